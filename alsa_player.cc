@@ -14,14 +14,25 @@
 
 #include "alsa_player.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #include <alsa/asoundlib.h>
 #include <sys/time.h>
 
-AlsaPlayer::AlsaPlayer(const Options& options) : options_(options) {
+namespace {
+
+// Interval between attempts to resume a suspended device.
+const int kSuspendRetryMs = 100;
+
+}  // namespace
+
+AlsaPlayer::AlsaPlayer(const Options& options)
+    : AudioSink(options.sample_format, options.sample_rate, options.channels),
+      options_(options) {
   int error = snd_pcm_open(&pcm_, options.device.c_str(),
                            SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
   if (error < 0) {
@@ -34,17 +45,13 @@ AlsaPlayer::AlsaPlayer(const Options& options) : options_(options) {
   if (options_.verbose) {
     std::cerr << GetAlsaPcmDump() << std::flush;
   }
-
-  // Allocate the PCM buffer.
-  const std::size_t sample_size =
-      snd_pcm_format_physical_width(options_.sample_format) / 8;
-  frame_size_ = options_.channels * sample_size;
-  buffer_.reset(new char[period_size_ * frame_size_]);
 }
 
 AlsaPlayer::~AlsaPlayer() {
   // Cleanup.
-  snd_pcm_close(pcm_);
+  if (pcm_ != nullptr) {
+    snd_pcm_close(pcm_);
+  }
 }
 
 void AlsaPlayer::SetupHwParams() {
@@ -59,8 +66,18 @@ void AlsaPlayer::SetupHwParams() {
 
   // Set ALSA hardware parameters for the requested PCM stream.
   check(snd_pcm_hw_params_any(pcm_, params));
-  check(snd_pcm_hw_params_set_access(pcm_, params,
-                                     SND_PCM_ACCESS_RW_INTERLEAVED));
+  if (options_.mmap) {
+    mmap_ = snd_pcm_hw_params_set_access(pcm_, params,
+                                         SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!mmap_) {
+      std::cerr << "AlsaPlayer: mmap access is not supported by the device, "
+                   "using read/write access." << std::endl;
+    }
+  }
+  if (!mmap_) {
+    check(snd_pcm_hw_params_set_access(pcm_, params,
+                                       SND_PCM_ACCESS_RW_INTERLEAVED));
+  }
   check(snd_pcm_hw_params_set_format(pcm_, params, options_.sample_format));
   check(snd_pcm_hw_params_set_rate(pcm_, params, options_.sample_rate, 0));
   check(snd_pcm_hw_params_set_channels(pcm_, params, options_.channels));
@@ -77,8 +94,11 @@ void AlsaPlayer::SetupHwParams() {
   check(snd_pcm_hw_params(pcm_, params));
 
   // Retrieve period and buffer sizes from ALSA.
-  check(snd_pcm_hw_params_get_period_size(params, &period_size_, 0));
-  check(snd_pcm_hw_params_get_buffer_size(params, &buffer_size_));
+  snd_pcm_uframes_t period_size = 0;
+  snd_pcm_uframes_t buffer_size = 0;
+  check(snd_pcm_hw_params_get_period_size(params, &period_size, 0));
+  check(snd_pcm_hw_params_get_buffer_size(params, &buffer_size));
+  SetBufferSize(period_size, buffer_size);
 }
 
 void AlsaPlayer::SetupSwParams() {
@@ -97,7 +117,7 @@ void AlsaPlayer::SetupSwParams() {
   // Start playing audio only after one full period is available, otherwise,
   // a short write (< 1 period) will cause the driver to leave the PREPARED
   // state and immediately go into underrun.
-  check(snd_pcm_sw_params_set_start_threshold(pcm_, params, period_size_));
+  check(snd_pcm_sw_params_set_start_threshold(pcm_, params, period_size()));
 
   // Write ALSA software params to the device.
   check(snd_pcm_sw_params(pcm_, params));
@@ -105,6 +125,7 @@ void AlsaPlayer::SetupSwParams() {
 
 std::vector<struct pollfd> AlsaPlayer::GetPollDescriptors() const {
   std::vector<struct pollfd> fds;
+  if (suspended_) return fds;
 
   int num_descriptors = snd_pcm_poll_descriptors_count(pcm_);
   if (num_descriptors > 0) {
@@ -120,6 +141,9 @@ std::vector<struct pollfd> AlsaPlayer::GetPollDescriptors() const {
 }
 
 int AlsaPlayer::GetPollEvents(struct pollfd* fds, int nfds) const {
+  // Retry resuming a suspended device whenever the poll timeout expires.
+  if (suspended_) return POLLOUT;
+
   unsigned short revents;
   int error = snd_pcm_poll_descriptors_revents(pcm_, fds, nfds, &revents);
   if (error < 0) {
@@ -129,51 +153,135 @@ int AlsaPlayer::GetPollEvents(struct pollfd* fds, int nfds) const {
   return revents;
 }
 
-std::size_t AlsaPlayer::Play(int count) {
+bool AlsaPlayer::Flush() {
+  if (suspended_ && !RecoverFromSuspend()) {
+    return false;
+  }
+  return AudioSink::Flush();
+}
+
+int AlsaPlayer::GetPollTimeout() const {
+  // A suspended device does not report readiness, so poll it periodically.
+  return suspended_ ? kSuspendRetryMs : -1;
+}
+
+char* AlsaPlayer::BeginWrite(std::size_t* frames) {
+  *frames = std::min<std::size_t>(*frames, period_size());
+  mmap_frames_ = 0;
+
+  // Audio can only go straight to the device if nothing is staged before it.
+  if (mmap_ && !pending()) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_);
+    if (avail < 0 && HandleWriteError(avail)) {
+      avail = snd_pcm_avail_update(pcm_);
+    }
+
+    const snd_pcm_channel_area_t* areas = nullptr;
+    snd_pcm_uframes_t size = std::min<snd_pcm_uframes_t>(*frames, avail);
+    if (avail > 0 &&
+        snd_pcm_mmap_begin(pcm_, &areas, &mmap_offset_, &size) == 0 &&
+        size > 0) {
+      mmap_frames_ = size;
+      *frames = size;
+      mmap_area_ = static_cast<char*>(areas[0].addr) +
+                   (areas[0].first + mmap_offset_ * areas[0].step) / 8;
+      return mmap_area_;
+    }
+  }
+
+  return AudioSink::BeginWrite(frames);
+}
+
+std::size_t AlsaPlayer::CommitWrite(std::size_t frames) {
+  if (mmap_frames_ == 0) {
+    return AudioSink::CommitWrite(frames);
+  }
+  mmap_frames_ = 0;
+  if (mixer()->active()) {
+    mixer()->Mix(mmap_area_, frames);
+  }
+
+  const snd_pcm_sframes_t r = snd_pcm_mmap_commit(pcm_, mmap_offset_, frames);
+  if (r < 0) {
+    // The audio in the device buffer is lost, as it is in an underrun.
+    HandleWriteError(r);
+    mixer()->Advance(frames);
+    return frames;
+  }
+  mixer()->Advance(r);
+
+  idle_ = false;
+  StartIfFilled();
+  return r;
+}
+
+std::size_t AlsaPlayer::Write(const char* data, std::size_t count) {
   std::size_t result = 0;
-  char* data = buffer_.get();
 
-  while (count > 0) {
-    snd_pcm_sframes_t r = snd_pcm_writei(pcm_, data, count);
+  while (count > 0 && !suspended_) {
+    snd_pcm_sframes_t r = mmap_ ? snd_pcm_mmap_writei(pcm_, data, count)
+                                : snd_pcm_writei(pcm_, data, count);
     if (r < 0) {
-      if (r == -EAGAIN) {
-        // TODO: Do not block on ALSA.
-        snd_pcm_wait(pcm_, 1000);
-      } else if (r == -EPIPE) {
-        RecoverFromUnderrun();
-      } else if (r == -ESTRPIPE) {
-        RecoverFromSuspend();
-      } else {
-        throw AlsaError("Failed to write PCM to ALSA.", r);
-      }
+      if (!HandleWriteError(r)) break;
     } else {
-      if (r < count) {
-        // TODO: Do not block on ALSA.
-        snd_pcm_wait(pcm_, 1000);
-      }
       idle_ = false;
       count -= r;
       result += r;
-      data += r * frame_size_;
+      data += r * frame_size();
+      if (r == 0) break;
     }
   }
 
   return result;
 }
 
+bool AlsaPlayer::HandleWriteError(snd_pcm_sframes_t error) {
+  if (error == -EAGAIN) {
+    return false;
+  } else if (error == -EPIPE) {
+    RecoverFromUnderrun();
+    return true;
+  } else if (error == -ESTRPIPE) {
+    suspended_ = true;
+    return RecoverFromSuspend();
+  } else {
+    throw AlsaError("Failed to write PCM to ALSA.", error);
+  }
+}
+
+void AlsaPlayer::StartIfFilled() {
+  if (snd_pcm_state(pcm_) != SND_PCM_STATE_PREPARED) return;
+
+  const snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_);
+  if (avail >= 0 && buffer_size() - avail >= period_size()) {
+    snd_pcm_start(pcm_);
+  }
+}
+
 void AlsaPlayer::Drain() {
   snd_pcm_drain(pcm_);
   snd_pcm_prepare(pcm_);
 }
 
-void AlsaPlayer::Pause() {
-  snd_pcm_pause(pcm_, true);
+bool AlsaPlayer::Pause() {
+  return snd_pcm_pause(pcm_, true) == 0;
 }
 
 void AlsaPlayer::Resume() {
   snd_pcm_pause(pcm_, false);
 }
 
+snd_pcm_sframes_t AlsaPlayer::GetDelay() const {
+  const snd_pcm_sframes_t staged = this->staged();
+  snd_pcm_sframes_t delay = 0;
+  if (snd_pcm_delay(pcm_, &delay) < 0 || delay < 0) {
+    // The stream is not running, so nothing is waiting to be played on the
+    // device.
+    return staged;
+  }
+  return delay + staged;
+}
+
 void AlsaPlayer::Idle() {
   // This method is called after an AudioTask has finished running (sending
   // its data to the player) and there is no other task in the queue. This
@@ -186,7 +294,27 @@ void AlsaPlayer::Idle() {
   idle_ = true;
 }
 
+bool AlsaPlayer::running() const {
+  return snd_pcm_state(pcm_) == SND_PCM_STATE_RUNNING;
+}
+
+void AlsaPlayer::Reconfigure(std::chrono::microseconds buffer_time) {
+  DropStaged();
+  snd_pcm_drop(pcm_);
+  snd_pcm_hw_free(pcm_);
+
+  options_.buffer_time = buffer_time;
+  SetupHwParams();
+  SetupSwParams();
+
+  if (options_.verbose) {
+    std::cerr << GetAlsaPcmDump() << std::flush;
+  }
+}
+
 void AlsaPlayer::Interrupt() {
+  DropStaged();
+  if (suspended_) return;
   snd_pcm_drop(pcm_);
   snd_pcm_prepare(pcm_);
 }
@@ -210,6 +338,8 @@ void AlsaPlayer::RecoverFromUnderrun() {
   }
 
   if (!idle_) {
+    ++underruns_;
+
     struct timeval now, diff, tstamp;
     gettimeofday(&now, 0);
     snd_pcm_status_get_trigger_tstamp(status, &tstamp);
@@ -225,14 +355,20 @@ void AlsaPlayer::RecoverFromUnderrun() {
   }
 }
 
-void AlsaPlayer::RecoverFromSuspend() {
-  std::cerr << "AlsaPlayer: ALSA was suspended, trying to resume..."
-            << std::endl;
+bool AlsaPlayer::RecoverFromSuspend() {
+  if (!suspended_) return true;
+
+  // Report only the first attempt, since this is retried until the suspend
+  // flag is released.
+  if (!resume_reported_) {
+    std::cerr << "AlsaPlayer: ALSA was suspended, trying to resume..."
+              << std::endl;
+    resume_reported_ = true;
+  }
 
-  int error;
-  while ((error = snd_pcm_resume(pcm_)) == -EAGAIN) {
-    // TODO: Do not block on ALSA.
-    sleep(1);  // wait until suspend flag is released
+  int error = snd_pcm_resume(pcm_);
+  if (error == -EAGAIN) {
+    return false;
   }
 
   if (error < 0) {
@@ -245,6 +381,9 @@ void AlsaPlayer::RecoverFromSuspend() {
   }
 
   std::cerr << "AlsaPlayer: Recovered from suspend." << std::endl;
+  suspended_ = false;
+  resume_reported_ = false;
+  return true;
 }
 
 std::string AlsaPlayer::GetAlsaPcmDump() {
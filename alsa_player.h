@@ -16,7 +16,6 @@
 #define ALSA_PLAYER_H_
 
 #include <chrono>
-#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -24,10 +23,12 @@
 #include <poll.h>
 #include <alsa/asoundlib.h>
 
+#include "audio_sink.h"
+
 // PCM Audio Player using ALSA.
 //
 // This class is responsible for handling communication with the ALSA drivers.
-class AlsaPlayer {
+class AlsaPlayer : public AudioSink {
  public:
   // Player options.
   struct Options {
@@ -52,50 +53,83 @@ class AlsaPlayer {
     // The default value zero means that the default buffer size will be
     // used.
     std::chrono::microseconds buffer_time = std::chrono::microseconds(0);
+
+    // Whether to access the device buffer directly through mmap, so audio
+    // generated with BeginWrite() and CommitWrite() is not copied. Falls back
+    // to read/write access if the device does not support it.
+    bool mmap = false;
   };
 
   AlsaPlayer(const Options& options = Options());
-  virtual ~AlsaPlayer();
-
-  // Read-only accessors.
-  snd_pcm_format_t sample_format() const { return options_.sample_format; }
-  unsigned int sample_rate() const { return options_.sample_rate; }
-  unsigned int period_size() const { return period_size_; }
-  char* buffer() const { return buffer_.get(); }
-
-  // ALSA driver descriptors for polling.
-  std::vector<struct pollfd> GetPollDescriptors() const;
-  int GetPollEvents(struct pollfd *fds, int nfds) const;
-
-  std::size_t Play(int count);
-  void Drain();
-  void Pause();
-  void Resume();
-
-  // Sets the end of a segment of audio, informing to the player that there
-  // will be no more audio for awhile and that an eventual underrun is
-  // expected.
-  void Idle();
-
-  void Interrupt();
+  ~AlsaPlayer() override;
+
+  // Returns whether the device buffer is accessed through mmap.
+  bool mmap() const { return mmap_; }
+
+  // In mmap mode, BeginWrite() returns the device buffer itself.
+  char* BeginWrite(std::size_t* frames) override;
+  std::size_t CommitWrite(std::size_t frames) override;
+
+  // The device may also be waiting to recover from a suspend, which Flush()
+  // retries first.
+  bool pending() const override { return AudioSink::pending() || suspended_; }
+  bool Flush() override;
+
+  // AudioSink overrides.
+  bool running() const override;
+  int underruns() const override { return underruns_; }
+  void Reconfigure(std::chrono::microseconds buffer_time) override;
+  std::vector<struct pollfd> GetPollDescriptors() const override;
+  int GetPollEvents(struct pollfd* fds, int nfds) const override;
+  int GetPollTimeout() const override;
+  void Drain() override;
+  bool Pause() override;
+  void Resume() override;
+  snd_pcm_sframes_t GetDelay() const override;
+  void Idle() override;
+  void Interrupt() override;
+
+ protected:
+  // Writes as many of count frames as the device accepts without blocking,
+  // recovering from underruns. Returns the number of frames written.
+  std::size_t Write(const char* data, std::size_t count) override;
 
  private:
   void SetupHwParams();
   void SetupSwParams();
+
+  // Handles an error returned by an ALSA write function. Returns whether
+  // writing may be retried.
+  bool HandleWriteError(snd_pcm_sframes_t error);
+
+  // Starts a prepared PCM once at least one period was written through mmap,
+  // which does not honor the start threshold.
+  void StartIfFilled();
+
   void RecoverFromUnderrun();
-  void RecoverFromSuspend();
+
+  // Tries to resume the device after a suspend. Returns false if the device
+  // is still suspended, in which case it is retried on the next Flush().
+  bool RecoverFromSuspend();
 
   // Returns a string reporting the ALSA PCM configuration, for debugging.
   std::string GetAlsaPcmDump();
 
-  const Options options_;
+  Options options_;
   snd_pcm_t* pcm_ = nullptr;
-  snd_pcm_uframes_t buffer_size_ = 0;
-  snd_pcm_uframes_t period_size_ = 0;
-  std::size_t frame_size_ = 0;
   bool idle_ = false;
-
-  std::unique_ptr<char[]> buffer_;
+  bool mmap_ = false;
+  int underruns_ = 0;
+
+  // Area of the device buffer returned by the last call to BeginWrite() in
+  // mmap mode, or zero frames if the player buffer was returned.
+  char* mmap_area_ = nullptr;
+  snd_pcm_uframes_t mmap_offset_ = 0;
+  snd_pcm_uframes_t mmap_frames_ = 0;
+
+  // Whether the device is suspended, waiting for snd_pcm_resume() to succeed.
+  bool suspended_ = false;
+  bool resume_reported_ = false;
 };
 
 // Exception thrown for ALSA errors.
@@ -0,0 +1,151 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the CPU time the AlsaPlayer spends per second of audio, generating
+// a tone in place with BeginWrite() and CommitWrite(), both with read/write
+// and with mmap access to the device. It is meant to be run against devices
+// that do not depend on sound hardware, such as the ALSA "null" plugin or the
+// "file" plugin, e.g.:
+//
+//   alsa_player_benchmark --device null --seconds 10
+//   alsa_player_benchmark --device "file:'/tmp/out.raw',raw"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <poll.h>
+
+#include "alsa_player.h"
+
+namespace po = boost::program_options;
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+namespace {
+
+struct Result {
+  bool mmap = false;
+  double audio_seconds = 0;
+  double cpu_seconds = 0;
+  double wall_seconds = 0;
+};
+
+// Plays a tone of the given duration on a new player, returning the time it
+// took.
+Result Run(const AlsaPlayer::Options& options, double seconds) {
+  AlsaPlayer player(options);
+
+  const std::size_t total_frames = seconds * player.sample_rate();
+  const double step = 2 * M_PI * 440.0 / player.sample_rate();
+  std::size_t t = 0;
+
+  const std::clock_t cpu_start = std::clock();
+  const auto wall_start = std::chrono::steady_clock::now();
+
+  while (t < total_frames || player.pending()) {
+    std::vector<struct pollfd> fds = player.GetPollDescriptors();
+    if (poll(fds.data(), fds.size(), player.GetPollTimeout()) < 0) {
+      continue;
+    }
+    if (!player.GetPollEvents(fds.data(), fds.size()) || !player.Flush()) {
+      continue;
+    }
+    if (t == total_frames) continue;
+
+    std::size_t frames = total_frames - t;
+    short* buffer = reinterpret_cast<short*>(player.BeginWrite(&frames));
+    for (std::size_t i = 0; i < frames; ++i) {
+      buffer[i] = 0.5 * std::sin(step * (t + i)) * (1 << 15);
+    }
+    t += player.CommitWrite(frames);
+  }
+  player.Idle();
+
+  Result result;
+  result.mmap = player.mmap();
+  result.audio_seconds = static_cast<double>(total_frames) /
+                         player.sample_rate();
+  result.cpu_seconds =
+      static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  result.wall_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - wall_start)
+                            .count();
+  return result;
+}
+
+void Report(const string& mode, const Result& result) {
+  cout << mode << (result.mmap ? " (mmap)" : " (read/write)") << ": "
+       << result.audio_seconds << "s of audio in " << result.wall_seconds
+       << "s, " << 1000 * result.cpu_seconds / result.audio_seconds
+       << "ms of CPU per second of audio." << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  /* clang-format off */
+  po::options_description options("Benchmark options");
+  options.add_options()
+      ("help,h", "Display this help message.")
+      ("device,D", po::value<string>()->value_name("name"),
+       "ALSA device to play audio output (default: null).")
+      ("rate,r", po::value<unsigned int>()->value_name("hz"),
+       "Audio sample rate.")
+      ("seconds", po::value<double>()->value_name("seconds"),
+       "Duration of the audio played in each mode (default: 5).");
+  /* clang-format on */
+
+  po::variables_map args;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), args);
+    po::notify(args);
+  } catch (po::error& e) {
+    cerr << "Error parsing command line options:\n" << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (args.count("help")) {
+    cerr << options << "\n";
+    return EXIT_SUCCESS;
+  }
+
+  AlsaPlayer::Options alsa_options;
+  alsa_options.device =
+      args.count("device") ? args["device"].as<string>() : "null";
+  if (args.count("rate")) {
+    alsa_options.sample_rate = args["rate"].as<unsigned int>();
+  }
+  const double seconds =
+      args.count("seconds") ? args["seconds"].as<double>() : 5.0;
+
+  try {
+    alsa_options.mmap = false;
+    Report("rw", Run(alsa_options, seconds));
+    alsa_options.mmap = true;
+    Report("mmap", Run(alsa_options, seconds));
+  } catch (std::exception& e) {
+    cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_decoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// WAV format tags.
+const std::uint16_t kWavFormatPcm = 1;
+const std::uint16_t kWavFormatFloat = 3;
+const std::uint16_t kWavFormatExtensible = 0xfffe;
+
+// Reads a little-endian unsigned integer of the given size.
+std::uint32_t ReadLE(const char* data, int bytes) {
+  std::uint32_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+// Converts count little-endian samples of the given format to float.
+void ConvertSamples(const char* data, std::size_t count, std::uint16_t format,
+                    int bits, float* out) {
+  const int bytes = bits / 8;
+  for (std::size_t i = 0; i < count; ++i, data += bytes) {
+    if (format == kWavFormatFloat) {
+      if (bits == 64) {
+        double value;
+        std::memcpy(&value, data, sizeof(value));
+        out[i] = value;
+      } else {
+        float value;
+        std::memcpy(&value, data, sizeof(value));
+        out[i] = value;
+      }
+      continue;
+    }
+
+    const std::uint32_t value = ReadLE(data, bytes);
+    switch (bits) {
+      case 8:
+        // 8-bit WAV samples are unsigned.
+        out[i] = (static_cast<int>(value) - 128) / 128.0f;
+        break;
+      case 16:
+        out[i] = static_cast<std::int16_t>(value) / 32768.0f;
+        break;
+      case 24:
+        // Sign-extend from 24 bits.
+        out[i] = static_cast<std::int32_t>(value << 8) / 2147483648.0f;
+        break;
+      default:
+        out[i] = static_cast<std::int32_t>(value) / 2147483648.0f;
+        break;
+    }
+  }
+}
+
+}  // namespace
+
+bool WavDecoder::CanDecode(const char* data, std::size_t size) const {
+  return size >= 12 && std::memcmp(data, "RIFF", 4) == 0 &&
+         std::memcmp(data + 8, "WAVE", 4) == 0;
+}
+
+AudioClip WavDecoder::Decode(const char* data, std::size_t size) const {
+  if (!CanDecode(data, size)) {
+    throw DecodeError("Not a WAV file.");
+  }
+
+  std::uint16_t format = 0;
+  int bits = 0;
+  AudioClip clip;
+  const char* samples = nullptr;
+  std::size_t samples_size = 0;
+
+  // Walk the chunks of the file, looking for the format and the samples.
+  std::size_t pos = 12;
+  while (pos + 8 <= size) {
+    const char* id = data + pos;
+    const std::size_t body = pos + 8;
+    // Accept truncated files, using whatever part of the chunk is there.
+    const std::size_t chunk_size =
+        std::min<std::size_t>(ReadLE(data + pos + 4, 4), size - body);
+
+    if (std::memcmp(id, "fmt ", 4) == 0) {
+      if (chunk_size < 16) {
+        throw DecodeError("Invalid WAV format chunk.");
+      }
+      format = ReadLE(data + body, 2);
+      clip.channels = ReadLE(data + body + 2, 2);
+      clip.sample_rate = ReadLE(data + body + 4, 4);
+      bits = ReadLE(data + body + 14, 2);
+      if (format == kWavFormatExtensible && chunk_size >= 26) {
+        // The format tag is the start of the sub-format GUID.
+        format = ReadLE(data + body + 24, 2);
+      }
+    } else if (std::memcmp(id, "data", 4) == 0) {
+      samples = data + body;
+      samples_size = chunk_size;
+    }
+
+    // Chunks are padded to an even size.
+    pos = body + chunk_size + (chunk_size & 1);
+  }
+
+  if (format == 0 || samples == nullptr) {
+    throw DecodeError("WAV file without format or data.");
+  }
+  if (clip.channels == 0 || clip.sample_rate == 0) {
+    throw DecodeError("Invalid WAV channels or sample rate.");
+  }
+  const bool valid_pcm = format == kWavFormatPcm &&
+                         (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+  const bool valid_float =
+      format == kWavFormatFloat && (bits == 32 || bits == 64);
+  if (!valid_pcm && !valid_float) {
+    throw DecodeError("Unsupported WAV sample format.");
+  }
+
+  const std::size_t frame_size = clip.channels * bits / 8;
+  const std::size_t count = samples_size / frame_size * clip.channels;
+  clip.samples.resize(count);
+  ConvertSamples(samples, count, format, bits, clip.samples.data());
+  return clip;
+}
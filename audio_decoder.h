@@ -0,0 +1,66 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUDIO_DECODER_H_
+#define AUDIO_DECODER_H_
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Decoded audio, as interleaved floating point samples in the range [-1, 1].
+struct AudioClip {
+  unsigned int sample_rate = 0;
+  unsigned int channels = 0;
+  std::vector<float> samples;
+
+  std::size_t frames() const {
+    return channels > 0 ? samples.size() / channels : 0;
+  }
+};
+
+// Interface of the decoders of audio file formats.
+class AudioDecoder {
+ public:
+  virtual ~AudioDecoder() {}
+
+  // Returns whether the data looks like a file of the format of this decoder.
+  virtual bool CanDecode(const char* data, std::size_t size) const = 0;
+
+  // Decodes the given file contents. Throws DecodeError if the data is not
+  // valid.
+  virtual AudioClip Decode(const char* data, std::size_t size) const = 0;
+
+ protected:
+  AudioDecoder() {}
+};
+
+// Decoder of RIFF WAVE files with 8, 16, 24 or 32 bit integer samples, or 32
+// or 64 bit floating point samples.
+class WavDecoder : public AudioDecoder {
+ public:
+  WavDecoder() = default;
+
+  bool CanDecode(const char* data, std::size_t size) const override;
+  AudioClip Decode(const char* data, std::size_t size) const override;
+};
+
+class DecodeError : public std::runtime_error {
+ public:
+  explicit DecodeError(const std::string& arg) : runtime_error(arg) {}
+};
+
+#endif  // AUDIO_DECODER_H_
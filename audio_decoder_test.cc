@@ -0,0 +1,136 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_decoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << "\n";
+  }
+}
+
+void AppendLE(string* out, std::uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+// Builds a WAV file with the given format and raw sample data.
+string MakeWav(std::uint16_t format, int channels, int rate, int bits,
+               const string& samples) {
+  string fmt;
+  AppendLE(&fmt, format, 2);
+  AppendLE(&fmt, channels, 2);
+  AppendLE(&fmt, rate, 4);
+  AppendLE(&fmt, rate * channels * bits / 8, 4);
+  AppendLE(&fmt, channels * bits / 8, 2);
+  AppendLE(&fmt, bits, 2);
+
+  string wav = "RIFF";
+  AppendLE(&wav, 4 + 8 + fmt.size() + 8 + samples.size(), 4);
+  wav += "WAVE";
+  // An unknown chunk with an odd size, which must be skipped with its padding.
+  wav += "LIST";
+  AppendLE(&wav, 3, 4);
+  wav += string("abc\0", 4);
+  wav += "fmt ";
+  AppendLE(&wav, fmt.size(), 4);
+  wav += fmt;
+  wav += "data";
+  AppendLE(&wav, samples.size(), 4);
+  wav += samples;
+  return wav;
+}
+
+bool Near(float a, float b) { return std::fabs(a - b) < 1e-4f; }
+
+int main() {
+  WavDecoder decoder;
+
+  {
+    string samples;
+    AppendLE(&samples, 0, 2);
+    AppendLE(&samples, 16384, 2);
+    AppendLE(&samples, static_cast<std::uint16_t>(-32768), 2);
+    AppendLE(&samples, 32767, 2);
+    const string wav = MakeWav(1, 2, 22050, 16, samples);
+    Check("Recognizes WAV", decoder.CanDecode(wav.data(), wav.size()));
+    const AudioClip clip = decoder.Decode(wav.data(), wav.size());
+    Check("16-bit format", clip.sample_rate == 22050 && clip.channels == 2 &&
+                               clip.frames() == 2);
+    Check("16-bit samples", Near(clip.samples[0], 0) &&
+                                Near(clip.samples[1], 0.5f) &&
+                                Near(clip.samples[2], -1) &&
+                                Near(clip.samples[3], 1));
+  }
+
+  {
+    const string wav = MakeWav(1, 1, 8000, 8, string("\x80\xc0\x00", 3));
+    const AudioClip clip = decoder.Decode(wav.data(), wav.size());
+    Check("8-bit samples", clip.frames() == 3 && Near(clip.samples[0], 0) &&
+                               Near(clip.samples[1], 0.5f) &&
+                               Near(clip.samples[2], -1));
+  }
+
+  {
+    string samples(8, '\0');
+    const float values[] = {0.25f, -0.75f};
+    std::memcpy(&samples[0], values, sizeof(values));
+    const string wav = MakeWav(3, 1, 44100, 32, samples);
+    const AudioClip clip = decoder.Decode(wav.data(), wav.size());
+    Check("Float samples", clip.frames() == 2 &&
+                               Near(clip.samples[0], 0.25f) &&
+                               Near(clip.samples[1], -0.75f));
+  }
+
+  {
+    string samples;
+    AppendLE(&samples, 1000, 2);
+    AppendLE(&samples, 2000, 2);
+    string wav = MakeWav(1, 1, 8000, 16, samples);
+    wav.resize(wav.size() - 1);
+    const AudioClip clip = decoder.Decode(wav.data(), wav.size());
+    Check("Truncated file", clip.frames() == 1);
+  }
+
+  {
+    const string text = "This is not a WAV file.";
+    Check("Rejects other files", !decoder.CanDecode(text.data(), text.size()));
+    const string wav = MakeWav(2, 1, 8000, 4, string(4, '\0'));
+    bool thrown = false;
+    try {
+      decoder.Decode(wav.data(), wav.size());
+    } catch (DecodeError& e) {
+      thrown = true;
+    }
+    Check("Rejects unsupported formats", thrown);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
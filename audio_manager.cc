@@ -12,67 +12,435 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "alsa_player.h"
+#include "audio_sink.h"
 #include "audio_manager.h"
 #include "eci-c++.h"
+#include "tracer.h"
 
+#include <algorithm>
 #include <iostream>
 
-AudioManager::AudioManager(std::unique_ptr<AlsaPlayer> player)
+constexpr int AudioManager::kNumLanes;
+
+AudioManager::AudioManager(std::unique_ptr<AudioSink> player)
     : player_(std::move(player)) {}
 
-void AudioManager::Push(std::unique_ptr<AudioTask> task) {
-  if (queue_.empty()) {
-    task->StartTask(player_.get());
+AudioManager::~AudioManager() {
+  if (metrics_ != nullptr) {
+    metrics_->RemoveCallbacks(this);
+  }
+}
+
+void AudioManager::Push(std::unique_ptr<AudioTask> task, Lane lane,
+                        int source) {
+  LaneQueue& queue = lanes_[lane];
+  auto it = std::find_if(
+      queue.begin(), queue.end(),
+      [source](const SourceQueue& entry) { return entry.source == source; });
+  if (it == queue.end()) {
+    it = queue.insert(queue.end(), SourceQueue{source, {}});
   }
-  queue_.push(std::move(task));
+  task->set_source(source);
+  it->tasks.push_back(QueuedTask{std::move(task), Clock::now(), false, 0});
+
+  LaneStats& stats = stats_[lane];
+  ++stats.pushed;
+  ++stats.depth;
+  if (lane == BULK) {
+    EnforceBudget(&*it);
+  }
+  stats.max_depth = std::max(stats.max_depth, stats.depth);
+
+  if (current_ == nullptr) {
+    ApplyBufferTime();
+    StartTask(lane);
+  } else if (lane == URGENT && current_lane_ != URGENT) {
+    PreemptTask();
+    StartTask(lane);
+  }
+}
+
+void AudioManager::StartTask(Lane lane) {
+  SourceQueue& entry = lanes_[lane].front();
+  QueuedTask& next = entry.tasks.front();
+  if (!next.started) {
+    const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - next.queued);
+    LaneStats& stats = stats_[lane];
+    stats.total_wait += wait;
+    stats.max_wait = std::max(stats.max_wait, wait);
+    next.started = true;
+  }
+
+  current_ = next.task.get();
+  current_lane_ = lane;
+  current_source_ = entry.source;
+  Tracer::Mark("StartTask", current_->trace_id(), "lane", lane);
+  current_->StartTask(player_.get());
+}
+
+void AudioManager::EndCurrentTask(bool finished) {
+  Tracer::Mark("EndTask", current_->trace_id(), "finished", finished);
+  current_->EndTask(player_.get(), finished);
+}
+
+std::unique_ptr<AudioTask> AudioManager::PopCurrentTask() {
+  LaneQueue& queue = lanes_[current_lane_];
+  SourceQueue& entry = queue.front();
+  std::unique_ptr<AudioTask> task = std::move(entry.tasks.front().task);
+  entry.tasks.pop_front();
+  --stats_[current_lane_].depth;
+  current_ = nullptr;
+
+  if (entry.tasks.empty()) {
+    queue.pop_front();
+  } else {
+    queue.splice(queue.end(), queue, queue.begin());
+  }
+  return task;
+}
+
+bool AudioManager::StartNextTask() {
+  for (int i = 0; i < kNumLanes; ++i) {
+    if (!lanes_[i].empty()) {
+      StartTask(static_cast<Lane>(i));
+      return true;
+    }
+  }
+  return false;
+}
+
+void AudioManager::PreemptTask() {
+  EndCurrentTask(false);
+  ++stats_[current_lane_].preempted;
+  current_ = nullptr;
+
+  // Drop the audio of the interrupted task that was not played yet, so the
+  // urgent task is heard at once. Speech continues later from the word that
+  // was interrupted.
+  player_->Interrupt();
+  measure_jitter_ = false;
+}
+
+void AudioManager::EnforceBudget(SourceQueue* entry) {
+  if (budget_.max_bytes == 0 && budget_.max_duration.count() == 0) return;
+
+  // The running task, or the one interrupted by urgent tasks, is at the front
+  // and stays.
+  std::deque<QueuedTask>& tasks = entry->tasks;
+  const std::size_t first = tasks.front().started ? 1 : 0;
+  std::size_t bytes = 0;
+  std::chrono::milliseconds duration(0);
+  for (std::size_t i = first; i < tasks.size(); ++i) {
+    bytes += tasks[i].task->queued_bytes();
+    duration += tasks[i].task->EstimateDuration();
+  }
+  if (WithinBudget(bytes, duration)) return;
+
+  // Remove the oldest tasks, always keeping the one just pushed.
+  std::size_t end = first;
+  std::size_t removed = 0;
+  std::size_t skipped = 0;
+  while (end + 1 < tasks.size() &&
+         (budget_.policy == QueueBudget::KEEP_LATEST ||
+          !WithinBudget(bytes, duration))) {
+    const QueuedTask& queued = tasks[end++];
+    bytes -= queued.task->queued_bytes();
+    duration -= queued.task->EstimateDuration();
+    if (queued.skipped > 0) {
+      // A previous notice, whose lines are announced by the new one.
+      skipped += queued.skipped;
+    } else {
+      ++removed;
+      if (queued.task->queued_bytes() > 0) ++skipped;
+    }
+  }
+
+  const Clock::time_point oldest = tasks[first].queued;
+  tasks.erase(tasks.begin() + first, tasks.begin() + end);
+  LaneStats& stats = stats_[BULK];
+  stats.depth -= end - first;
+
+  if (budget_.policy != QueueBudget::SUMMARIZE || !budget_.make_notice) {
+    stats.dropped += removed;
+    return;
+  }
+  stats.merged += removed;
+  if (skipped > 0) {
+    std::unique_ptr<AudioTask> notice = budget_.make_notice(skipped);
+    notice->set_source(entry->source);
+    tasks.insert(tasks.begin() + first,
+                 QueuedTask{std::move(notice), oldest, false, skipped});
+    ++stats.depth;
+  }
+}
+
+bool AudioManager::WithinBudget(std::size_t bytes,
+                                std::chrono::milliseconds duration) const {
+  return (budget_.max_bytes == 0 || bytes <= budget_.max_bytes) &&
+         (budget_.max_duration.count() == 0 ||
+          duration <= budget_.max_duration);
+}
+
+void AudioManager::PlayIcon(std::shared_ptr<const Icon> icon, float gain,
+                            int source) {
+  player_->mixer()->Add(std::move(icon), gain, source);
+  idle_pending_ = false;
 }
 
 void AudioManager::Run() {
-  if (queue_.empty()) return;
+  AudioSink* player = player_.get();
+
+  // Audio staged by the player must reach the device before producing more.
+  if (!player->Flush()) return;
+
+  if (current_ == nullptr) {
+    if (player->mixer()->active()) {
+      PlayVoices();
+    } else if (idle_pending_) {
+      player->Idle();
+      idle_pending_ = false;
+    }
+    return;
+  }
+
+  if (tuner_ != nullptr) {
+    MeasureJitter();
+  }
 
-  AlsaPlayer* player = player_.get();
-  AudioTask* task = queue_.front().get();
+  const AudioTask::TaskResult result = current_->Run(player);
 
-  if (task->Run(player) == AudioTask::CONTINUE) {
+  if (tuner_ != nullptr) {
+    // Jitter is only measured from the moment the device buffer is full,
+    // and not while it is being filled, e.g. at the start of an utterance.
+    measure_jitter_ = player->running() && GetFreeFrames() < period_frames();
+  }
+
+  if (result == AudioTask::CONTINUE) {
     return;
   }
 
-  task->EndTask(player, true);
-  queue_.pop();
+  EndCurrentTask(true);
+  PopCurrentTask();
+
+  if (!StartNextTask()) {
+    if (tuner_ != nullptr) {
+      EndUtterance();
+    }
+    if (!player->mixer()->active()) {
+      SetIdle();
+    }
+  }
+}
+
+void AudioManager::PlayVoices() {
+  AudioSink* player = player_.get();
+  Mixer* mixer = player->mixer();
+
+  std::size_t frames =
+      std::min<std::size_t>(player->period_size(), mixer->remaining());
+  char* buffer = player->BeginWrite(&frames);
+  mixer->format().FillSilence(buffer, frames * player->channels());
+  player->CommitWrite(frames);
+
+  if (!mixer->active()) {
+    SetIdle();
+  }
+}
 
-  if (queue_.empty()) {
-    player->Idle();
+void AudioManager::SetIdle() {
+  // The player goes idle once the last of the audio is written.
+  if (player_->pending()) {
+    idle_pending_ = true;
   } else {
-    AudioTask* next_task = queue_.front().get();
-    next_task->StartTask(player);
+    player_->Idle();
   }
 }
 
-void AudioManager::Clear() {
-  if (queue_.empty()) return;
+std::queue<std::unique_ptr<AudioTask>> AudioManager::Clear() {
+  std::queue<std::unique_ptr<AudioTask>> tasks;
+  idle_pending_ = false;
+  player_->mixer()->Clear();
+  if (current_ == nullptr) return tasks;
 
-  AlsaPlayer* player = player_.get();
-  AudioTask* task = queue_.front().get();
+  EndCurrentTask(false);
+  current_ = nullptr;
 
-  task->EndTask(player, false);
+  // The current task goes first, then the rest in the order they would have
+  // run.
+  SourceQueue& current_entry = lanes_[current_lane_].front();
+  tasks.push(std::move(current_entry.tasks.front().task));
+  current_entry.tasks.pop_front();
+  for (int i = 0; i < kNumLanes; ++i) {
+    for (SourceQueue& entry : lanes_[i]) {
+      while (!entry.tasks.empty()) {
+        tasks.push(std::move(entry.tasks.front().task));
+        entry.tasks.pop_front();
+      }
+    }
+    lanes_[i].clear();
+    stats_[i].depth = 0;
+  }
+  return tasks;
+}
+
+std::queue<std::unique_ptr<AudioTask>> AudioManager::Clear(int source) {
+  std::queue<std::unique_ptr<AudioTask>> tasks;
+  if (current_ != nullptr && current_source_ == source) {
+    EndCurrentTask(false);
+    current_ = nullptr;
 
-  decltype(queue_) empty;
-  std::swap(queue_, empty);
+    SourceQueue& entry = lanes_[current_lane_].front();
+    tasks.push(std::move(entry.tasks.front().task));
+    entry.tasks.pop_front();
+    --stats_[current_lane_].depth;
+  }
+
+  for (int i = 0; i < kNumLanes; ++i) {
+    LaneQueue& queue = lanes_[i];
+    for (auto it = queue.begin(); it != queue.end();) {
+      if (it->source != source) {
+        ++it;
+        continue;
+      }
+      stats_[i].depth -= it->tasks.size();
+      while (!it->tasks.empty()) {
+        tasks.push(std::move(it->tasks.front().task));
+        it->tasks.pop_front();
+      }
+      it = queue.erase(it);
+    }
+  }
+
+  // The other sources go on, if they have anything to play, and so do their
+  // voices.
+  player_->mixer()->Clear(source);
+  if (current_ == nullptr && !StartNextTask()) {
+    idle_pending_ = false;
+  }
+  return tasks;
 }
 
-std::vector<pollfd> AudioManager::GetPollDescriptors() const {
-  if (!queue_.empty()) {
-    return queue_.front()->GetPollDescriptors(player_.get());
+AudioManager::LaneStats AudioManager::lane_stats(Lane lane) const {
+  return stats_[lane];
+}
+
+bool AudioManager::ParsePolicy(const std::string& name,
+                               QueueBudget::Policy* policy) {
+  if (name == "drop-oldest") {
+    *policy = QueueBudget::DROP_OLDEST;
+  } else if (name == "keep-latest") {
+    *policy = QueueBudget::KEEP_LATEST;
+  } else if (name == "summarize") {
+    *policy = QueueBudget::SUMMARIZE;
   } else {
-    return {};
+    return false;
   }
+  return true;
 }
 
-int AudioManager::GetPollEvents(pollfd* fds, int nfds) const {
-  if (!queue_.empty()) {
-    return queue_.front()->GetPollEvents(player_.get(), fds, nfds);
-  } else {
-    return 0;
+std::string AudioManager::GetLaneName(Lane lane) {
+  switch (lane) {
+    case URGENT:
+      return "urgent";
+    case INTERACTIVE:
+      return "interactive";
+    case BULK:
+      return "bulk";
+  }
+  return "";
+}
+
+void AudioManager::ExportMetrics(Metrics* metrics) {
+  metrics_ = metrics;
+  for (int i = 0; i < kNumLanes; ++i) {
+    const LaneStats* stats = &stats_[i];
+    const std::string lane =
+        Metrics::Label("lane", GetLaneName(static_cast<Lane>(i)));
+    metrics->AddCallback("speech_server_queue_depth",
+                         "Tasks in the lane, including the running one.",
+                         Metrics::GAUGE, lane,
+                         [stats]() { return stats->depth; }, this);
+    metrics->AddCallback("speech_server_tasks_total",
+                         "Tasks pushed to the lane.", Metrics::COUNTER, lane,
+                         [stats]() { return stats->pushed; }, this);
+    metrics->AddCallback("speech_server_tasks_preempted_total",
+                         "Tasks of the lane interrupted by urgent tasks.",
+                         Metrics::COUNTER, lane,
+                         [stats]() { return stats->preempted; }, this);
+    metrics->AddCallback(
+        "speech_server_tasks_dropped_total",
+        "Tasks removed to keep the lane within its budget, including those "
+        "replaced by a notice.",
+        Metrics::COUNTER, lane,
+        [stats]() { return stats->dropped + stats->merged; }, this);
   }
+  metrics->AddCallback("speech_server_underruns_total",
+                       "Underruns of the audio device.", Metrics::COUNTER, "",
+                       [this]() { return player_->underruns(); }, this);
+}
+
+void AudioManager::set_buffer_tuner(std::unique_ptr<BufferTuner> tuner) {
+  tuner_ = std::move(tuner);
+  underruns_ = player_->underruns();
+}
+
+void AudioManager::MeasureJitter() {
+  // The device asks for more audio once a period is free in its buffer. Any
+  // audio played beyond that, since the buffer was last filled, before the
+  // main loop came back to refill it is scheduling jitter.
+  AudioSink* player = player_.get();
+  if (!measure_jitter_ || !player->running()) return;
+
+  const snd_pcm_sframes_t late_frames = GetFreeFrames() - period_frames();
+  if (late_frames <= 0) return;
+
+  tuner_->AddJitter(std::chrono::microseconds(late_frames * 1000000LL /
+                                              player->sample_rate()));
+}
+
+snd_pcm_sframes_t AudioManager::GetFreeFrames() const {
+  return static_cast<snd_pcm_sframes_t>(player_->buffer_size()) -
+         player_->GetDelay();
+}
+
+void AudioManager::EndUtterance() {
+  for (int i = underruns_; i < player_->underruns(); ++i) {
+    tuner_->AddUnderrun();
+  }
+  measure_jitter_ = false;
+  if (tuner_->EndUtterance()) {
+    reconfigure_pending_ = true;
+  }
+}
+
+void AudioManager::ApplyBufferTime() {
+  underruns_ = player_->underruns();
+  if (!reconfigure_pending_) return;
+
+  // Reconfiguring drops the audio in the device, so wait for the end of the
+  // previous utterance, if it is still playing.
+  AudioSink* player = player_.get();
+  if (player->pending() || player->mixer()->active() ||
+      player->GetDelay() > 0) {
+    return;
+  }
+
+  player->Reconfigure(tuner_->buffer_time());
+  underruns_ = player->underruns();
+  reconfigure_pending_ = false;
+}
+
+std::vector<pollfd> AudioManager::GetPollDescriptors() const {
+  // Staged audio, tasks and voices all wait for the player.
+  return player_->GetPollDescriptors();
+}
+
+int AudioManager::GetPollEvents(pollfd* fds, int nfds) const {
+  if (!pending()) return 0;
+  return player_->GetPollEvents(fds, nfds);
+}
+
+int AudioManager::GetPollTimeout() const {
+  return player_->GetPollTimeout();
 }
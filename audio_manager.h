@@ -15,50 +15,281 @@
 #ifndef AUDIO_MANAGER_H_
 #define AUDIO_MANAGER_H_
 
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <list>
 #include <memory>
 #include <queue>
 #include <string>
 
+#include "audio_sink.h"
 #include "audio_tasks.h"
+#include "buffer_tuner.h"
+#include "metrics.h"
 
-class AlsaPlayer;
+class AudioSink;
 class ECI;
 
 // Task manager for audio tasks.
 //
-// Manages a queue of AudioTask objects, invoking them when necessary in order
+// Manages queues of AudioTask objects, invoking them when necessary in order
 // to generate audio samples on demand and send them to the player.
+//
+// Tasks are queued in lanes of decreasing priority. Each lane runs its tasks
+// in order, and when a task finishes, the next task to run is the first one of
+// the highest lane that is not empty. So speech that must be heard now, e.g.
+// a letter echoed while typing, only waits for the end of the utterance being
+// played instead of the whole text dispatched before it, and the bulk of the
+// speech goes on afterwards. Urgent tasks do not even wait for the end of the
+// utterance: the running task is interrupted, and started again once the
+// urgent tasks are done, which for speech continues from the interrupted
+// word.
+//
+// Tasks are pushed on behalf of a source, e.g. a client of the server. Within
+// a lane, the sources with tasks take turns, one task each, so a client that
+// dispatched a long text does not hold the others until it is done.
+//
+// The bulk lane may have a budget, limiting the bytes of text or the
+// estimated duration of the tasks each source queues in it. When a source
+// goes over its budget, e.g. while streaming the output of a compilation, the
+// oldest of its tasks are dropped, possibly replaced by a notice of how many
+// were skipped.
 class AudioManager {
 public:
-  explicit AudioManager(std::unique_ptr<AlsaPlayer> player);
+  enum Lane {
+    URGENT,
+    INTERACTIVE,
+    BULK,
+  };
+  static constexpr int kNumLanes = 3;
+
+  // Statistics of the tasks of one lane.
+  struct LaneStats {
+    // Tasks pushed to the lane, tasks in it now, including the running one,
+    // and the most it ever had.
+    std::size_t pushed = 0;
+    std::size_t depth = 0;
+    std::size_t max_depth = 0;
+
+    // Time the tasks waited in the lane before starting, in total and at
+    // most.
+    std::chrono::microseconds total_wait{0};
+    std::chrono::microseconds max_wait{0};
+
+    // Tasks of the lane interrupted by urgent tasks.
+    std::size_t preempted = 0;
+
+    // Tasks removed to keep the lane within its budget, and tasks replaced
+    // by a notice of how many were skipped.
+    std::size_t dropped = 0;
+    std::size_t merged = 0;
+  };
+
+  // Budget of the tasks queued by each source in the bulk lane, besides the
+  // running one.
+  struct QueueBudget {
+    enum Policy {
+      // Removes the oldest tasks until the rest fit in the budget.
+      DROP_OLDEST,
+      // Removes all the tasks but the one just pushed.
+      KEEP_LATEST,
+      // Removes the oldest tasks as DROP_OLDEST, replacing them with a single
+      // notice of how many lines were skipped.
+      SUMMARIZE,
+    };
+
+    QueueBudget() noexcept {}
+
+    // Limits of the bytes of text and the estimated duration of the queued
+    // tasks. Zero means no limit.
+    std::size_t max_bytes = 0;
+    std::chrono::milliseconds max_duration{0};
+
+    Policy policy = DROP_OLDEST;
+
+    // Makes the notice of the given number of skipped lines, for SUMMARIZE.
+    std::function<std::unique_ptr<AudioTask>(std::size_t skipped)> make_notice;
+  };
 
-  // Pushes one audio task into the queue.
-  void Push(std::unique_ptr<AudioTask> task);
+  explicit AudioManager(std::unique_ptr<AudioSink> player);
+  ~AudioManager();
 
-  // Runs the task at the front of the queue.  If the task returns FINISHED,
-  // the task is removed from the queue.
+  // Pushes one audio task into the queue of the given lane, on behalf of the
+  // given source.
+  void Push(std::unique_ptr<AudioTask> task, Lane lane = BULK,
+            int source = 0);
+
+  // Starts playing the given icon over the audio of the tasks, with the
+  // given gain, on behalf of the given source, without waiting for the tasks
+  // in the queue.
+  void PlayIcon(std::shared_ptr<const Icon> icon, float gain, int source = 0);
+
+  // Runs the current task. If the task returns FINISHED, the task is removed
+  // from its queue and the next one is started. While all the queues are
+  // empty, plays the voices of the mixer alone.
   void Run();
 
-  // Ends the current running task and clears all tasks from the queue.
-  void Clear();
+  // Ends the current running task and removes all tasks from the queues,
+  // returning them in the order they would have run, and stops the voices of
+  // the mixer. Tasks that were interrupted may be pushed again later.
+  std::queue<std::unique_ptr<AudioTask>> Clear();
+
+  // Removes the tasks of the given source from the queues, returning them as
+  // above. If the current task belongs to the source, it is ended, and the
+  // next task of the other sources starts. Only the voices of the mixer that
+  // the source started are stopped. The audio already sent to the player is
+  // not dropped.
+  std::queue<std::unique_ptr<AudioTask>> Clear(int source);
 
-  // Returns the set of file descriptors that the AudioManager must wait for in
-  // order to run the task at the front of the queue.
+  // Returns the source of the current task, or -1 if there is none.
+  int current_source() const {
+    return current_ != nullptr ? current_source_ : -1;
+  }
+
+  // Returns the descriptors to wait for, while pending(), in order to run. They
+  // are those of the player, which do not change, so they can be registered
+  // once.
   std::vector<struct pollfd> GetPollDescriptors() const;
 
-  // Returns the number of interesting events for the task at the front of the
-  // queue.
+  // Returns whether the manager can run, given the events of the descriptors
+  // above.
   int GetPollEvents(struct pollfd* fds, int nfds) const;
 
-  // Returns the player object.
-  AlsaPlayer* player() const { return player_.get(); }
+  // Returns the timeout for waiting instead of the descriptors above, in
+  // milliseconds, or -1 to wait for the descriptors.
+  int GetPollTimeout() const;
+
+  // Enables adaptive buffer tuning. While running tasks, the manager measures
+  // the jitter and underruns of the player and, between utterances,
+  // reconfigures the player with the buffer time chosen by the tuner.
+  void set_buffer_tuner(std::unique_ptr<BufferTuner> tuner);
+
+  // Returns the sink that plays the audio.
+  AudioSink* player() const { return player_.get(); }
 
-  // Returns whether there are any pending tasks in the queue.
-  bool pending() const { return !queue_.empty(); }
+  // Returns whether there are any pending tasks in the queues, voices being
+  // mixed, or audio that was not written to the device yet.
+  bool pending() const {
+    return current_ != nullptr || player_->mixer()->active() ||
+           player_->pending() || idle_pending_;
+  }
+
+  // Sets the budget of the bulk lane.
+  void set_budget(const QueueBudget& budget) { budget_ = budget; }
+
+  // Parses the name of a budget policy, "drop-oldest", "keep-latest" or
+  // "summarize". Returns false if the name is not valid.
+  static bool ParsePolicy(const std::string& name, QueueBudget::Policy* policy);
+
+  // Returns the statistics of the given lane.
+  LaneStats lane_stats(Lane lane) const;
+
+  // Returns the name of the given lane, e.g. "interactive".
+  static std::string GetLaneName(Lane lane);
+
+  // Publishes the statistics of the lanes and the underruns of the player in
+  // the given registry, read when the metrics are written, until the manager
+  // is destroyed.
+  void ExportMetrics(Metrics* metrics);
 
  private:
-  std::unique_ptr<AlsaPlayer> player_;
-  std::queue<std::unique_ptr<AudioTask>> queue_;
+  using Clock = std::chrono::steady_clock;
+
+  struct QueuedTask {
+    std::unique_ptr<AudioTask> task;
+    Clock::time_point queued;
+    bool started;
+
+    // Number of lines announced, if the task is a notice of skipped lines.
+    std::size_t skipped;
+  };
+
+  // Tasks of one source in a lane.
+  struct SourceQueue {
+    int source;
+    std::deque<QueuedTask> tasks;
+  };
+
+  // Sources with tasks in a lane, in the order of their turns.
+  using LaneQueue = std::list<SourceQueue>;
+
+  // Starts the first task of the given lane.
+  void StartTask(Lane lane);
+
+  // Ends the current task, which may have finished or not.
+  void EndCurrentTask(bool finished);
+
+  // Removes the current task from its queue, and gives the turn to the next
+  // source of its lane.
+  std::unique_ptr<AudioTask> PopCurrentTask();
+
+  // Starts the first task of the highest lane with tasks, if any. Returns
+  // whether a task was started.
+  bool StartNextTask();
+
+  // Interrupts the current task, leaving it at the front of its lane to be
+  // started again later.
+  void PreemptTask();
+
+  // Removes tasks of the given source of the bulk lane, as chosen by the
+  // policy of the budget, if they do not fit in it.
+  void EnforceBudget(SourceQueue* entry);
+
+  // Returns whether the given bytes and duration fit in the budget.
+  bool WithinBudget(std::size_t bytes,
+                    std::chrono::milliseconds duration) const;
+
+  std::unique_ptr<AudioSink> player_;
+  LaneQueue lanes_[kNumLanes];
+  LaneStats stats_[kNumLanes];
+  QueueBudget budget_;
+
+  // Task being run, at the front of the queue of the first source of its
+  // lane, or nullptr if all the queues are empty.
+  AudioTask* current_ = nullptr;
+  Lane current_lane_ = BULK;
+  int current_source_ = 0;
+
+  // Writes one period of the voices of the mixer over silence.
+  void PlayVoices();
+
+  // Sets the player idle, once its staged audio is written.
+  void SetIdle();
+
+  // Feeds the buffer tuner with the current state of the player.
+  void MeasureJitter();
+
+  // Returns the number of frames free in the device buffer, and in one
+  // period.
+  snd_pcm_sframes_t GetFreeFrames() const;
+  snd_pcm_sframes_t period_frames() const { return player_->period_size(); }
+
+  // Ends an utterance for the buffer tuner.
+  void EndUtterance();
+
+  // Applies the buffer time chosen by the tuner, if the device is done
+  // playing.
+  void ApplyBufferTime();
+
+  // Whether the player must be set idle once its staged audio is written.
+  bool idle_pending_ = false;
+
+  std::unique_ptr<BufferTuner> tuner_;
+
+  // Underruns counted by the player at the start of the current utterance.
+  int underruns_ = 0;
+
+  // Whether the device buffer was full after the last run, so the next run
+  // can measure the jitter.
+  bool measure_jitter_ = false;
+
+  // Whether the player must be reconfigured with the buffer time of the
+  // tuner.
+  bool reconfigure_pending_ = false;
+
+  Metrics* metrics_ = nullptr;
 };
 
 #endif  // AUDIO_MANAGER_H_
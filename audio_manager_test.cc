@@ -0,0 +1,263 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_manager.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "null_sink.h"
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, const string& value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Task that runs for a number of periods of silence, recording when it is
+// started, ended and finished in a shared log. It may claim to hold some bytes
+// of text, for the budget of the queue.
+class FakeTask : public AudioTask {
+ public:
+  FakeTask(const string& name, int periods, string* log, std::size_t bytes = 0)
+      : name_(name), periods_(periods), log_(log), bytes_(bytes) {}
+
+  void StartTask(AudioSink* player) override {
+    *log_ += "+" + name_;
+    remaining_ = periods_;
+  }
+
+  void EndTask(AudioSink* player, bool finished) override {
+    *log_ += (finished ? "." : "!") + name_;
+  }
+
+  TaskResult Run(AudioSink* player) override {
+    player->Play(player->period_size());
+    return --remaining_ > 0 ? CONTINUE : FINISHED;
+  }
+
+  std::size_t queued_bytes() const override { return bytes_; }
+
+ private:
+  const string name_;
+  const int periods_;
+  string* log_;
+  const std::size_t bytes_;
+  int remaining_ = 0;
+};
+
+NullSink::Options MakeOptions() {
+  NullSink::Options options;
+  options.clock = NullSink::VIRTUAL;
+  return options;
+}
+
+// Runs the audio manager until it has nothing else to do.
+void RunAll(AudioManager* audio) {
+  for (int i = 0; i < 1000 && audio->pending(); ++i) {
+    audio->Run();
+  }
+}
+
+int main() {
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a", 3, &log)));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b", 3, &log)));
+    audio.Run();
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("i", 1, &log)),
+               AudioManager::INTERACTIVE);
+    RunAll(&audio);
+    Check("Interactive after utterance", log == "+a.a+i.i+b.b", log);
+
+    const AudioManager::LaneStats bulk = audio.lane_stats(AudioManager::BULK);
+    const AudioManager::LaneStats interactive =
+        audio.lane_stats(AudioManager::INTERACTIVE);
+    Check("Lane stats",
+          bulk.pushed == 2 && bulk.max_depth == 2 && bulk.depth == 0 &&
+              interactive.pushed == 1 && interactive.max_depth == 1 &&
+              bulk.preempted == 0,
+          std::to_string(bulk.pushed) + " " + std::to_string(bulk.max_depth));
+  }
+
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a", 3, &log)));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b", 1, &log)));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("i", 1, &log)),
+               AudioManager::INTERACTIVE);
+    audio.Run();
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("u", 1, &log)),
+               AudioManager::URGENT);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("v", 1, &log)),
+               AudioManager::URGENT);
+    RunAll(&audio);
+    Check("Urgent preempts", log == "+a!a+u.u+v.v+i.i+a.a+b.b", log);
+    Check("Preempted",
+          audio.lane_stats(AudioManager::BULK).preempted == 1 &&
+              audio.lane_stats(AudioManager::URGENT).preempted == 0,
+          std::to_string(audio.lane_stats(AudioManager::BULK).preempted));
+  }
+
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a", 3, &log)));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b", 1, &log)));
+    audio.Run();
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("i", 1, &log)),
+               AudioManager::INTERACTIVE);
+    std::queue<std::unique_ptr<AudioTask>> tasks = audio.Clear();
+    Check("Cleared", log == "+a!a" && tasks.size() == 3 && !audio.pending(),
+          log);
+
+    // The tasks are returned in the order they would have run.
+    log.clear();
+    while (!tasks.empty()) {
+      audio.Push(std::move(tasks.front()));
+      tasks.pop();
+    }
+    RunAll(&audio);
+    Check("Pushed again", log == "+a.a+i.i+b.b", log);
+  }
+
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a1", 1, &log)),
+               AudioManager::BULK, 1);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a2", 1, &log)),
+               AudioManager::BULK, 1);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a3", 1, &log)),
+               AudioManager::BULK, 1);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b1", 1, &log)),
+               AudioManager::BULK, 2);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b2", 1, &log)),
+               AudioManager::BULK, 2);
+    RunAll(&audio);
+    Check("Sources take turns", log == "+a1.a1+b1.b1+a2.a2+b2.b2+a3.a3", log);
+  }
+
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a1", 2, &log)),
+               AudioManager::BULK, 1);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("a2", 1, &log)),
+               AudioManager::BULK, 1);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b1", 1, &log)),
+               AudioManager::BULK, 2);
+    audio.Push(std::unique_ptr<AudioTask>(new FakeTask("b2", 1, &log)),
+               AudioManager::BULK, 2);
+    audio.Run();
+
+    std::queue<std::unique_ptr<AudioTask>> tasks = audio.Clear(2);
+    Check("Cleared other source", tasks.size() == 2 && log == "+a1" &&
+                                      audio.current_source() == 1,
+          log);
+
+    tasks = audio.Clear(1);
+    Check("Cleared current source",
+          tasks.size() == 2 && log == "+a1!a1" && audio.current_source() == -1,
+          log);
+  }
+
+  {
+    // A source only stops the icons it started.
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    std::shared_ptr<Icon> long_icon(new Icon());
+    long_icon->frames = 2000;
+    long_icon->data.assign(long_icon->frames * 2, 0);
+    std::shared_ptr<Icon> short_icon(new Icon());
+    short_icon->frames = 500;
+    short_icon->data.assign(short_icon->frames * 2, 0);
+    audio.PlayIcon(long_icon, 1.0f, 1);
+    audio.PlayIcon(short_icon, 1.0f, 2);
+
+    audio.Clear(1);
+    const Mixer* mixer = audio.player()->mixer();
+    Check("Cleared the icons of the source",
+          mixer->active() && mixer->remaining() == 500,
+          std::to_string(mixer->remaining()) + " frames left");
+  }
+
+  {
+    // Tasks over the budget are dropped from the oldest.
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    AudioManager::QueueBudget budget;
+    budget.max_bytes = 20;
+    audio.set_budget(budget);
+    for (const char* name : {"a", "b", "c", "d"}) {
+      audio.Push(std::unique_ptr<AudioTask>(new FakeTask(name, 1, &log, 10)));
+    }
+    RunAll(&audio);
+    const AudioManager::LaneStats stats =
+        audio.lane_stats(AudioManager::BULK);
+    Check("Drop oldest", log == "+a.a+c.c+d.d" && stats.dropped == 1, log);
+  }
+
+  {
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    AudioManager::QueueBudget budget;
+    budget.max_bytes = 20;
+    budget.policy = AudioManager::QueueBudget::KEEP_LATEST;
+    audio.set_budget(budget);
+    for (const char* name : {"a", "b", "c", "d"}) {
+      audio.Push(std::unique_ptr<AudioTask>(new FakeTask(name, 1, &log, 10)));
+    }
+    RunAll(&audio);
+    const AudioManager::LaneStats stats =
+        audio.lane_stats(AudioManager::BULK);
+    Check("Keep latest", log == "+a.a+d.d" && stats.dropped == 2, log);
+  }
+
+  {
+    // Skipped tasks are replaced by a single notice, counting all of them.
+    string log;
+    AudioManager audio(std::unique_ptr<AudioSink>(new NullSink(MakeOptions())));
+    AudioManager::QueueBudget budget;
+    budget.max_bytes = 20;
+    budget.policy = AudioManager::QueueBudget::SUMMARIZE;
+    budget.make_notice = [&log](std::size_t skipped) {
+      return std::unique_ptr<AudioTask>(
+          new FakeTask("n" + std::to_string(skipped), 1, &log));
+    };
+    audio.set_budget(budget);
+    for (const char* name : {"a", "b", "c", "d", "e"}) {
+      audio.Push(std::unique_ptr<AudioTask>(new FakeTask(name, 1, &log, 10)));
+    }
+    RunAll(&audio);
+    const AudioManager::LaneStats stats =
+        audio.lane_stats(AudioManager::BULK);
+    Check("Summarize",
+          log == "+a.a+n2.n2+d.d+e.e" && stats.merged == 2 &&
+              stats.dropped == 0,
+          log);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
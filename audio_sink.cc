@@ -0,0 +1,137 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_sink.h"
+
+#include <algorithm>
+#include <cstring>
+
+AudioSink::AudioSink(snd_pcm_format_t sample_format, unsigned int sample_rate,
+                     unsigned int channels)
+    : sample_format_(sample_format),
+      sample_rate_(sample_rate),
+      channels_(channels),
+      frame_size_(channels * snd_pcm_format_physical_width(sample_format) /
+                  8),
+      mixer_(new Mixer(sample_format, channels)) {}
+
+AudioSink::~AudioSink() {}
+
+void AudioSink::SetBufferSize(std::size_t period_size,
+                              std::size_t buffer_size) {
+  period_size_ = period_size;
+  buffer_size_ = buffer_size;
+  buffer_.reset(new char[period_size_ * frame_size_]);
+
+  // The staging buffer must take at least one full period, since the speech
+  // engine and the tone generator produce audio one period at a time.
+  ReserveStaging(std::max(buffer_size_, period_size_));
+}
+
+void AudioSink::ReserveStaging(std::size_t frames) {
+  if (frames <= staging_size_) return;
+
+  std::unique_ptr<char[]> staging(new char[frames * frame_size_]);
+  const std::size_t staged = staging_end_ - staging_begin_;
+  if (staged > 0) {
+    std::memcpy(staging.get(), staging_.get() + staging_begin_ * frame_size_,
+                staged * frame_size_);
+  }
+  staging_ = std::move(staging);
+  staging_size_ = frames;
+  staging_begin_ = 0;
+  staging_end_ = staged;
+}
+
+std::size_t AudioSink::Play(int count) {
+  return Play(buffer_.get(), count);
+}
+
+std::size_t AudioSink::Play(const char* data, int count) {
+  if (count <= 0) return 0;
+  if (!mixer_->active()) return Output(data, count);
+
+  // The voices are mixed into a copy of the audio, one period at a time, and
+  // only advanced by the frames that were accepted.
+  std::size_t accepted = 0;
+  while (accepted < static_cast<std::size_t>(count) && mixer_->active()) {
+    const char* in = data + accepted * frame_size_;
+    const std::size_t frames =
+        std::min<std::size_t>(count - accepted, period_size_);
+    if (in != buffer_.get()) {
+      std::memcpy(buffer_.get(), in, frames * frame_size_);
+    }
+    mixer_->Mix(buffer_.get(), frames);
+
+    const std::size_t written = Output(buffer_.get(), frames);
+    mixer_->Advance(written);
+    accepted += written;
+    if (written < frames) return accepted;
+  }
+
+  return accepted + Output(data + accepted * frame_size_, count - accepted);
+}
+
+char* AudioSink::BeginWrite(std::size_t* frames) {
+  *frames = std::min(*frames, period_size_);
+  return buffer_.get();
+}
+
+std::size_t AudioSink::CommitWrite(std::size_t frames) {
+  return Play(buffer_.get(), frames);
+}
+
+std::size_t AudioSink::Output(const char* data, std::size_t count) {
+  if (count == 0) return 0;
+
+  // Frames can only go straight to the device if nothing is staged before
+  // them.
+  std::size_t written = 0;
+  if (!pending()) {
+    written = Write(data, count);
+  }
+  return written + Stage(data + written * frame_size_, count - written);
+}
+
+bool AudioSink::Flush() {
+  if (staging_begin_ != staging_end_) {
+    staging_begin_ += Write(staging_.get() + staging_begin_ * frame_size_,
+                            staging_end_ - staging_begin_);
+    if (staging_begin_ != staging_end_) {
+      return false;
+    }
+  }
+
+  staging_begin_ = staging_end_ = 0;
+  return true;
+}
+
+std::size_t AudioSink::Stage(const char* data, std::size_t count) {
+  if (count == 0) return 0;
+
+  // Move the staged frames to the start of the buffer if the new ones do not
+  // fit after them.
+  if (staging_end_ + count > staging_size_ && staging_begin_ > 0) {
+    std::memmove(staging_.get(), staging_.get() + staging_begin_ * frame_size_,
+                 (staging_end_ - staging_begin_) * frame_size_);
+    staging_end_ -= staging_begin_;
+    staging_begin_ = 0;
+  }
+
+  count = std::min(count, staging_size_ - staging_end_);
+  std::memcpy(staging_.get() + staging_end_ * frame_size_, data,
+              count * frame_size_);
+  staging_end_ += count;
+  return count;
+}
@@ -0,0 +1,180 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUDIO_SINK_H_
+#define AUDIO_SINK_H_
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <poll.h>
+#include <alsa/asoundlib.h>
+
+#include "mixer.h"
+
+// Destination of the audio produced by the speech server.
+//
+// A sink takes interleaved frames of a fixed sample format, sample rate and
+// number of channels, and plays them on a device with a buffer of
+// buffer_size() frames that asks for more audio one period at a time. This
+// class implements what every sink has in common: frames that the device does
+// not accept yet are kept in a staging buffer, so producers never block, and
+// the voices of the mixer are mixed over the audio on its way out. Derived
+// classes implement the device itself, e.g. an ALSA PCM, a file or a clock.
+class AudioSink {
+ public:
+  virtual ~AudioSink();
+
+  // Read-only accessors.
+  snd_pcm_format_t sample_format() const { return sample_format_; }
+  unsigned int sample_rate() const { return sample_rate_; }
+  unsigned int channels() const { return channels_; }
+  unsigned int period_size() const { return period_size_; }
+  unsigned int buffer_size() const { return buffer_size_; }
+  std::size_t frame_size() const { return frame_size_; }
+  char* buffer() const { return buffer_.get(); }
+
+  // Returns the mixer of the voices played over the audio of the sink.
+  Mixer* mixer() const { return mixer_.get(); }
+
+  // Writes count frames from the sink buffer to the device.
+  std::size_t Play(int count);
+
+  // Writes count frames from the given buffer to the device, without
+  // blocking, mixing in the active voices of the mixer. Frames that do not
+  // fit in the device buffer are copied to a staging buffer, to be written by
+  // Flush() once the device is ready. Returns the number of frames accepted,
+  // which is less than count only if the staging buffer is full.
+  std::size_t Play(const char* data, int count);
+
+  // Returns a buffer to generate up to *frames frames of audio in place, and
+  // updates *frames to the number of frames that fit in it, which is never
+  // more than one period. The default implementation returns the sink
+  // buffer. The audio must then be submitted with CommitWrite() before
+  // calling any other method.
+  virtual char* BeginWrite(std::size_t* frames);
+
+  // Submits the given number of frames written to the buffer returned by
+  // BeginWrite(). Returns the number of frames accepted, as Play() does.
+  virtual std::size_t CommitWrite(std::size_t frames);
+
+  // Returns the number of frames that the next call to Play() is guaranteed
+  // to accept.
+  std::size_t available() const {
+    return staging_size_ - (staging_end_ - staging_begin_);
+  }
+
+  // Makes sure the staging buffer can hold at least the given number of
+  // frames, for producers that write more than one period at once.
+  void ReserveStaging(std::size_t frames);
+
+  // Returns whether there are frames waiting to be written to the device.
+  virtual bool pending() const { return staging_end_ != staging_begin_; }
+
+  // Writes as many staged frames to the device as possible, without
+  // blocking. Returns whether all of them were written.
+  virtual bool Flush();
+
+  // Returns whether the sink renders audio offline, as fast as it is
+  // produced, instead of playing it in real time.
+  virtual bool offline() const { return false; }
+
+  // Returns whether the device is playing audio.
+  virtual bool running() const = 0;
+
+  // Returns the number of underruns while audio was being played, not
+  // counting the expected ones after Idle().
+  virtual int underruns() const { return 0; }
+
+  // Configures the device again with the given buffer time, dropping any
+  // audio not played yet. The period size may change.
+  virtual void Reconfigure(std::chrono::microseconds buffer_time) = 0;
+
+  // Descriptors to poll for the device to be ready for more audio, and the
+  // events that they report.
+  virtual std::vector<struct pollfd> GetPollDescriptors() const = 0;
+  virtual int GetPollEvents(struct pollfd* fds, int nfds) const = 0;
+
+  // Returns the timeout for poll() when waiting for the sink, in
+  // milliseconds, or -1 to wait only for the sink descriptors.
+  virtual int GetPollTimeout() const { return -1; }
+
+  // Waits until all the audio written is played.
+  virtual void Drain() = 0;
+
+  // Pauses the playback. Returns false if the device does not support
+  // pausing, in which case the playback continues.
+  virtual bool Pause() = 0;
+  virtual void Resume() = 0;
+
+  // Returns the number of frames written that were not played yet.
+  virtual snd_pcm_sframes_t GetDelay() const = 0;
+
+  // Sets the end of a segment of audio, informing to the sink that there
+  // will be no more audio for awhile and that an eventual underrun is
+  // expected.
+  virtual void Idle() = 0;
+
+  // Drops the audio not played yet.
+  virtual void Interrupt() = 0;
+
+ protected:
+  AudioSink(snd_pcm_format_t sample_format, unsigned int sample_rate,
+            unsigned int channels);
+
+  // Sets the period and buffer sizes of the device, in frames, and allocates
+  // the sink and staging buffers accordingly. The staging buffer never
+  // shrinks, since the speech engines keep producing audio in buffers of the
+  // original period size.
+  void SetBufferSize(std::size_t period_size, std::size_t buffer_size);
+
+  // Writes as many of count frames as the device accepts without blocking,
+  // and returns the number of frames written.
+  virtual std::size_t Write(const char* data, std::size_t count) = 0;
+
+  // Returns the number of frames in the staging buffer, and drops them.
+  std::size_t staged() const { return staging_end_ - staging_begin_; }
+  void DropStaged() { staging_begin_ = staging_end_ = 0; }
+
+ private:
+  // Outputs count frames of audio, already mixed, writing them to the device
+  // and staging the ones that do not fit. Returns the number of frames
+  // accepted.
+  std::size_t Output(const char* data, std::size_t count);
+
+  // Copies count frames to the end of the staging buffer, as many as fit.
+  // Returns the number of frames copied.
+  std::size_t Stage(const char* data, std::size_t count);
+
+  const snd_pcm_format_t sample_format_;
+  const unsigned int sample_rate_;
+  const unsigned int channels_;
+  std::size_t period_size_ = 0;
+  std::size_t buffer_size_ = 0;
+  const std::size_t frame_size_;
+
+  std::unique_ptr<char[]> buffer_;
+  std::unique_ptr<Mixer> mixer_;
+
+  // Frames accepted by Play() but not written to the device yet, stored from
+  // staging_begin_ to staging_end_, out of staging_size_ frames.
+  std::unique_ptr<char[]> staging_;
+  std::size_t staging_size_ = 0;
+  std::size_t staging_begin_ = 0;
+  std::size_t staging_end_ = 0;
+};
+
+#endif  // AUDIO_SINK_H_
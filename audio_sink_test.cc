@@ -0,0 +1,199 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "null_sink.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "audio_decoder.h"
+#include "file_sink.h"
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+const unsigned int kSampleRate = 11025;
+
+double Seconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// Writes the given number of frames of silence to the sink as the audio
+// manager does: one period at a time, flushing the staged frames first, and
+// waiting on the descriptors of the sink whenever it is not ready. Returns
+// the number of times poll() returned.
+int Produce(AudioSink* sink, std::size_t frames) {
+  std::memset(sink->buffer(), 0, sink->period_size() * sink->frame_size());
+  int wakeups = 0;
+  while (frames > 0 || sink->pending()) {
+    std::vector<struct pollfd> fds = sink->GetPollDescriptors();
+    if (poll(fds.data(), fds.size(), 1000) <= 0) return -1;
+    ++wakeups;
+    if (!sink->GetPollEvents(fds.data(), fds.size())) continue;
+    if (!sink->Flush()) continue;
+    const std::size_t count =
+        std::min<std::size_t>(frames, sink->period_size());
+    frames -= sink->Play(count);
+  }
+  return wakeups;
+}
+
+NullSink::Options MakeOptions(NullSink::Clock clock) {
+  NullSink::Options options;
+  options.sample_rate = kSampleRate;
+  options.clock = clock;
+  return options;
+}
+
+int main() {
+  // The virtual clock only advances when the device buffer is full.
+  {
+    NullSink sink(MakeOptions(NullSink::VIRTUAL));
+    const snd_pcm_sframes_t buffer = sink.buffer_size();
+    Check("Period size", sink.period_size() == buffer / NullSink::kPeriods,
+          sink.period_size());
+
+    Produce(&sink, kSampleRate);
+    const double expected =
+        static_cast<double>(kSampleRate - buffer) / kSampleRate;
+    Check("Virtual time to fill", std::abs(Seconds(sink.now()) - expected) <
+                                      0.001,
+          Seconds(sink.now()));
+    Check("Delay of a full buffer", sink.GetDelay() == buffer,
+          sink.GetDelay());
+
+    // A paused device does not play.
+    sink.Pause();
+    sink.AdvanceClock(std::chrono::seconds(1));
+    Check("Paused", sink.GetDelay() == buffer, sink.GetDelay());
+    sink.Resume();
+    sink.AdvanceClock(std::chrono::milliseconds(50));
+    const snd_pcm_sframes_t played = kSampleRate / 20;
+    Check("Resumed", sink.GetDelay() == buffer - played, sink.GetDelay());
+
+    sink.Idle();
+    sink.Drain();
+    Check("Drained", sink.GetDelay() == 0 &&
+                         sink.frames_played() == kSampleRate,
+          sink.frames_played());
+    Check("Virtual time of the audio",
+          std::abs(Seconds(sink.now()) - 2.0) < 0.001, Seconds(sink.now()));
+    Check("No underruns", sink.underruns() == 0, sink.underruns());
+  }
+
+  // Running out of audio without going idle is an underrun.
+  {
+    NullSink sink(MakeOptions(NullSink::VIRTUAL));
+    Produce(&sink, sink.period_size() * 2);
+    sink.AdvanceClock(std::chrono::seconds(1));
+    Produce(&sink, sink.period_size() * 2);
+    Check("Underrun", sink.underruns() == 1, sink.underruns());
+
+    sink.Idle();
+    sink.AdvanceClock(std::chrono::seconds(1));
+    Produce(&sink, sink.period_size() * 2);
+    Check("Expected underrun", sink.underruns() == 1, sink.underruns());
+
+    sink.Interrupt();
+    Check("Interrupted", sink.GetDelay() == 0 && !sink.running(),
+          sink.GetDelay());
+  }
+
+  // The real time clock paces the producer as a sound device, waking it up
+  // about once per period.
+  {
+    NullSink sink(MakeOptions(NullSink::REAL_TIME));
+    const std::size_t frames = kSampleRate * 3 / 10;
+    const auto start = std::chrono::steady_clock::now();
+    const int wakeups = Produce(&sink, frames);
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start).count();
+    // The last period is written as soon as there is room for it.
+    const double expected =
+        static_cast<double>(frames - sink.buffer_size()) / kSampleRate;
+    const double period = static_cast<double>(sink.period_size()) / kSampleRate;
+    Check("Real time to fill", elapsed > expected - 0.005 &&
+                                   elapsed < expected + period + 0.02,
+          elapsed);
+    const int periods = frames / sink.period_size();
+    Check("Wakeups", wakeups > 0 && wakeups <= 2 * periods, wakeups);
+    Check("Real time delay",
+          sink.GetDelay() > 0 &&
+              sink.GetDelay() <= static_cast<long>(sink.buffer_size()),
+          sink.GetDelay());
+
+    sink.Idle();
+    sink.Drain();
+    Check("Real time drained", sink.GetDelay() == 0, sink.GetDelay());
+    Check("No real time underruns", sink.underruns() == 0, sink.underruns());
+  }
+
+  // The file sink writes a WAV file that decodes to the same samples.
+  {
+    const string file_path = "/tmp/audio_sink_test.wav";
+    std::vector<std::int16_t> samples(2000);
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      samples[i] = 10000 * std::sin(i * 0.05);
+    }
+    {
+      FileSink sink(file_path, SND_PCM_FORMAT_S16_LE, 22050, 2);
+      sink.Play(reinterpret_cast<const char*>(samples.data()), 600);
+      sink.Play(reinterpret_cast<const char*>(samples.data() + 1200), 400);
+      Check("File duration",
+            std::abs(sink.duration().count() - 1000.0 / 22050) < 1e-9,
+            sink.duration().count());
+    }
+
+    std::ifstream file(file_path, std::ios::binary);
+    const std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+    const AudioClip clip = WavDecoder().Decode(data.data(), data.size());
+    bool same = clip.samples.size() == samples.size();
+    for (std::size_t i = 0; same && i < samples.size(); ++i) {
+      same = std::lround(clip.samples[i] * 32768) == samples[i];
+    }
+    Check("WAV format", clip.channels == 2 && clip.sample_rate == 22050,
+          clip.sample_rate);
+    Check("WAV samples", same, clip.frames());
+    unlink(file_path.c_str());
+  }
+
+  if (!good) {
+    std::cout << "Some test failed.\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -14,60 +14,253 @@
 
 #include "audio_tasks.h"
 
-#include <cmath>
-#include <sstream>
+#include <algorithm>
+#include <iostream>
+
+#include "metrics.h"
 
 using std::string;
-using std::vector;
+
+// SpeechTask
 
 namespace {
 
-// Default program to play the wav files.
-static const char kDefaultPlayProgram[] = "aplay";
+// Characters separating words in the text sent to the engine.
+const char kWordSeparators[] = " \t\n\r";
 
-}  // namespace
+// Rough speaking rate of the engine: about 180 words per minute at the
+// default speed of 50, growing linearly with the speed.
+int WordsPerMinute(int speed) { return 80 + 2 * speed; }
 
-// AudioTask
+// Returns whether the word of the text at the given position is an
+// annotation of the engine, e.g. `v2 or `p100, rather than a spoken word.
+bool IsAnnotation(const string& text, std::size_t pos) {
+  return text[pos] == '`';
+}
 
-vector<pollfd> AudioTask::GetPollDescriptors(AlsaPlayer* player) const {
-  return player->GetPollDescriptors();
+// Returns the number of spoken words in the given text.
+int CountWords(const string& text) {
+  int count = 0;
+  std::size_t pos = text.find_first_not_of(kWordSeparators);
+  while (pos != string::npos) {
+    if (!IsAnnotation(text, pos)) ++count;
+    pos = text.find_first_of(kWordSeparators, pos);
+    if (pos == string::npos) break;
+    pos = text.find_first_not_of(kWordSeparators, pos);
+  }
+  return count;
 }
 
-int AudioTask::GetPollEvents(AlsaPlayer* player, pollfd* fds, int nfds) const {
-  return player->GetPollEvents(fds, nfds);
+// Time the engine took to synthesize each utterance, divided by the duration
+// of its audio.
+Histogram* SynthesisRealTimeFactor() {
+  static Histogram* histogram = Metrics::Default()->GetHistogram(
+      "speech_server_synthesis_realtime_factor",
+      "Synthesis time of each finished utterance over its audio duration.",
+      {0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0});
+  return histogram;
 }
 
-// SpeechTask
+}  // namespace
+
+constexpr std::chrono::milliseconds SpeechTask::kMaxRunTime;
+constexpr std::size_t SpeechTask::kReservedOperations;
 
-SpeechTask::SpeechTask(ECI* eci) : eci_(eci) {}
+SpeechTask::SpeechTask(ECI* eci, SpeechConverter* converter)
+    : eci_(eci), converter_(converter) {
+  ops_.reserve(kReservedOperations);
+}
 
 void SpeechTask::AddText(const string& text) {
-  ops_.push_back([=](ECI* eci) { eci->AddText(text); });
+  Operation op = Operation();
+  op.type = Operation::ADD_TEXT;
+  op.text_begin = text_.size();
+  op.first_mark = num_marks_ + 1;
+  text_.append(text);
+  op.text_end = text_.size();
+  num_marks_ += CountWords(text);
+  ops_.push_back(op);
+}
+
+void SpeechTask::AddMarkedText(std::size_t begin, std::size_t end,
+                               int first_mark) {
+  int mark = first_mark;
+  std::size_t start = begin;
+  while (start < end) {
+    // Each word is sent along with the separators around it. Spoken words are
+    // followed by their index mark, while annotations have none and are sent
+    // even when resuming, so the voice they select still applies.
+    const std::size_t word = text_.find_first_not_of(kWordSeparators, start);
+    if (word >= end) break;
+    std::size_t word_end = text_.find_first_of(kWordSeparators, word);
+    if (word_end < end) {
+      word_end = text_.find_first_not_of(kWordSeparators, word_end);
+    }
+    if (word_end > end) word_end = end;
+
+    const bool annotation = IsAnnotation(text_, word);
+    if (annotation || mark > last_spoken_mark_) {
+      // The engine takes null-terminated text: terminate the word in place
+      // rather than copying it, unless it ends the text, which already is.
+      if (word_end < text_.size()) {
+        const char next = text_[word_end];
+        text_[word_end] = '\0';
+        eci_->AddText(&text_[start]);
+        text_[word_end] = next;
+      } else {
+        eci_->AddText(text_.c_str() + start);
+      }
+      if (!annotation) eci_->InsertIndex(mark);
+    }
+    if (!annotation) ++mark;
+    start = word_end;
+  }
 }
 
 void SpeechTask::Synthesize() {
-  ops_.push_back([=](ECI* eci) { eci->Synthesize(); });
+  Operation op = Operation();
+  op.type = Operation::SYNTHESIZE;
+  ops_.push_back(op);
+}
+
+void SpeechTask::SetVoice(VoiceTable* voices, int voice, int speed) {
+  Operation op = Operation();
+  op.type = Operation::SET_VOICE;
+  op.voices = voices;
+  op.voice = voice;
+  op.speed = speed;
+  ops_.push_back(op);
+}
+
+void SpeechTask::InvalidateVoice(VoiceTable* voices) {
+  Operation op = Operation();
+  op.type = Operation::INVALIDATE_VOICE;
+  op.voices = voices;
+  ops_.push_back(op);
+}
+
+void SpeechTask::StartTask(AudioSink* player) {
+  const auto start = std::chrono::steady_clock::now();
+  waveform_started_ = false;
+  frames_written_ = 0;
+  converter_->Begin();
+  reached_marks_.clear();
+  reached_marks_.reserve(num_marks_ - last_spoken_mark_);
+
+  eci_->SetCallback(eciWaveformBuffer, [this, player](long frames) {
+    return OnWaveform(player, frames);
+  });
+  eci_->SetCallback(eciIndexReply,
+                    [this](long index) { return OnIndex(index); });
+
+  // The operations are kept, so that the task can be started again from the
+  // last spoken word if it is interrupted.
+  for (const Operation& op : ops_) {
+    switch (op.type) {
+      case Operation::ADD_TEXT:
+        AddMarkedText(op.text_begin, op.text_end, op.first_mark);
+        break;
+      case Operation::SYNTHESIZE:
+        eci_->Synthesize();
+        break;
+      case Operation::SET_VOICE:
+        op.voices->Apply(eci_, op.voice, op.speed);
+        break;
+      case Operation::INVALIDATE_VOICE:
+        op.voices->Invalidate(eci_);
+        break;
+    }
+  }
+  synthesis_time_ = std::chrono::steady_clock::now() - start;
 }
 
-void SpeechTask::StartTask(AlsaPlayer* player) {
-  for (const auto& op : ops_) {
-    op(eci_);
+ECICallbackReturn SpeechTask::OnWaveform(AudioSink* player, long frames) {
+  if (!waveform_started_) {
+    waveform_started_ = true;
+    Tracer::Mark("FirstWaveform", trace_id());
   }
-  ops_.clear();
+
+  // If the player cannot take the whole buffer, or the run is over, the
+  // engine keeps it and offers it again on a later call to Speaking().
+  if (player->available() < converter_->MaxOutputFrames(frames) ||
+      std::chrono::steady_clock::now() > run_deadline_) {
+    return eciDataNotProcessed;
+  }
+  std::size_t output_frames = 0;
+  const char* data =
+      converter_->Convert(eci_->output_buffer(), frames, &output_frames);
+  player->Play(data, output_frames);
+  if (frames_written_ == 0) {
+    Tracer::Mark("FirstAudio", trace_id(), "frames", output_frames);
+  }
+  frames_written_ += output_frames;
+  return eciDataProcessed;
 }
 
-AudioTask::TaskResult SpeechTask::Run(AlsaPlayer* player) {
-  if (eci_->Speaking()) {
+ECICallbackReturn SpeechTask::OnIndex(long index) {
+  reached_marks_.emplace_back(index, frames_written_);
+  return eciDataProcessed;
+}
+
+AudioTask::TaskResult SpeechTask::Run(AudioSink* player) {
+  const auto start = std::chrono::steady_clock::now();
+  run_deadline_ = start + kMaxRunTime;
+  const bool speaking = eci_->Speaking();
+  synthesis_time_ += std::chrono::steady_clock::now() - start;
+  if (speaking) {
     return CONTINUE;
   } else {
     return FINISHED;
   }
 }
 
-void SpeechTask::EndTask(AlsaPlayer* player, bool finished) {
-  if (!finished) {
-  eci_->Stop();
+std::size_t SpeechTask::queued_bytes() const {
+  return last_spoken_mark_ < num_marks_ ? text_.size() : 0;
+}
+
+std::chrono::milliseconds SpeechTask::EstimateDuration() const {
+  int speed = 50;
+  for (const Operation& op : ops_) {
+    if (op.type == Operation::SET_VOICE) speed = op.speed;
   }
+  const int words = num_marks_ - last_spoken_mark_;
+  return std::chrono::milliseconds(60000LL * words /
+                                   WordsPerMinute(std::max(speed, 0)));
+}
+
+void SpeechTask::EndTask(AudioSink* player, bool finished) {
+  if (finished) {
+    last_spoken_mark_ = num_marks_;
+
+    // Audio held by the converter belongs to this utterance.
+    std::size_t frames = 0;
+    const char* data = converter_->Drain(&frames);
+    player->Play(data, frames);
+
+    const std::size_t total_frames = frames_written_ + frames;
+    if (total_frames > 0) {
+      const std::chrono::duration<double> synthesis = synthesis_time_;
+      SynthesisRealTimeFactor()->Observe(synthesis.count() *
+                                         player->sample_rate() / total_frames);
+    }
+  } else {
+    eci_->Stop();
+    converter_->Reset();
+
+    // The audio of a word was played if all the frames written up to its
+    // mark have left the device.
+    const std::size_t delay = player->GetDelay();
+    const std::size_t played =
+        frames_written_ > delay ? frames_written_ - delay : 0;
+    for (const auto& mark : reached_marks_) {
+      if (mark.second <= played && mark.first > last_spoken_mark_) {
+        last_spoken_mark_ = mark.first;
+      }
+    }
+  }
+
+  eci_->SetCallback(eciWaveformBuffer, nullptr);
+  eci_->SetCallback(eciIndexReply, nullptr);
 }
 
 // ToneTask
@@ -75,37 +268,73 @@ void SpeechTask::EndTask(AlsaPlayer* player, bool finished) {
 ToneTask::ToneTask(float frequency, float amplitude, int duration_ms)
     : frequency_(frequency), amplitude_(amplitude), duration_ms_(duration_ms) {}
 
-void ToneTask::StartTask(AlsaPlayer* player) {
-  sample_rate_ = player->sample_rate();
-  duration_samples_ = duration_ms_ * sample_rate_ / 1000;
+void ToneTask::StartTask(AudioSink* player) {
+  const unsigned int sample_rate = player->sample_rate();
+  generator_.reset(new ToneGenerator(frequency_, amplitude_,
+                                     duration_ms_ * sample_rate / 1000,
+                                     sample_rate));
+  format_.reset(new PcmFormat(player->sample_format()));
+  samples_.resize(player->period_size());
+  frames_.resize(player->period_size() * player->channels());
 }
 
-AudioTask::TaskResult ToneTask::Run(AlsaPlayer* player) {
-  // TODO: Only works in S16 mono format, make it more generic.
-  short* buffer = reinterpret_cast<short*>(player->buffer());
-  const std::size_t buffer_size = player->period_size();  // in samples.
+AudioTask::TaskResult ToneTask::Run(AudioSink* player) {
+  std::size_t frames = samples_.size();
+  char* buffer = player->BeginWrite(&frames);
+  frames = generator_->Generate(samples_.data(), frames);
 
-  std::size_t pos = 0;
-  while (pos < buffer_size && t_ < duration_samples_) {
-    const double x = 2 * M_PI * frequency_ * (t_++) / sample_rate_;
-    const int y = amplitude_ * std::sin(x) * (1 << 15);
-    buffer[pos++] = y;
+  // The same tone goes to every channel.
+  const unsigned int channels = player->channels();
+  const float* samples = samples_.data();
+  if (channels > 1) {
+    for (std::size_t i = 0; i < frames; ++i) {
+      for (unsigned int c = 0; c < channels; ++c) {
+        frames_[i * channels + c] = samples_[i];
+      }
+    }
+    samples = frames_.data();
   }
 
-  player->Play(pos);
-  return t_ < duration_samples_ ? CONTINUE : FINISHED;
+  format_->FromFloat(samples, frames * channels, buffer);
+  player->CommitWrite(frames);
+  return generator_->done() ? FINISHED : CONTINUE;
+}
+
+// SilenceTask
+
+SilenceTask::SilenceTask(int duration_ms) : duration_ms_(duration_ms) {}
+
+void SilenceTask::StartTask(AudioSink* player) {
+  format_.reset(new PcmFormat(player->sample_format()));
+  remaining_frames_ = duration_ms_ * player->sample_rate() / 1000;
+}
+
+AudioTask::TaskResult SilenceTask::Run(AudioSink* player) {
+  std::size_t frames = remaining_frames_;
+  char* buffer = player->BeginWrite(&frames);
+  format_->FillSilence(buffer, frames * player->channels());
+  remaining_frames_ -= player->CommitWrite(frames);
+  return remaining_frames_ > 0 ? CONTINUE : FINISHED;
 }
 
 // PlayTask
 
-PlayTask::PlayTask(const string& file_path) : file_path_(file_path) {}
+PlayTask::PlayTask(IconCache* icons, const string& file_path, float gain)
+    : icons_(icons), file_path_(file_path), gain_(gain) {}
 
-void PlayTask::StartTask(AlsaPlayer* player) {
-  std::ostringstream command;
-  command << kDefaultPlayProgram << " " << file_path_ << " &";
-  std::system(command.str().c_str());
+void PlayTask::StartTask(AudioSink* player) {
+  try {
+    icon_ = icons_->Get(file_path_);
+  } catch (std::exception& e) {
+    std::cerr << "PlayTask: Failed to load " << file_path_ << ": " << e.what()
+              << "\n";
+    icon_.reset();
+  }
 }
 
-AudioTask::TaskResult PlayTask::Run(AlsaPlayer* player) {
+AudioTask::TaskResult PlayTask::Run(AudioSink* player) {
+  if (icon_ != nullptr) {
+    player->mixer()->Add(icon_, gain_, source());
+  }
   return FINISHED;
 }
@@ -15,16 +15,30 @@
 #ifndef AUDIO_TASKS_H_
 #define AUDIO_TASKS_H_
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "alsa_player.h"
+#include "audio_sink.h"
 #include "eci-c++.h"
+#include "icon_cache.h"
+#include "pcm_format.h"
+#include "speech_converter.h"
+#include "task_arena.h"
+#include "tone_generator.h"
+#include "tracer.h"
+#include "voice_table.h"
 
 // Audio task.
 //
 // This abstract base class represents a single task which is enqueued to
-// produce audio output from the server, such as speech, tone or play.
+// produce audio output from the server, such as speech, tone or play. Tasks
+// are allocated from the task arena, which recycles the memory of finished
+// tasks.
 class AudioTask {
  public:
   enum TaskResult {
@@ -32,42 +46,58 @@ class AudioTask {
     FINISHED,
   };
 
-  virtual ~AudioTask() {}
+  // Ends the trace of the statement of the task, if any.
+  virtual ~AudioTask() { Tracer::End("Statement", trace_id_); }
 
-  // Starts the task. This method is called only once when the task reaches
-  // the front of the queue, it already has exclusive access to the player
-  // and will start running. It is used to prepare the task before the
-  // Run() method is called.
-  virtual void StartTask(AlsaPlayer* player) {}
+  static void* operator new(std::size_t size) {
+    return TaskArena::Allocate(size);
+  }
+  static void operator delete(void* block, std::size_t size) {
+    TaskArena::Free(block, size);
+  }
+
+  // Starts the task. This method is called when the task reaches the front
+  // of the queue, it already has exclusive access to the player and will
+  // start running. It is used to prepare the task before the Run() method is
+  // called. A task that was ended before finishing may be pushed again to
+  // continue its output, in which case this method is called again.
+  virtual void StartTask(AudioSink* player) {}
 
   // Ends the task. This method is only called if StartTask() was previously
   // called for this task. The task may end either when it finished producing
   // its output (if Run() returnes FINISHED), or when some other server
   // command requested cleanup of any running tasks. The parameter finished
   // is used to determine the reason the task is being ended.
-  virtual void EndTask(AlsaPlayer* player, bool finished) {}
+  virtual void EndTask(AudioSink* player, bool finished) {}
 
   // Executes the task. Only the task at the front of the queue is executed
   // at once, and it is only executed when the player is ready to accept more
   // audio. The tasks is executed repeatedly until it returns FINISHED.
-  virtual TaskResult Run(AlsaPlayer* player) = 0;
-
-  // Returns the set of file descriptors that this task must wait for in order
-  // to run. By default, all tasks wait on the AlsaPlayer object, but specific
-  // kinds of tasks can override this method to wait on a different descriptor,
-  // e.g. an external process.
-  virtual std::vector<struct pollfd> GetPollDescriptors(
-      AlsaPlayer* player) const;
-
-  // Returns the number of interesting events for this task, given the output
-  // descriptor list from a previous poll() call. If the return value is
-  // different from zero, Run() will be called. By default, all tasks will run
-  // whenever the AlsaPlayer object gets events on the ALSA descriptors.
-  virtual int GetPollEvents(AlsaPlayer* player, struct pollfd* fds,
-                            int nfds) const;
+  virtual TaskResult Run(AudioSink* player) = 0;
+
+  // Returns the bytes of text the task has yet to speak, and an estimate of
+  // the duration of the audio it has yet to produce. The audio manager uses
+  // them to keep its queues within their budget.
+  virtual std::size_t queued_bytes() const { return 0; }
+  virtual std::chrono::milliseconds EstimateDuration() const {
+    return std::chrono::milliseconds(0);
+  }
+
+  // Id of the statement that made the task, in the trace of the server, or
+  // zero if it is not traced.
+  std::uint64_t trace_id() const { return trace_id_; }
+  void set_trace_id(std::uint64_t id) { trace_id_ = id; }
+
+  // Source on whose behalf the task was pushed to the audio manager.
+  int source() const { return source_; }
+  void set_source(int source) { source_ = source; }
 
  protected:
   AudioTask() {}
+
+ private:
+  std::uint64_t trace_id_ = 0;
+  int source_ = 0;
 };
 
 // Speech synthesis task.
@@ -75,68 +105,190 @@ class AudioTask {
 // This task controls the ECI library to synthesize speech, then pass the
 // result to the player. Several ECI operations can be scheduled before the
 // task starts. When the task starts, it invokes all operations on the ECI
-// object in sequence to synthesize speech.
+// object in sequence to synthesize speech. The operations are kept as a
+// compact list, and the text of all of them is stored in a single buffer of
+// the task, so scheduling an utterance takes the same few allocations
+// whatever its length.
+//
+// Text is sent to the engine with an index mark after each spoken word, but
+// not after annotations, e.g. `v2. While speaking, the task records how many
+// frames were written when each mark was reached, so when it is ended before
+// finishing it knows the last word whose audio actually left the device. If
+// the task is started again afterwards, it only synthesizes the text following
+// that word, along with all the annotations of the text.
+//
+// Each run synthesizes for at most kMaxRunTime, even if the player could take
+// more audio, so the server gets back to its input, e.g. to stop the speech,
+// within a bounded time.
 class SpeechTask : public AudioTask {
  public:
-  explicit SpeechTask(ECI* eci);
+  static constexpr std::chrono::milliseconds kMaxRunTime{5};
 
-  // Schedules an AddText(text) operation on ECI.
+  // The audio of the engine is sent to the player through the given
+  // converter, shared by all speech tasks.
+  SpeechTask(ECI* eci, SpeechConverter* converter);
+
+  // Schedules an AddText(text) operation on ECI, inserting an index mark
+  // after each spoken word.
   void AddText(const std::string& text);
 
   // Schedules a Synthesize() operation on ECI.
   void Synthesize();
 
+  // Schedules selecting the given voice and speed from the voice table.
+  void SetVoice(VoiceTable* voices, int voice, int speed);
+
+  // Schedules telling the voice table that the active voice of the engine is
+  // no longer known.
+  void InvalidateVoice(VoiceTable* voices);
+
   // Base class overrides.
-  void StartTask(AlsaPlayer* player) override;
-  void EndTask(AlsaPlayer* player, bool finished) override;
-  TaskResult Run(AlsaPlayer* player) override;
+  void StartTask(AudioSink* player) override;
+  void EndTask(AudioSink* player, bool finished) override;
+  TaskResult Run(AudioSink* player) override;
+  std::size_t queued_bytes() const override;
+  std::chrono::milliseconds EstimateDuration() const override;
+
+  // Returns the number of index marks in the text of this task, one per
+  // spoken word.
+  int num_marks() const { return num_marks_; }
+
+  // Returns the last index mark whose audio was played when the task was
+  // ended, or zero if no word was played yet.
+  int last_spoken_mark() const { return last_spoken_mark_; }
 
  private:
+  // Operation scheduled on the engine.
+  struct Operation {
+    enum Type {
+      ADD_TEXT,
+      SYNTHESIZE,
+      SET_VOICE,
+      INVALIDATE_VOICE,
+    };
+
+    Type type;
+
+    // ADD_TEXT: range of text_ and index mark of its first word.
+    std::size_t text_begin;
+    std::size_t text_end;
+    int first_mark;
+
+    // SET_VOICE and INVALIDATE_VOICE.
+    VoiceTable* voices;
+    int voice;
+    int speed;
+  };
+
+  // Number of operations of a typical utterance: voice, text and synthesis.
+  static constexpr std::size_t kReservedOperations = 4;
+
+  // Adds the words of text_ in the given range with index marks, numbered from
+  // first_mark, to the engine. Spoken words up to last_spoken_mark_ are
+  // skipped.
+  void AddMarkedText(std::size_t begin, std::size_t end, int first_mark);
+
+  // ECI callbacks, installed while the task is running.
+  ECICallbackReturn OnWaveform(AudioSink* player, long frames);
+  ECICallbackReturn OnIndex(long index);
+
   ECI* eci_;
+  SpeechConverter* converter_;
+
+  // Time after which the current run stops taking audio from the engine.
+  std::chrono::steady_clock::time_point run_deadline_;
+
+  // Time spent in the engine since the task was started.
+  std::chrono::steady_clock::duration synthesis_time_{0};
 
-  using Operation = std::function<void(ECI*)>;
   std::vector<Operation> ops_;
+  std::string text_;
+
+  int num_marks_ = 0;
+  int last_spoken_mark_ = 0;
+
+  // Whether the engine produced audio since the task was started.
+  bool waveform_started_ = false;
+
+  // Frames written to the player since the task was started, and the number
+  // of frames written at the time each index mark was reached.
+  std::size_t frames_written_ = 0;
+  std::vector<std::pair<int, std::size_t>> reached_marks_;
 };
 
 // Tone synthesis task.
 //
-// This task generates a sinusoidal tone with the given parameters.
+// This task generates a sinusoidal tone with the given parameters, in the
+// sample format and number of channels of the player.
 class ToneTask : public AudioTask {
  public:
   ToneTask(float frequency, float amplitude, int duration_ms);
 
   // Base class overrides.
-  void StartTask(AlsaPlayer* player) override;
-  TaskResult Run(AlsaPlayer* player) override;
+  void StartTask(AudioSink* player) override;
+  TaskResult Run(AudioSink* player) override;
+  std::chrono::milliseconds EstimateDuration() const override {
+    return std::chrono::milliseconds(duration_ms_);
+  }
 
  private:
   const float frequency_;
   const float amplitude_;
   const int duration_ms_;
 
-  unsigned int sample_rate_ = 0;
-  unsigned int duration_samples_ = 0;
-  unsigned int t_ = 0;
+  std::unique_ptr<ToneGenerator> generator_;
+  std::unique_ptr<PcmFormat> format_;
+
+  // Mono and interleaved samples of one period.
+  std::vector<float> samples_;
+  std::vector<float> frames_;
+};
+
+// Silence task.
+//
+// This task writes silence of the given duration directly to the player.
+class SilenceTask : public AudioTask {
+ public:
+  explicit SilenceTask(int duration_ms);
+
+  // Base class overrides.
+  void StartTask(AudioSink* player) override;
+  TaskResult Run(AudioSink* player) override;
+  std::chrono::milliseconds EstimateDuration() const override {
+    return std::chrono::milliseconds(duration_ms_);
+  }
+
+ private:
+  const int duration_ms_;
+
+  std::unique_ptr<PcmFormat> format_;
+  std::size_t remaining_frames_ = 0;
 };
 
 // Play audio task.
 //
-// This class plays via an external process the given file.
+// This class plays an auditory icon, decoded once by the icon cache. When it
+// reaches the front of the queue, it hands the icon to the mixer of the player
+// and finishes, so the tasks after it play over the icon instead of waiting
+// for it.
 class PlayTask : public AudioTask {
  public:
-  explicit PlayTask(const std::string& file_path);
+  PlayTask(IconCache* icons, const std::string& file_path, float gain);
 
-  // Starts the external process to play the file.
-  void StartTask(AlsaPlayer* player) override;
+  // Fetches the decoded icon from the cache, decoding the file if needed.
+  void StartTask(AudioSink* player) override;
 
-  // Run() will only be called when the poll descriptors for this task are
-  // returned. In this case, we wait for the external process to finish. For
-  // this reason, this task does not need to do anything in this method .
-  TaskResult Run(AlsaPlayer* player) override;
+  // Starts mixing the icon.
+  TaskResult Run(AudioSink* player) override;
 
  private:
+  IconCache* icons_;
+
   // File path of the .wav file to be played.
   const std::string file_path_;
+  const float gain_;
+
+  std::shared_ptr<const Icon> icon_;
 };
 
 #endif  // AUDIO_TASKS_H_
@@ -0,0 +1,132 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_tasks.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "audio_manager.h"
+#include "null_sink.h"
+#include "tts.h"
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, const string& value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Number of calls to the global operator new.
+int allocations = 0;
+
+void* operator new(std::size_t size) {
+  ++allocations;
+  void* block = std::malloc(size == 0 ? 1 : size);
+  if (block == nullptr) throw std::bad_alloc();
+  return block;
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+
+// Returns text with the given number of words.
+string MakeText(int words) {
+  string text;
+  for (int i = 0; i < words; ++i) {
+    text += "utterance ";
+  }
+  return text;
+}
+
+// Returns the number of allocations taken to say an utterance with the given
+// text, push it to the audio manager and discard it, as q, d and s commands
+// do. The audio manager is kept busy by another source, so the utterance is
+// only queued: once started, the allocations are those of the engine.
+int CountAllocations(TTS* tts, AudioManager* audio, const string& text) {
+  const int before = allocations;
+  tts->Say(text);
+  audio->Push(tts->ReleaseTask(), AudioManager::BULK, 1);
+  audio->Clear(1);
+  return allocations - before;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <fake ECI library>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  ECI::Init(argv[1]);
+
+  {
+    NullSink::Options sink_options;
+    sink_options.clock = NullSink::VIRTUAL;
+    AudioManager audio(
+        std::unique_ptr<AudioSink>(new NullSink(sink_options)));
+    TTS tts(&audio);
+    audio.Push(std::unique_ptr<AudioTask>(new SilenceTask(10000)),
+               AudioManager::BULK, 2);
+
+    // The first task takes its memory from the allocator, later ones reuse it.
+    CountAllocations(&tts, &audio, MakeText(400));
+
+    string counts;
+    bool constant = true;
+    int first = -1;
+    for (int words : {4, 40, 400}) {
+      const int count = CountAllocations(&tts, &audio, MakeText(words));
+      if (first < 0) first = count;
+      constant = constant && count == first;
+      if (!counts.empty()) counts += ", ";
+      counts += std::to_string(count) + " for " + std::to_string(words) +
+                " words";
+    }
+    Check("Constant allocations per utterance", constant, counts);
+
+    Check("Speech task returned to the arena", TaskArena::free_blocks() == 1,
+          std::to_string(TaskArena::free_blocks()) + " free blocks");
+    audio.Clear();
+  }
+
+  {
+    // Annotations are not words, so they have no index mark.
+    SpeechTask task(nullptr, nullptr);
+    task.AddText("`v2 hello `vs60 world `p1");
+    Check("Marks of spoken words", task.num_marks() == 2,
+          std::to_string(task.num_marks()) + " marks");
+  }
+
+  {
+    // Once tasks were destroyed, new tasks reuse their memory.
+    std::unique_ptr<AudioTask> tone(new ToneTask(440, 0.3f, 10));
+    std::unique_ptr<AudioTask> silence(new SilenceTask(10));
+    tone.reset();
+    silence.reset();
+    const int before = allocations;
+    tone.reset(new ToneTask(880, 0.3f, 10));
+    silence.reset(new SilenceTask(20));
+    Check("Recycled tasks", allocations == before,
+          std::to_string(allocations - before) + " allocations");
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
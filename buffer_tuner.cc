@@ -0,0 +1,119 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "buffer_tuner.h"
+
+#include <algorithm>
+#include <iostream>
+
+using std::chrono::microseconds;
+
+namespace {
+
+double ToMs(microseconds time) { return time.count() / 1000.0; }
+
+}  // namespace
+
+BufferTuner::BufferTuner(microseconds initial_buffer_time,
+                         const Options& options)
+    : options_(options), buffer_time_(initial_buffer_time) {
+  buffer_time_ = Clamp(buffer_time_);
+}
+
+void BufferTuner::AddJitter(microseconds jitter) {
+  max_jitter_ = std::max(max_jitter_, jitter);
+}
+
+bool BufferTuner::EndUtterance() {
+  const microseconds previous = buffer_time_;
+  const microseconds jitter = max_jitter_;
+  const int underruns = underruns_;
+  underruns_ = 0;
+
+  if (underruns > 0) {
+    // Back off, and remember not to shrink to this size again.
+    stable_utterances_ = 0;
+    max_jitter_ = microseconds(0);
+    utterances_since_underrun_ = 0;
+    if (unstable_buffer_time_ == microseconds(0) ||
+        previous > unstable_buffer_time_) {
+      unstable_buffer_time_ = previous;
+    }
+    buffer_time_ = Clamp(previous * 2);
+    if (options_.log) {
+      std::cerr << "BufferTuner: " << underruns << " underrun(s) with "
+                << ToMs(previous) << "ms, growing buffer to "
+                << ToMs(buffer_time_) << "ms." << std::endl;
+    }
+    return buffer_time_ != previous;
+  }
+
+  if (unstable_buffer_time_ > microseconds(0) &&
+      ++utterances_since_underrun_ >= options_.forget_underrun_utterances) {
+    if (options_.log) {
+      std::cerr << "BufferTuner: No underruns in "
+                << utterances_since_underrun_ << " utterances, allowing "
+                << ToMs(unstable_buffer_time_) << "ms again." << std::endl;
+    }
+    unstable_buffer_time_ = microseconds(0);
+    utterances_since_underrun_ = 0;
+  }
+
+  if (++stable_utterances_ < options_.stable_utterances) {
+    if (options_.log) {
+      std::cerr << "BufferTuner: No underruns with " << ToMs(previous)
+                << "ms, " << stable_utterances_ << " of "
+                << options_.stable_utterances << " stable utterances."
+                << std::endl;
+    }
+    return false;
+  }
+  stable_utterances_ = 0;
+  max_jitter_ = microseconds(0);
+
+  // Shrink by a quarter at most, keeping the margin over the jitter and
+  // staying above the size that underran.
+  microseconds target = std::max(
+      previous * 3 / 4,
+      microseconds(static_cast<microseconds::rep>(jitter.count() *
+                                                  options_.margin)));
+  if (unstable_buffer_time_ > microseconds(0)) {
+    target = std::max(target, unstable_buffer_time_ * 5 / 4);
+  }
+  target = Clamp(target);
+
+  if (target >= previous) {
+    if (options_.log) {
+      std::cerr << "BufferTuner: No underruns in "
+                << options_.stable_utterances << " utterances, worst jitter "
+                << ToMs(jitter) << "ms, keeping buffer at " << ToMs(previous)
+                << "ms." << std::endl;
+    }
+    return false;
+  }
+
+  buffer_time_ = target;
+  if (options_.log) {
+    std::cerr << "BufferTuner: No underruns in "
+              << options_.stable_utterances << " utterances, worst jitter "
+              << ToMs(jitter) << "ms, shrinking buffer from " << ToMs(previous)
+              << "ms to " << ToMs(buffer_time_) << "ms." << std::endl;
+  }
+  return true;
+}
+
+microseconds BufferTuner::Clamp(microseconds time) const {
+  return std::min(std::max(time, options_.min_buffer_time),
+                  options_.max_buffer_time);
+}
@@ -0,0 +1,92 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUFFER_TUNER_H_
+#define BUFFER_TUNER_H_
+
+#include <chrono>
+
+// Chooses the audio buffer time from the underruns and the scheduling jitter
+// measured during each utterance.
+//
+// A small buffer keeps the latency of every command low, but underruns if the
+// main loop does not refill it in time. The jitter is measured as how long the
+// device kept playing after asking for more audio, before the main loop came
+// back to refill it. After several utterances without underruns, the buffer
+// shrinks step by step, but never below a safety margin over the worst jitter
+// seen. After an underrun, it grows back, and it does not shrink again to the
+// size that underran until it has been stable for a while, so that a single
+// glitch does not hold the buffer large forever.
+class BufferTuner {
+ public:
+  struct Options {
+    Options() noexcept {}
+
+    // Limits of the buffer time.
+    std::chrono::microseconds min_buffer_time = std::chrono::milliseconds(10);
+    std::chrono::microseconds max_buffer_time = std::chrono::milliseconds(500);
+
+    // Number of consecutive utterances without underruns before shrinking.
+    int stable_utterances = 3;
+
+    // Number of consecutive utterances without underruns after which the
+    // buffer may shrink again to the size that underran.
+    int forget_underrun_utterances = 30;
+
+    // How many times the worst jitter the buffer time must be.
+    double margin = 2.0;
+
+    // Whether to log every decision to stderr.
+    bool log = true;
+  };
+
+  explicit BufferTuner(std::chrono::microseconds initial_buffer_time,
+                       const Options& options = Options());
+
+  // Returns the buffer time that should be used.
+  std::chrono::microseconds buffer_time() const { return buffer_time_; }
+
+  // Records an underrun during the current utterance.
+  void AddUnderrun() { ++underruns_; }
+
+  // Records how long the device waited for the main loop to refill it.
+  void AddJitter(std::chrono::microseconds jitter);
+
+  // Ends the current utterance and decides the buffer time for the next
+  // ones. Returns whether buffer_time() changed.
+  bool EndUtterance();
+
+ private:
+  std::chrono::microseconds Clamp(std::chrono::microseconds time) const;
+
+  const Options options_;
+  std::chrono::microseconds buffer_time_;
+
+  // Largest buffer time that underran, or zero if none did since the last
+  // forget_underrun_utterances utterances.
+  std::chrono::microseconds unstable_buffer_time_{0};
+
+  // Number of consecutive utterances without underruns since one underran.
+  int utterances_since_underrun_ = 0;
+
+  // Underruns of the current utterance, and worst jitter since the buffer
+  // time was last decided, i.e. over the current stable utterances.
+  int underruns_ = 0;
+  std::chrono::microseconds max_jitter_{0};
+
+  // Number of consecutive utterances without underruns.
+  int stable_utterances_ = 0;
+};
+
+#endif  // BUFFER_TUNER_H_
@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "buffer_tuner.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using std::chrono::milliseconds;
+
+bool good = true;
+
+void Check(const std::string& name, milliseconds expected,
+           std::chrono::microseconds actual) {
+  if (actual != expected) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": expected=" << expected.count()
+              << "ms actual=" << actual.count() / 1000.0 << "ms\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << expected.count() << "ms\n";
+  }
+}
+
+// Ends the given number of utterances with the given jitter and no underruns.
+void StableUtterances(BufferTuner* tuner, int count, milliseconds jitter) {
+  for (int i = 0; i < count; ++i) {
+    tuner->AddJitter(jitter);
+    tuner->EndUtterance();
+  }
+}
+
+int main() {
+  BufferTuner::Options options;
+  options.log = false;
+  options.stable_utterances = 2;
+
+  {
+    BufferTuner tuner(milliseconds(1000), options);
+    Check("Clamped to the maximum", milliseconds(500), tuner.buffer_time());
+  }
+
+  {
+    BufferTuner tuner(milliseconds(100), options);
+    StableUtterances(&tuner, 1, milliseconds(1));
+    Check("Kept until stable", milliseconds(100), tuner.buffer_time());
+    StableUtterances(&tuner, 1, milliseconds(1));
+    Check("Shrinks by a quarter", milliseconds(75), tuner.buffer_time());
+    StableUtterances(&tuner, 20, milliseconds(1));
+    Check("Shrinks down to the minimum", milliseconds(10),
+          tuner.buffer_time());
+  }
+
+  {
+    BufferTuner tuner(milliseconds(100), options);
+    StableUtterances(&tuner, 20, milliseconds(30));
+    Check("Keeps a margin over the jitter", milliseconds(60),
+          tuner.buffer_time());
+  }
+
+  {
+    BufferTuner tuner(milliseconds(100), options);
+    StableUtterances(&tuner, 1, milliseconds(45));
+    StableUtterances(&tuner, 1, milliseconds(1));
+    Check("Keeps a margin over the jitter of every utterance",
+          milliseconds(90), tuner.buffer_time());
+  }
+
+  {
+    BufferTuner tuner(milliseconds(40), options);
+    tuner.AddUnderrun();
+    tuner.EndUtterance();
+    Check("Grows after an underrun", milliseconds(80), tuner.buffer_time());
+    StableUtterances(&tuner, 20, milliseconds(1));
+    Check("Stays above the size that underran", milliseconds(50),
+          tuner.buffer_time());
+  }
+
+  {
+    BufferTuner::Options forgetful = options;
+    forgetful.forget_underrun_utterances = 10;
+    BufferTuner tuner(milliseconds(40), forgetful);
+    tuner.AddUnderrun();
+    tuner.EndUtterance();
+    StableUtterances(&tuner, 9, milliseconds(1));
+    Check("Held after a single underrun", milliseconds(50),
+          tuner.buffer_time());
+    StableUtterances(&tuner, 20, milliseconds(1));
+    Check("Recovers after a single underrun", milliseconds(10),
+          tuner.buffer_time());
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -37,6 +37,10 @@ CommandRegistry::CommandRegistry() {
   commands_map_["t"] = unique_ptr<Command>(new TCommand());
   commands_map_["tts_set_speech_rate"] =
       unique_ptr<Command>(new TtsSetSpeechRateCommand());
+  commands_map_["tts_set_playback_tempo"] =
+      unique_ptr<Command>(new TtsSetPlaybackTempoCommand());
+  commands_map_["tts_set_voice"] =
+      unique_ptr<Command>(new TtsSetVoiceCommand());
   commands_map_["tts_set_punctuations"] =
       unique_ptr<Command>(new TtsSetPunctuationsCommand());
   commands_map_["tts_split_caps"] =
@@ -47,6 +51,12 @@ CommandRegistry::CommandRegistry() {
       unique_ptr<Command>(new TtsAllcapsBeepCommand());
   commands_map_["tts_sync_state"] =
       unique_ptr<Command>(new TtsSyncStateCommand());
+  commands_map_["set_lang"] = unique_ptr<Command>(new SetLangCommand());
+  commands_map_["set_next_lang"] =
+      unique_ptr<Command>(new SetNextLangCommand());
+  commands_map_["set_previous_lang"] =
+      unique_ptr<Command>(new SetPreviousLangCommand());
+  commands_map_["tts_stats"] = unique_ptr<Command>(new TtsStatsCommand());
 }
 
 Command* CommandRegistry::GetCommand(const std::string& command_name) {
@@ -14,17 +14,41 @@
 
 #include "commands.h"
 
+#include <cmath>
 #include <memory>
 #include <sstream>
 
+#include "metrics.h"
+#include "metrics_exporter.h"
 #include "text_formatter.h"
+#include "tracer.h"
 
 using std::string;
 using std::unique_ptr;
 
+namespace {
+
+// Speaks the name of the currently selected language.
+bool SayLanguage(const CommandContext& ctx) {
+  const string name = TTS::GetLanguageName(ctx.tts->GetLanguage());
+  return ctx.tts->Say(name, ctx.tts->GetVoice()) &&
+         ctx.tts->SubmitTask(AudioManager::INTERACTIVE);
+}
+
+// Time taken to format the text of each q command.
+Histogram* FormatTime() {
+  static Histogram* histogram = Metrics::Default()->GetHistogram(
+      "speech_server_format_seconds", "Time to format the text of a q command.",
+      {0.00001, 0.00003, 0.0001, 0.0003, 0.001, 0.003, 0.01});
+  return histogram;
+}
+
+}  // namespace
+
 bool VersionCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   const string msg = "ViaVoice " + ctx.tts->TTSVersion();
-  return ctx.tts->Say(msg, TTS::DEFAULT_VOICE) && ctx.tts->SubmitTask();
+  return ctx.tts->Say(msg, ctx.tts->GetVoice()) &&
+         ctx.tts->SubmitTask(AudioManager::INTERACTIVE);
 }
 
 bool TtsSayCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
@@ -33,8 +57,9 @@ bool TtsSayCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   }
   const string processed_msg =
       ctx.server_state->text_formatter()->FormatPause(cmd.arguments[0]);
-  return ctx.tts->Say(processed_msg, TTS::DEFAULT_VOICE) &&
-         ctx.tts->SubmitTask();
+  // Spoken right after the current utterance, before any queued speech.
+  return ctx.tts->Say(processed_msg, ctx.tts->GetVoice()) &&
+         ctx.tts->SubmitTask(AudioManager::INTERACTIVE);
 }
 
 bool LCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
@@ -43,7 +68,10 @@ bool LCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   }
   const string msg =
       ctx.server_state->text_formatter()->FormatSingleChar(cmd.arguments[0][0]);
-  return ctx.tts->Say(msg, TTS::DEFAULT_VOICE) && ctx.tts->SubmitTask();
+  return ctx.tts->Say(msg, ctx.tts->GetVoice()) &&
+         ctx.tts->SubmitTask(ctx.server_state->urgent_letters()
+                                 ? AudioManager::URGENT
+                                 : AudioManager::INTERACTIVE);
 }
 
 bool TtsPauseCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
@@ -69,10 +97,16 @@ bool QCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   if (cmd.arguments.size() != 1) {
     return false;
   }
-  string processed_message = ctx.server_state->text_formatter()->Format(
-      cmd.arguments[0], ctx.server_state->punctuation_mode(),
-      ctx.server_state->tts_split_caps(), ctx.server_state->tts_capitalize(),
-      ctx.server_state->tts_allcaps_beep());
+  string processed_message;
+  Tracer::Begin("Format", ctx.trace_id);
+  {
+    ScopedTimer timer(FormatTime());
+    processed_message = ctx.server_state->text_formatter()->Format(
+        cmd.arguments[0], ctx.server_state->punctuation_mode(),
+        ctx.server_state->tts_split_caps(), ctx.server_state->tts_capitalize(),
+        ctx.server_state->tts_allcaps_beep());
+  }
+  Tracer::End("Format", ctx.trace_id);
   ctx.tts->Say(processed_message);
   ctx.server_state->queue().push(ctx.tts->ReleaseTask());
   return true;
@@ -91,7 +125,9 @@ bool ACommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   if (cmd.arguments.size() != 1) {
     return false;
   }
-  std::unique_ptr<PlayTask> task(new PlayTask(cmd.arguments[0]));
+  std::unique_ptr<PlayTask> task(
+      new PlayTask(ctx.server_state->icon_cache(), cmd.arguments[0],
+                   ctx.server_state->icon_gain()));
   ctx.server_state->queue().push(std::move(task));
   return true;
 }
@@ -100,19 +136,30 @@ bool PCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
   if (cmd.arguments.size() != 1) {
     return false;
   }
-  std::unique_ptr<PlayTask> task(new PlayTask(cmd.arguments[0]));
-  ctx.server_state->audio()->Push(std::move(task));
+  // The icon is mixed immediately over whatever is playing.
+  std::shared_ptr<const Icon> icon;
+  try {
+    icon = ctx.server_state->icon_cache()->Get(cmd.arguments[0]);
+  } catch (std::exception& e) {
+    return false;
+  }
+  ctx.server_state->audio()->PlayIcon(icon, ctx.server_state->icon_gain(),
+                                      ctx.tts->source());
   return true;
 }
 
 bool DCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
-  // Annotates all the messages to be dispatched to speak with the default
-  // voice.
-  ctx.server_state->audio()->Push(
-      ctx.tts->UseSelectedVoice(TTS::DEFAULT_VOICE));
+  // Annotates all the messages to be dispatched to speak with the voice of
+  // the client. The tasks are pushed on behalf of the client, so that its stops
+  // only clear its own speech.
+  AudioManager* audio = ctx.server_state->audio();
+  const int source = ctx.tts->source();
+  audio->Push(ctx.tts->UseSelectedVoice(ctx.tts->GetVoice()),
+              AudioManager::BULK, source);
   while (!ctx.server_state->queue().empty()) {
     auto& task = ctx.server_state->queue().front();
-    ctx.server_state->audio()->Push(std::move(task));
+    Tracer::Mark("Dispatch", task->trace_id());
+    audio->Push(std::move(task), AudioManager::BULK, source);
     ctx.server_state->queue().pop();
   }
   return true;
@@ -127,8 +174,8 @@ bool ShCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
     return false;
   }
 
-  ctx.tts->GenerateSilence(duration);
-  ctx.server_state->queue().push(ctx.tts->ReleaseTask());
+  std::unique_ptr<SilenceTask> silence(new SilenceTask(duration));
+  ctx.server_state->queue().push(std::move(silence));
   return true;
 }
 
@@ -168,6 +215,49 @@ bool TtsSetSpeechRateCommand::Run(const StatementInfo& cmd,
   return true;
 }
 
+bool TtsSetPlaybackTempoCommand::Run(const StatementInfo& cmd,
+                                     const CommandContext& ctx) {
+  if (cmd.arguments.size() != 1) {
+    return false;
+  }
+
+  // Rejects anything but a finite number in range, e.g. "fast" or "nan".
+  double tempo;
+  try {
+    std::size_t parsed = 0;
+    tempo = std::stod(cmd.arguments[0], &parsed);
+    if (parsed != cmd.arguments[0].size()) {
+      return false;
+    }
+  } catch (std::exception& e) {
+    return false;
+  }
+  if (!std::isfinite(tempo) || tempo < TimeStretcher::kMinTempo ||
+      tempo > TimeStretcher::kMaxTempo) {
+    return false;
+  }
+
+  ctx.tts->SetPlaybackTempo(tempo);
+  return true;
+}
+
+bool TtsSetVoiceCommand::Run(const StatementInfo& cmd,
+                            const CommandContext& ctx) {
+  if (cmd.arguments.size() != 1) {
+    return false;
+  }
+
+  TTS::ECIVoiceAnnotation voice;
+  try {
+    voice = TTS::GetVoiceConfig(cmd.arguments[0]);
+  } catch (TTSError& e) {
+    return false;
+  }
+
+  ctx.tts->SetVoice(voice);
+  return true;
+}
+
 bool TtsSetPunctuationsCommand::Run(const StatementInfo& cmd,
                                     const CommandContext& ctx) {
   if (cmd.arguments.size() != 1) {
@@ -276,3 +366,58 @@ bool TtsSyncStateCommand::Run(const StatementInfo& cmd,
 
   return true;
 }
+
+bool SetLangCommand::Run(const StatementInfo& cmd, const CommandContext& ctx) {
+  if (cmd.arguments.size() != 1 && cmd.arguments.size() != 2) {
+    return false;
+  }
+
+  ECILanguageDialect language;
+  try {
+    language = TTS::GetLanguageConfig(cmd.arguments[0]);
+  } catch (TTSError& e) {
+    return false;
+  }
+
+  if (!ctx.tts->SelectLanguage(language)) {
+    return false;
+  }
+  if (cmd.arguments.size() == 2 && cmd.arguments[1] == "1") {
+    return SayLanguage(ctx);
+  }
+  return true;
+}
+
+bool SetNextLangCommand::Run(const StatementInfo& cmd,
+                             const CommandContext& ctx) {
+  if (cmd.arguments.size() > 1) {
+    return false;
+  }
+
+  ctx.tts->NextLanguage();
+  if (cmd.arguments.size() == 1 && cmd.arguments[0] == "1") {
+    return SayLanguage(ctx);
+  }
+  return true;
+}
+
+bool SetPreviousLangCommand::Run(const StatementInfo& cmd,
+                                 const CommandContext& ctx) {
+  if (cmd.arguments.size() > 1) {
+    return false;
+  }
+
+  ctx.tts->PreviousLanguage();
+  if (cmd.arguments.size() == 1 && cmd.arguments[0] == "1") {
+    return SayLanguage(ctx);
+  }
+  return true;
+}
+
+bool TtsStatsCommand::Run(const StatementInfo& cmd,
+                          const CommandContext& ctx) {
+  if (!cmd.arguments.empty() || ctx.output_fd < 0) {
+    return false;
+  }
+  return MetricsExporter::Send(ctx.output_fd, Metrics::Default()->ToString());
+}
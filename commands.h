@@ -15,6 +15,8 @@
 #ifndef COMMANDS_H_
 #define COMMANDS_H_
 
+#include <cstdint>
+
 #include "input_parser.h"
 #include "tts.h"
 #include "server_state.h"
@@ -22,6 +24,12 @@
 struct CommandContext {
   TTS* tts = nullptr;
   ServerState* server_state = nullptr;
+  // Descriptor where the command writes its reply, if it has one: the socket
+  // of the client, or the standard output.
+  int output_fd = -1;
+  // Id of the statement in the trace of the server, or zero if it is not
+  // traced.
+  std::uint64_t trace_id = 0;
 };
 
 // Base class that all commands of the speech server derive. Child classes are
@@ -33,6 +41,11 @@ class Command {
   Command() = default;
   virtual ~Command() = default;
   virtual bool Run(const StatementInfo& cmd, const CommandContext& ctx) = 0;
+
+  // Returns whether the only effect of the command is adding a task to the
+  // queue of the server state, so it can be skipped if the queue is cleared
+  // before it is dispatched.
+  virtual bool QueuesOnly() const { return false; }
 };
 
 // Returns the version of the underlying speech engine. It produces an speech
@@ -66,7 +79,8 @@ class TtsPauseCommand : public Command {
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
 };
 
-// Resumes the speech previously paused.
+// Resumes the speech previously paused, from the last word that was spoken if
+// the sound device could not pause.
 class TtsResumeCommand : public Command {
  public:
   TtsResumeCommand() = default;
@@ -84,6 +98,7 @@ class QCommand : public Command {
  public:
   QCommand() = default;
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+  bool QueuesOnly() const override { return true; }
 };
 
 class DCommand : public Command {
@@ -98,16 +113,19 @@ class CCommand : public Command {
  public:
   CCommand() = default;
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+  bool QueuesOnly() const override { return true; }
 };
 
-// Queues a file to be played.
+// Queues a file to be played. Once dispatched, the speech that follows it
+// plays over it.
 class ACommand : public Command {
  public:
   ACommand() = default;
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+  bool QueuesOnly() const override { return true; }
 };
 
-// Plays an audio file immediately.
+// Plays an audio file immediately, mixed over any speech in progress.
 class PCommand : public Command {
  public:
   PCommand() = default;
@@ -119,12 +137,14 @@ class ShCommand : public Command {
  public:
   ShCommand() = default;
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+  bool QueuesOnly() const override { return true; }
 };
 
 class TCommand : public Command {
  public:
   TCommand() = default;
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+  bool QueuesOnly() const override { return true; }
 };
 
 class TtsSetSpeechRateCommand : public Command {
@@ -133,6 +153,22 @@ class TtsSetSpeechRateCommand : public Command {
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
 };
 
+// Changes the tempo of the speech immediately, including speech that is
+// already playing, by a factor from 0.5 to 3.
+class TtsSetPlaybackTempoCommand : public Command {
+ public:
+  TtsSetPlaybackTempoCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
+// Selects the voice the client speaks with, by the name of one of the preset
+// voices of the server, e.g. "harry" or "wendy".
+class TtsSetVoiceCommand : public Command {
+ public:
+  TtsSetVoiceCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
 class TtsSetPunctuationsCommand : public Command {
  public:
   TtsSetPunctuationsCommand() = default;
@@ -163,4 +199,37 @@ class TtsSyncStateCommand : public Command {
   bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
 };
 
+// Switches to the given language, e.g. "set_lang en_US". Each language has its
+// own engine, so switching does not stall the speech output. If the optional
+// second argument is "1", the name of the new language is spoken.
+class SetLangCommand : public Command {
+ public:
+  SetLangCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
+// Switches to the next available language. If the optional argument is "1",
+// the name of the new language is spoken.
+class SetNextLangCommand : public Command {
+ public:
+  SetNextLangCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
+// Switches to the previous available language. If the optional argument is
+// "1", the name of the new language is spoken.
+class SetPreviousLangCommand : public Command {
+ public:
+  SetPreviousLangCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
+// Writes the metrics of the server to the client, in the Prometheus text
+// format.
+class TtsStatsCommand : public Command {
+ public:
+  TtsStatsCommand() = default;
+  bool Run(const StatementInfo& cmd, const CommandContext& ctx) override;
+};
+
 #endif  // COMMANDS_H_
@@ -0,0 +1,177 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests of the commands of the server, run against the fake ECI library whose
+// path is given as the only argument.
+
+#include "commands.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_manager.h"
+#include "eci-c++.h"
+#include "null_sink.h"
+#include "server_state.h"
+#include "text_formatter.h"
+#include "tts.h"
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, const string& value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Sink of a device that cannot pause.
+class UnpausableSink : public NullSink {
+ public:
+  explicit UnpausableSink(const Options& options) : NullSink(options) {}
+
+  bool Pause() override { return false; }
+};
+
+// Client of the server, whose commands are run on behalf of its source.
+struct Client {
+  Client(int source, AudioManager* audio, TextFormatter* text_formatter)
+      : source(source), server_state(audio, text_formatter, nullptr) {}
+
+  const int source;
+  ServerState server_state;
+};
+
+// Runs a command of the client, as the server does.
+bool Run(Client* client, TTS* tts, Command* command,
+         const std::vector<string>& arguments = {}) {
+  StatementInfo statement;
+  statement.arguments = arguments;
+  tts->set_source(client->source);
+  CommandContext context;
+  context.tts = tts;
+  context.server_state = &client->server_state;
+  return command->Run(statement, context);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <fake ECI library>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  ECI::Init(argv[1]);
+
+  NullSink::Options sink_options;
+  sink_options.clock = NullSink::VIRTUAL;
+  AudioManager audio(
+      std::unique_ptr<AudioSink>(new NullSink(sink_options)));
+  TTS tts(&audio);
+  ECITextFormatter text_formatter;
+
+  QCommand q;
+  DCommand d;
+  SCommand s;
+  TtsPauseCommand pause;
+  TtsResumeCommand resume;
+  TtsSetPlaybackTempoCommand tempo;
+
+  {
+    // Speech dispatched by two clients belongs to each of them, so a stop
+    // only clears the speech of the client that sent it.
+    Client first(1, &audio, &text_formatter);
+    Client second(2, &audio, &text_formatter);
+    Run(&first, &tts, &q, {"first client"});
+    Run(&first, &tts, &d);
+    audio.Run();
+    Run(&second, &tts, &q, {"second client"});
+    Run(&second, &tts, &d);
+    Check("Playing the first client", audio.current_source() == 1,
+          std::to_string(audio.current_source()));
+
+    Run(&second, &tts, &s);
+    Check("First client still playing", audio.current_source() == 1,
+          std::to_string(audio.current_source()));
+    const std::size_t first_tasks = audio.Clear(1).size();
+    const std::size_t other_tasks = audio.Clear().size();
+    Check("Stopped the second client only",
+          first_tasks > 0 && other_tasks == 0,
+          std::to_string(first_tasks) + " tasks of the first client, " +
+              std::to_string(other_tasks) + " others");
+  }
+
+  {
+    // Only finite tempos in range are accepted, and a rejected tempo leaves
+    // the current one untouched.
+    Client client(1, &audio, &text_formatter);
+    const bool accepted = Run(&client, &tts, &tempo, {"1.5"});
+    Check("Tempo accepted", accepted && tts.GetPlaybackTempo() == 1.5,
+          std::to_string(tts.GetPlaybackTempo()));
+    for (const char* value : {"fast", "nan", "inf", "1.5x", "100", ""}) {
+      const bool rejected = !Run(&client, &tts, &tempo, {value});
+      Check("Tempo rejected", rejected && tts.GetPlaybackTempo() == 1.5,
+            string("\"") + value + "\"");
+    }
+  }
+
+  {
+    // Clients speak with the preset voice they select by name.
+    Client client(1, &audio, &text_formatter);
+    TtsSetVoiceCommand set_voice;
+    const bool selected = Run(&client, &tts, &set_voice, {"wendy"});
+    Check("Voice selected", selected && tts.GetVoice() == TTS::WENDY,
+          std::to_string(tts.GetVoice()));
+    const bool rejected = !Run(&client, &tts, &set_voice, {"nobody"});
+    Check("Unknown voice rejected", rejected && tts.GetVoice() == TTS::WENDY,
+          std::to_string(tts.GetVoice()));
+    tts.SetVoice(TTS::DEFAULT_VOICE);
+  }
+
+  {
+    // A pause on a device that cannot pause interrupts the speech, which is
+    // resumed later, but speech that was stopped is not.
+    AudioManager audio(
+        std::unique_ptr<AudioSink>(new UnpausableSink(sink_options)));
+    TTS tts(&audio);
+    Client client(1, &audio, &text_formatter);
+
+    Run(&client, &tts, &q, {"paused speech"});
+    Run(&client, &tts, &d);
+    audio.Run();
+    Run(&client, &tts, &pause);
+    Check("Interrupted by a pause", audio.current_source() == -1,
+          std::to_string(audio.current_source()));
+    Run(&client, &tts, &resume);
+    std::size_t resumed = audio.Clear(1).size();
+    Check("Resumed after a pause", resumed > 0,
+          std::to_string(resumed) + " tasks");
+
+    Run(&client, &tts, &q, {"stopped speech"});
+    Run(&client, &tts, &d);
+    audio.Run();
+    Run(&client, &tts, &s);
+    Run(&client, &tts, &resume);
+    resumed = audio.Clear(1).size();
+    Check("Not resumed after a stop", resumed == 0,
+          std::to_string(resumed) + " tasks");
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
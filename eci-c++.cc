@@ -46,6 +46,11 @@ struct ECI::Library {
   int (*eciSetDefaultParam)(ECIParam, int);
   int (*eciGetParam)(ECIHand, ECIParam);
   int (*eciSetParam)(ECIHand, ECIParam, int);
+  Boolean (*eciCopyVoice)(ECIHand, int, int);
+  Boolean (*eciGetVoiceName)(ECIHand, int, void*);
+  Boolean (*eciSetVoiceName)(ECIHand, int, const void*);
+  int (*eciGetVoiceParam)(ECIHand, int, ECIVoiceParam);
+  int (*eciSetVoiceParam)(ECIHand, int, ECIVoiceParam, int);
   void (*eciClearErrors)(ECIHand);
   int (*eciProgStatus)(ECIHand);
   void (*eciErrorMessage)(ECIHand, void*);
@@ -95,6 +100,11 @@ void ECI::Init(const std::string& library_path) {
   LoadSymbol(lib_.handle, &lib_.eciSetDefaultParam, "eciSetDefaultParam");
   LoadSymbol(lib_.handle, &lib_.eciGetParam, "eciGetParam");
   LoadSymbol(lib_.handle, &lib_.eciSetParam, "eciSetParam");
+  LoadSymbol(lib_.handle, &lib_.eciCopyVoice, "eciCopyVoice");
+  LoadSymbol(lib_.handle, &lib_.eciGetVoiceName, "eciGetVoiceName");
+  LoadSymbol(lib_.handle, &lib_.eciSetVoiceName, "eciSetVoiceName");
+  LoadSymbol(lib_.handle, &lib_.eciGetVoiceParam, "eciGetVoiceParam");
+  LoadSymbol(lib_.handle, &lib_.eciSetVoiceParam, "eciSetVoiceParam");
   LoadSymbol(lib_.handle, &lib_.eciClearErrors, "eciClearErrors");
   LoadSymbol(lib_.handle, &lib_.eciErrorMessage, "eciErrorMessage");
   LoadSymbol(lib_.handle, &lib_.eciProgStatus, "eciProgStatus");
@@ -143,9 +153,9 @@ std::vector<ECILanguageDialect> ECI::GetAvailableLanguages() {
   return languages;
 }
 
-void ECI::AddText(const std::string& text) {
-  Check(lib_.eciAddText(handle_, text.c_str()));
-}
+void ECI::AddText(const std::string& text) { AddText(text.c_str()); }
+
+void ECI::AddText(const char* text) { Check(lib_.eciAddText(handle_, text)); }
 
 void ECI::ClearInput() {
   Check(lib_.eciClearInput(handle_));
@@ -189,6 +199,7 @@ void ECI::SynthesizeFile(const std::string& filename) {
 
 void ECI::SetOutputBuffer(int size, short* buffer) {
   Check(lib_.eciSetOutputBuffer(handle_, size, buffer));
+  output_buffer_ = buffer;
 }
 
 void ECI::SetOutputDevice(int num) {
@@ -215,6 +226,28 @@ int ECI::SetParam(ECIParam parameter, int value) {
   return Check(lib_.eciSetParam(handle_, parameter, value));
 }
 
+void ECI::CopyVoice(int voice_from, int voice_to) {
+  Check(lib_.eciCopyVoice(handle_, voice_from, voice_to));
+}
+
+std::string ECI::GetVoiceName(int voice) {
+  char buffer[ECI_VOICE_NAME_LENGTH + 1] = {};
+  Check(lib_.eciGetVoiceName(handle_, voice, buffer));
+  return buffer;
+}
+
+void ECI::SetVoiceName(int voice, const std::string& name) {
+  Check(lib_.eciSetVoiceName(handle_, voice, name.c_str()));
+}
+
+int ECI::GetVoiceParam(int voice, ECIVoiceParam parameter) {
+  return Check(lib_.eciGetVoiceParam(handle_, voice, parameter));
+}
+
+int ECI::SetVoiceParam(int voice, ECIVoiceParam parameter, int value) {
+  return Check(lib_.eciSetVoiceParam(handle_, voice, parameter, value));
+}
+
 int ECI::ProgStatus() {
   return lib_.eciProgStatus(handle_);
 }
@@ -49,6 +49,7 @@ class ECI {
 
   // Synthesis control.
   void AddText(const std::string& text);
+  void AddText(const char* text);
   void ClearInput();
   void GeneratePhonemes(int size, void* buffer);
   int GetIndex();
@@ -62,6 +63,7 @@ class ECI {
 
   // Output control.
   void SetOutputBuffer(int size, short* buffer);
+  short* output_buffer() const { return output_buffer_; }
   void SetOutputDevice(int num);
   void eciSetOutputFilename(const std::string& filename);
 
@@ -72,8 +74,11 @@ class ECI {
   int SetParam(ECIParam parameter, int value);
 
   // VoiceParameterControl.
-  // TODO: Missing: eciCopyVoice, eciGetVoiceName, eciGetVoiceParam,
-  //       eciSetVoiceName.
+  void CopyVoice(int voice_from, int voice_to);
+  std::string GetVoiceName(int voice);
+  void SetVoiceName(int voice, const std::string& name);
+  int GetVoiceParam(int voice, ECIVoiceParam parameter);
+  int SetVoiceParam(int voice, ECIVoiceParam parameter, int value);
 
   // Dynamic Dictionary Maintenance.
   // TODO: Missing: (everything).
@@ -103,6 +108,7 @@ class ECI {
   static Library lib_;
   const ECIHand handle_;
   std::vector<Callback> callbacks_;
+  short* output_buffer_ = nullptr;
 };
 
 class ECIError : public std::runtime_error {
@@ -0,0 +1,72 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "engine_pool.h"
+
+#include <fstream>
+
+#include <unistd.h>
+
+EnginePool::EnginePool(const std::vector<ECILanguageDialect>& languages,
+                       Setup setup, const Options& options)
+    : setup_(std::move(setup)), options_(options) {
+  engines_.resize(languages.size());
+  for (std::size_t i = 0; i < languages.size(); ++i) {
+    engines_[i].language = languages[i];
+  }
+
+  if (options_.preload) {
+    for (auto& engine : engines_) {
+      Load(&engine);
+    }
+  }
+}
+
+EnginePool::~EnginePool() {}
+
+ECI* EnginePool::Get(std::size_t index) {
+  Engine* engine = &engines_[index];
+  if (engine->eci == nullptr) {
+    Load(engine);
+  }
+  return engine->eci.get();
+}
+
+void EnginePool::Load(Engine* engine) {
+  const auto start_time = std::chrono::steady_clock::now();
+  const std::size_t start_memory = GetResidentMemory();
+
+  std::unique_ptr<ECI> eci(new ECI(engine->language));
+  std::unique_ptr<short[]> buffer(new short[options_.buffer_size]());
+  eci->SetOutputBuffer(options_.buffer_size, buffer.get());
+  setup_(eci.get(), buffer.get());
+
+  const std::size_t end_memory = GetResidentMemory();
+  engine->memory_cost = end_memory > start_memory ? end_memory - start_memory
+                                                  : 0;
+  engine->load_time = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  engine->buffer = std::move(buffer);
+  engine->eci = std::move(eci);
+}
+
+std::size_t EnginePool::GetResidentMemory() {
+  // The second field of /proc/self/statm is the resident set size, in pages.
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size_pages = 0, resident_pages = 0;
+  if (!(statm >> size_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,106 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ENGINE_POOL_H_
+#define ENGINE_POOL_H_
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "eci-c++.h"
+
+// Pool of ECI engine handles, one per available language.
+//
+// Changing eciLanguageDialect on a live handle makes the ECI library reload
+// its language data synchronously, stalling any speech output. Instead, this
+// class keeps one fully initialized handle per language, each one with its
+// own output buffer and callbacks, so switching languages is just a matter of
+// picking another handle. Handles are either created upfront, or lazily the
+// first time their language is requested.
+class EnginePool {
+ public:
+  // Function called once for each new handle to configure it. It receives the
+  // handle and the output buffer allocated for it, whose size in samples is
+  // given by Options::buffer_size. The buffer has already been set as the
+  // output buffer of the handle.
+  using Setup = std::function<void(ECI* eci, short* buffer)>;
+
+  struct Options {
+    Options() noexcept {}
+
+    // Whether to create the handles of all languages at construction time.
+    // Otherwise, each handle is created the first time it is requested.
+    bool preload = false;
+
+    // Size of the output buffer of each handle, in samples.
+    int buffer_size = 0;
+  };
+
+  EnginePool(const std::vector<ECILanguageDialect>& languages, Setup setup,
+             const Options& options = Options());
+  ~EnginePool();
+
+  // Returns the number of languages in the pool.
+  std::size_t size() const { return engines_.size(); }
+
+  // Returns the language of the handle at the given index.
+  ECILanguageDialect language(std::size_t index) const {
+    return engines_[index].language;
+  }
+
+  // Returns whether the handle at the given index was already created.
+  bool loaded(std::size_t index) const {
+    return engines_[index].eci != nullptr;
+  }
+
+  // Returns how much the resident memory of the process grew while creating
+  // and configuring the handle at the given index, in bytes, or zero if the
+  // handle was not created yet.
+  std::size_t memory_cost(std::size_t index) const {
+    return engines_[index].memory_cost;
+  }
+
+  // Returns how long it took to create and configure the handle at the given
+  // index.
+  std::chrono::microseconds load_time(std::size_t index) const {
+    return engines_[index].load_time;
+  }
+
+  // Returns the handle for the language at the given index, creating it if
+  // necessary. The returned pointer stays valid for the lifetime of the pool.
+  ECI* Get(std::size_t index);
+
+ private:
+  struct Engine {
+    ECILanguageDialect language;
+    std::unique_ptr<ECI> eci;
+    std::unique_ptr<short[]> buffer;
+    std::size_t memory_cost = 0;
+    std::chrono::microseconds load_time{0};
+  };
+
+  void Load(Engine* engine);
+
+  // Returns the current resident set size of the process, in bytes.
+  static std::size_t GetResidentMemory();
+
+  const Setup setup_;
+  const Options options_;
+  std::vector<Engine> engines_;
+};
+
+#endif  // ENGINE_POOL_H_
@@ -0,0 +1,218 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "event_loop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+// Maximum number of events returned by one call to epoll_wait().
+const int kMaxEvents = 16;
+
+void CheckError(int result, const char* message) {
+  if (result < 0) {
+    throw std::system_error(errno, std::system_category(), message);
+  }
+}
+
+}  // namespace
+
+// EventLoop
+
+EventLoop::EventLoop() : events_(kMaxEvents) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  CheckError(epoll_fd_, "EventLoop: Failed to create the epoll descriptor");
+}
+
+EventLoop::~EventLoop() {
+  close(epoll_fd_);
+}
+
+void EventLoop::Add(int fd, std::uint32_t events, Handler handler) {
+  std::unique_ptr<Registration> registration(new Registration());
+  registration->fd = fd;
+  registration->events = events;
+  registration->handler = std::move(handler);
+
+  struct epoll_event event = {};
+  event.events = events;
+  event.data.ptr = registration.get();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    if (errno != EPERM) {
+      CheckError(-1, "EventLoop: Failed to watch a descriptor");
+    }
+    registration->always_ready = true;
+    ready_.push_back(registration.get());
+  }
+  registrations_[fd] = std::move(registration);
+}
+
+void EventLoop::Enable(int fd, bool enabled) {
+  auto it = registrations_.find(fd);
+  if (it == registrations_.end() || it->second->enabled == enabled) return;
+  Watch(it->second.get(), enabled);
+  it->second->enabled = enabled;
+}
+
+void EventLoop::Remove(int fd) {
+  auto it = registrations_.find(fd);
+  if (it == registrations_.end()) return;
+  if (it->second->enabled) {
+    Watch(it->second.get(), false);
+    it->second->enabled = false;
+  }
+  removed_.push_back(std::move(it->second));
+  registrations_.erase(it);
+}
+
+void EventLoop::Watch(Registration* registration, bool watch) {
+  if (registration->always_ready) {
+    if (watch) {
+      ready_.push_back(registration);
+    } else {
+      for (auto it = ready_.begin(); it != ready_.end(); ++it) {
+        if (*it == registration) {
+          ready_.erase(it);
+          break;
+        }
+      }
+    }
+    return;
+  }
+
+  // A descriptor that stays registered without events still reports errors
+  // and hangups, so disabling it removes it from the epoll set.
+  struct epoll_event event = {};
+  event.events = registration->events;
+  event.data.ptr = registration;
+  CheckError(epoll_ctl(epoll_fd_, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                       registration->fd, &event),
+             "EventLoop: Failed to change a watched descriptor");
+}
+
+int EventLoop::RunOnce(int timeout_ms) {
+  const int count = epoll_wait(epoll_fd_, events_.data(), events_.size(),
+                               ready_.empty() ? timeout_ms : 0);
+  if (count < 0 && errno != EINTR) {
+    CheckError(count, "EventLoop: Failed to wait for events");
+  }
+
+  int dispatched = 0;
+  for (int i = 0; i < count; ++i) {
+    Registration* registration =
+        static_cast<Registration*>(events_[i].data.ptr);
+    // Handlers called before may have disabled or removed it.
+    if (!registration->enabled) continue;
+    registration->handler(events_[i].events);
+    ++dispatched;
+  }
+
+  if (!ready_.empty()) {
+    const std::vector<Registration*> ready(ready_);
+    for (Registration* registration : ready) {
+      if (!registration->enabled) continue;
+      registration->handler(registration->events);
+      ++dispatched;
+    }
+  }
+
+  removed_.clear();
+  if (dispatched > 0) {
+    ++wakeups_;
+  }
+  return dispatched;
+}
+
+// Timer
+
+Timer::Timer(EventLoop* loop, std::function<void()> callback)
+    : loop_(loop), callback_(std::move(callback)) {
+  fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  CheckError(fd_, "Timer: Failed to create the timer");
+  loop_->Add(fd_, EPOLLIN, [this](std::uint32_t events) {
+    std::uint64_t expirations = 0;
+    // The timer may have been stopped or started again since it expired.
+    if (read(fd_, &expirations, sizeof(expirations)) !=
+        sizeof(expirations)) {
+      return;
+    }
+    if (!periodic_) {
+      armed_ = false;
+    }
+    callback_();
+  });
+}
+
+Timer::~Timer() {
+  loop_->Remove(fd_);
+  close(fd_);
+}
+
+void Timer::Start(std::chrono::nanoseconds delay,
+                  std::chrono::nanoseconds interval) {
+  // A zero delay would disarm the timer.
+  delay = std::max(delay, std::chrono::nanoseconds(1));
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = delay.count() / 1000000000;
+  spec.it_value.tv_nsec = delay.count() % 1000000000;
+  spec.it_interval.tv_sec = interval.count() / 1000000000;
+  spec.it_interval.tv_nsec = interval.count() % 1000000000;
+  CheckError(timerfd_settime(fd_, 0, &spec, nullptr),
+             "Timer: Failed to start the timer");
+  armed_ = true;
+  periodic_ = interval.count() > 0;
+}
+
+void Timer::Stop() {
+  if (!armed_) return;
+  struct itimerspec spec = {};
+  CheckError(timerfd_settime(fd_, 0, &spec, nullptr),
+             "Timer: Failed to stop the timer");
+  armed_ = false;
+  periodic_ = false;
+}
+
+// Notifier
+
+Notifier::Notifier(EventLoop* loop, std::function<void()> callback)
+    : loop_(loop), callback_(std::move(callback)) {
+  fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  CheckError(fd_, "Notifier: Failed to create the eventfd");
+  loop_->Add(fd_, EPOLLIN, [this](std::uint32_t events) {
+    std::uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count)) return;
+    callback_();
+  });
+}
+
+Notifier::~Notifier() {
+  loop_->Remove(fd_);
+  close(fd_);
+}
+
+void Notifier::Notify() {
+  const std::uint64_t one = 1;
+  // The counter only overflows if the loop never reads it, in which case it
+  // is ready anyway.
+  ssize_t result = write(fd_, &one, sizeof(one));
+  (void)result;
+}
@@ -0,0 +1,142 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+
+// Event loop of the server, built on epoll.
+//
+// Descriptors are registered once, with the handler to call when they get
+// events, instead of being collected and polled again on every iteration, so
+// waiting costs one system call however many descriptors are watched. A
+// descriptor that is only interesting at times, e.g. the sound device while
+// there is audio to play, is disabled in between, so an idle server makes no
+// wakeups at all. Descriptors that epoll cannot watch, e.g. regular files,
+// are always ready, as they are for poll().
+class EventLoop {
+ public:
+  // Handler of the events of a descriptor, as epoll events.
+  using Handler = std::function<void(std::uint32_t events)>;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Registers the descriptor, to call the handler with the given events,
+  // e.g. EPOLLIN. The descriptor is watched until Remove() is called, unless
+  // it is disabled. Throws std::system_error on failure.
+  void Add(int fd, std::uint32_t events, Handler handler);
+
+  // Starts or stops watching a registered descriptor, keeping its handler.
+  // A disabled descriptor reports nothing, not even errors or hangups, which
+  // epoll would otherwise report even without asking for any event.
+  void Enable(int fd, bool enabled);
+
+  // Unregisters the descriptor. May be called from a handler.
+  void Remove(int fd);
+
+  // Waits for events for at most timeout_ms milliseconds, or indefinitely if
+  // it is negative, and calls the handlers of the descriptors that got them.
+  // Returns the number of handlers called.
+  int RunOnce(int timeout_ms = -1);
+
+  // Returns the number of times that RunOnce() called any handler.
+  std::uint64_t wakeups() const { return wakeups_; }
+
+ private:
+  struct Registration {
+    int fd;
+    std::uint32_t events;
+    Handler handler;
+    bool enabled = true;
+    // Whether the descriptor cannot be watched by epoll, and is always ready.
+    bool always_ready = false;
+  };
+
+  void Watch(Registration* registration, bool watch);
+
+  int epoll_fd_ = -1;
+  std::unordered_map<int, std::unique_ptr<Registration>> registrations_;
+
+  // Registrations removed while dispatching events, which may still be
+  // referenced by the events being dispatched.
+  std::vector<std::unique_ptr<Registration>> removed_;
+
+  // Registrations that are always ready, and enabled.
+  std::vector<Registration*> ready_;
+
+  std::vector<struct epoll_event> events_;
+  std::uint64_t wakeups_ = 0;
+};
+
+// Timer that calls a function from an event loop, using a timerfd.
+class Timer {
+ public:
+  Timer(EventLoop* loop, std::function<void()> callback);
+  ~Timer();
+
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+
+  // Calls the function once after the given delay, and then every interval,
+  // if it is not zero. Replaces the previous schedule of the timer.
+  void Start(std::chrono::nanoseconds delay,
+             std::chrono::nanoseconds interval = std::chrono::nanoseconds(0));
+
+  // Cancels the timer.
+  void Stop();
+
+  // Returns whether the timer is scheduled to fire.
+  bool armed() const { return armed_; }
+
+ private:
+  EventLoop* loop_;
+  std::function<void()> callback_;
+  int fd_ = -1;
+  bool armed_ = false;
+  bool periodic_ = false;
+};
+
+// Wakes up an event loop from another thread, to call a function from it,
+// using an eventfd. Several notifications before the loop wakes up call the
+// function once.
+class Notifier {
+ public:
+  Notifier(EventLoop* loop, std::function<void()> callback);
+  ~Notifier();
+
+  Notifier(const Notifier&) = delete;
+  Notifier& operator=(const Notifier&) = delete;
+
+  // Wakes up the loop. May be called from any thread.
+  void Notify();
+
+ private:
+  EventLoop* loop_;
+  std::function<void()> callback_;
+  int fd_ = -1;
+};
+
+#endif  // EVENT_LOOP_H_
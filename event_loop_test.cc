@@ -0,0 +1,172 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "event_loop.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+double Milliseconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  // Descriptors are dispatched when ready, and not at all while disabled.
+  {
+    EventLoop loop;
+    int fds[2];
+    if (pipe(fds) != 0) return EXIT_FAILURE;
+    std::uint32_t received = 0;
+    loop.Add(fds[0], EPOLLIN, [&](std::uint32_t events) {
+      received = events;
+      char c;
+      if (read(fds[0], &c, 1) != 1) received = 0;
+    });
+
+    int dispatched = loop.RunOnce(0);
+    Check("Nothing ready", dispatched == 0, dispatched);
+    if (write(fds[1], "x", 1) != 1) return EXIT_FAILURE;
+    dispatched = loop.RunOnce(100);
+    Check("Ready", dispatched == 1 && (received & EPOLLIN), dispatched);
+
+    loop.Enable(fds[0], false);
+    if (write(fds[1], "x", 1) != 1) return EXIT_FAILURE;
+    dispatched = loop.RunOnce(20);
+    Check("Disabled", dispatched == 0, dispatched);
+    close(fds[1]);
+    dispatched = loop.RunOnce(20);
+    Check("Disabled hangup", dispatched == 0, dispatched);
+    loop.Enable(fds[0], true);
+    dispatched = loop.RunOnce(100);
+    Check("Enabled", dispatched == 1, dispatched);
+
+    loop.Remove(fds[0]);
+    close(fds[0]);
+    Check("Wakeups", loop.wakeups() == 2, loop.wakeups());
+  }
+
+  // A handler may remove a descriptor whose event is already pending.
+  {
+    EventLoop loop;
+    int first[2];
+    int second[2];
+    if (pipe(first) != 0 || pipe(second) != 0) return EXIT_FAILURE;
+    int calls = 0;
+    loop.Add(first[0], EPOLLIN, [&](std::uint32_t events) {
+      ++calls;
+      loop.Remove(second[0]);
+      loop.Remove(first[0]);
+    });
+    loop.Add(second[0], EPOLLIN, [&](std::uint32_t events) {
+      ++calls;
+      loop.Remove(second[0]);
+      loop.Remove(first[0]);
+    });
+    if (write(first[1], "x", 1) != 1 || write(second[1], "x", 1) != 1) {
+      return EXIT_FAILURE;
+    }
+    loop.RunOnce(100);
+    Check("Removed while dispatching", calls == 1, calls);
+    const int dispatched = loop.RunOnce(20);
+    Check("Removed", dispatched == 0, dispatched);
+    for (int fd : {first[0], first[1], second[0], second[1]}) close(fd);
+  }
+
+  // Regular files cannot be watched by epoll, and are always ready.
+  {
+    EventLoop loop;
+    const int fd = open("/proc/self/exe", O_RDONLY);
+    int calls = 0;
+    loop.Add(fd, EPOLLIN, [&](std::uint32_t events) { ++calls; });
+    int dispatched = loop.RunOnce(1000);
+    Check("Regular file ready", dispatched == 1 && calls == 1, dispatched);
+    loop.Enable(fd, false);
+    dispatched = loop.RunOnce(20);
+    Check("Regular file disabled", dispatched == 0, dispatched);
+    loop.Remove(fd);
+    close(fd);
+  }
+
+  // Timers fire once or periodically, and not after being stopped.
+  {
+    EventLoop loop;
+    int calls = 0;
+    Timer timer(&loop, [&]() { ++calls; });
+
+    auto start = std::chrono::steady_clock::now();
+    timer.Start(std::chrono::milliseconds(20));
+    loop.RunOnce();
+    const double elapsed = Milliseconds(start);
+    Check("One shot", calls == 1 && !timer.armed() && elapsed >= 19 &&
+                          elapsed < 40,
+          elapsed);
+
+    timer.Start(std::chrono::milliseconds(10));
+    timer.Stop();
+    const int dispatched = loop.RunOnce(30);
+    Check("Stopped", dispatched == 0 && calls == 1, dispatched);
+
+    start = std::chrono::steady_clock::now();
+    timer.Start(std::chrono::milliseconds(10), std::chrono::milliseconds(10));
+    while (calls < 6) loop.RunOnce();
+    const double periodic = Milliseconds(start);
+    timer.Stop();
+    Check("Periodic", !timer.armed() && periodic >= 49 && periodic < 80,
+          periodic);
+  }
+
+  // Notifications from another thread wake up the loop, and coalesce.
+  {
+    EventLoop loop;
+    int calls = 0;
+    Notifier notifier(&loop, [&]() { ++calls; });
+    std::thread thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      notifier.Notify();
+      notifier.Notify();
+    });
+    const auto start = std::chrono::steady_clock::now();
+    while (calls == 0) loop.RunOnce();
+    const double elapsed = Milliseconds(start);
+    thread.join();
+    loop.RunOnce(0);
+    Check("Notified", calls == 1 && elapsed >= 19, elapsed);
+  }
+
+  if (!good) {
+    std::cout << "Some test failed.\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,568 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Deterministic fake of the IBM ViaVoice TTS ECI library.
+//
+// This library implements the ECI entry points loaded by ECI::Init(), so the
+// whole speech server pipeline can be exercised and benchmarked on machines
+// without a licensed ViaVoice installation, e.g. with:
+//
+//   speech_server --eci-library ./libfake_eci.so --render-to out.wav
+//
+// Instead of speech, each character of the input text is rendered as a short
+// tone whose frequency depends on the character, so the output is always the
+// same for the same input, and its length scales with the length of the text
+// and with the speed of the active voice. Spaces and `p<ms> annotations
+// produce silence, and the `v<n> and `vs<n> annotations are honored. Output is
+// delivered through the eciWaveformBuffer callback into the buffer given to
+// eciSetOutputBuffer(), one buffer per call to eciSpeaking(), honoring the
+// eciDataNotProcessed and eciDataAbort callback results, and index marks are
+// reported through eciIndexReply when synthesis reaches them. eciSynchronize()
+// gives up and returns false if the callback keeps refusing the output.
+//
+// The cost of the fake engine is configured through environment variables,
+// read when each engine is created:
+//
+//   FAKE_ECI_CHAR_COST_US  CPU time spent synthesizing each character, in
+//                          microseconds (default 0).
+//   FAKE_ECI_LOAD_MS       CPU time spent loading a language, either when
+//                          creating an engine or when changing the
+//                          eciLanguageDialect parameter, in milliseconds
+//                          (default 0).
+
+#include "eci.h"
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Voice slots: the active voice, the presets and the user-defined voices.
+const int kNumVoices = 1 + ECI_PRESET_VOICES + ECI_USER_DEFINED_VOICES;
+
+// Duration of each character at the default speed (50), in milliseconds.
+const int kCharDurationMs = 60;
+
+// Amplitude of the generated tones.
+const double kAmplitude = 0.25 * 32767;
+
+// Number of times eciSynchronize() retries output that cannot be delivered,
+// and the time it waits before each retry.
+const int kMaxSynchronizeRetries = 100;
+const std::chrono::milliseconds kSynchronizeRetryDelay(1);
+
+const ECILanguageDialect kLanguages[] = {
+    eciGeneralAmericanEnglish, eciBritishEnglish, eciCastilianSpanish,
+    eciStandardFrench, eciStandardGerman,
+};
+
+// Built-in voices, indexed by ECIVoiceParam.
+const int kPresetVoices[ECI_PRESET_VOICES][eciNumVoiceParams] = {
+    // gender, head size, pitch baseline, pitch fluctuation, roughness,
+    // breathiness, speed, volume
+    {0, 50, 65, 30, 0, 0, 50, 92},   // Adult Male.
+    {1, 50, 81, 30, 0, 50, 50, 95},  // Adult Female.
+    {1, 22, 93, 35, 0, 0, 50, 95},   // Child.
+    {0, 86, 56, 47, 0, 0, 50, 93},   // Adult Male 2.
+    {0, 50, 69, 34, 0, 0, 70, 92},   // Adult Male 3.
+    {1, 56, 89, 35, 0, 40, 70, 95},  // Adult Female 2.
+    {1, 45, 68, 30, 3, 40, 50, 90},  // Elderly Female.
+    {0, 30, 61, 44, 18, 20, 50, 90},  // Elderly Male.
+};
+
+const char* const kPresetVoiceNames[ECI_PRESET_VOICES] = {
+    "Adult Male 1", "Adult Female 1", "Child 1",        "Adult Male 2",
+    "Adult Male 3", "Adult Female 2", "Elderly Female 1", "Elderly Male 1",
+};
+
+int g_default_params[eciNumParams] = {
+    0,  // eciSynthMode
+    0,  // eciInputType
+    0,  // eciTextMode
+    0,  // eciDictionary
+    0,  // (unused)
+    1,  // eciSampleRate
+    0,  // (unused)
+    0,  // eciWantPhonemeIndices
+    0,  // eciRealWorldUnits
+    eciGeneralAmericanEnglish,  // eciLanguageDialect
+    0,  // eciNumberMode
+    0,  // (unused)
+    0,  // eciWantWordIndex
+    0,  // eciNumDeviceBlocks
+    0,  // eciSizeDeviceBlocks
+    0,  // eciNumPrerollDeviceBlocks
+    0,  // eciSizePrerollDeviceBlocks
+};
+
+// A unit of synthesis output.
+struct Item {
+  enum Kind { AUDIO, INDEX };
+  Kind kind;
+
+  // For AUDIO, the character rendered (zero for silence); for INDEX, the
+  // index value.
+  int value;
+
+  // For AUDIO, the duration in milliseconds at the default speed.
+  int duration_ms;
+
+  // For AUDIO, the speed of the voice when the text was added.
+  int speed;
+};
+
+struct Engine {
+  ECILanguageDialect language;
+  int params[eciNumParams];
+  int voices[kNumVoices][eciNumVoiceParams];
+  char voice_names[kNumVoices][ECI_VOICE_NAME_LENGTH + 1];
+
+  ECICallback callback = nullptr;
+  void* callback_data = nullptr;
+
+  short* buffer = nullptr;
+  int buffer_size = 0;
+
+  // Items added since the last call to eciSynthesize().
+  std::vector<Item> input;
+
+  // Items being synthesized.
+  std::deque<Item> output;
+
+  // Position, in samples, inside the AUDIO item at the front of output.
+  int position = 0;
+
+  // Number of samples in the buffer that the callback did not process yet.
+  int unprocessed = 0;
+
+  bool paused = false;
+
+  // Last index mark reached.
+  int last_index = 0;
+
+  double char_cost_us = 0;
+  double load_ms = 0;
+};
+
+double GetEnv(const char* name) {
+  const char* value = std::getenv(name);
+  return value != nullptr ? std::atof(value) : 0;
+}
+
+// Keeps the CPU busy for the given time, simulating synthesis work.
+void Spin(double microseconds) {
+  if (microseconds <= 0) return;
+  const auto until = std::chrono::steady_clock::now() +
+                     std::chrono::duration<double, std::micro>(microseconds);
+  while (std::chrono::steady_clock::now() < until) {
+  }
+}
+
+bool IsAvailable(int language) {
+  for (ECILanguageDialect available : kLanguages) {
+    if (available == language) return true;
+  }
+  return false;
+}
+
+int GetSampleRate(const Engine* engine) {
+  switch (engine->params[eciSampleRate]) {
+    case 0:
+      return 8000;
+    case 2:
+      return 22050;
+    default:
+      return 11025;
+  }
+}
+
+// Returns the number of samples of the given AUDIO item.
+int GetSamples(const Engine* engine, const Item& item) {
+  const int speed = item.speed > 0 ? item.speed : 1;
+  return static_cast<long>(item.duration_ms) * GetSampleRate(engine) * 50 /
+         (speed * 1000);
+}
+
+// Applies an annotation (without the leading backquote) to the engine,
+// appending any resulting items.
+void Annotate(Engine* engine, const std::string& annotation) {
+  int* voice = engine->voices[0];
+  if (annotation.size() > 1 && annotation[0] == 'p') {
+    engine->input.push_back(
+        {Item::AUDIO, 0, std::atoi(annotation.c_str() + 1), 50});
+  } else if (annotation.compare(0, 2, "vs") == 0) {
+    voice[eciSpeed] = std::atoi(annotation.c_str() + 2);
+  } else if (annotation.compare(0, 2, "vb") == 0) {
+    voice[eciPitchBaseline] = std::atoi(annotation.c_str() + 2);
+  } else if (annotation.compare(0, 2, "vh") == 0) {
+    voice[eciHeadSize] = std::atoi(annotation.c_str() + 2);
+  } else if (annotation.size() > 1 && annotation[0] == 'v' &&
+             std::isdigit(annotation[1])) {
+    const int preset = std::atoi(annotation.c_str() + 1);
+    if (preset >= 1 && preset <= ECI_PRESET_VOICES) {
+      std::memcpy(voice, engine->voices[preset], sizeof(engine->voices[0]));
+    }
+  }
+}
+
+// Converts text into items, interpreting annotations.
+void AddText(Engine* engine, const char* text) {
+  for (const char* p = text; *p != '\0';) {
+    if (*p == '`') {
+      const char* end = p + 1;
+      while (*end != '\0' && !std::isspace(*end)) ++end;
+      Annotate(engine, std::string(p + 1, end));
+      p = end;
+    } else {
+      const int c = static_cast<unsigned char>(*p++);
+      engine->input.push_back({Item::AUDIO, std::isspace(c) ? 0 : c,
+                               kCharDurationMs,
+                               engine->voices[0][eciSpeed]});
+    }
+  }
+}
+
+// Produces the next output buffer and delivers it through the callback.
+// Returns whether there is more output pending.
+bool Step(Engine* engine) {
+  if (engine->paused) {
+    return !engine->output.empty() || engine->unprocessed > 0;
+  }
+
+  auto notify = [engine](ECIMessage message, long lparam) {
+    if (engine->callback == nullptr) return eciDataProcessed;
+    return engine->callback(engine, message, lparam, engine->callback_data);
+  };
+
+  // If the callback did not process the last buffer, deliver it again.
+  if (engine->unprocessed == 0) {
+    // Report any index marks reached.
+    while (!engine->output.empty() &&
+           engine->output.front().kind == Item::INDEX) {
+      const int index = engine->output.front().value;
+      engine->output.pop_front();
+      engine->last_index = index;
+      if (notify(eciIndexReply, index) == eciDataAbort) {
+        engine->output.clear();
+        engine->position = 0;
+        return false;
+      }
+    }
+
+    // Render audio up to the next index mark, or until the buffer is full.
+    const int rate = GetSampleRate(engine);
+    int count = 0;
+    while (count < engine->buffer_size && !engine->output.empty() &&
+           engine->output.front().kind == Item::AUDIO) {
+      const Item& item = engine->output.front();
+      const int samples = GetSamples(engine, item);
+      if (engine->position == 0 && item.value != 0) {
+        Spin(engine->char_cost_us);
+      }
+      const double frequency = 150 + (item.value % 40) * 15;
+      while (count < engine->buffer_size && engine->position < samples) {
+        const double t = static_cast<double>(engine->position++) / rate;
+        engine->buffer[count++] =
+            item.value == 0
+                ? 0
+                : static_cast<short>(kAmplitude *
+                                     std::sin(2 * M_PI * frequency * t));
+      }
+      if (engine->position >= samples) {
+        engine->output.pop_front();
+        engine->position = 0;
+      }
+    }
+    engine->unprocessed = count;
+  }
+
+  if (engine->unprocessed > 0) {
+    switch (notify(eciWaveformBuffer, engine->unprocessed)) {
+      case eciDataNotProcessed:
+        return true;
+      case eciDataAbort:
+        engine->output.clear();
+        engine->position = 0;
+        engine->unprocessed = 0;
+        return false;
+      default:
+        engine->unprocessed = 0;
+        break;
+    }
+  }
+
+  return !engine->output.empty();
+}
+
+Engine* Get(ECIHand handle) { return static_cast<Engine*>(handle); }
+
+}  // namespace
+
+extern "C" {
+
+ECIHand eciNewEx(enum ECILanguageDialect language) {
+  if (!IsAvailable(language)) return NULL_ECI_HAND;
+
+  Engine* engine = new Engine();
+  engine->language = language;
+  std::memcpy(engine->params, g_default_params, sizeof(engine->params));
+  engine->params[eciLanguageDialect] = language;
+  for (int i = 0; i < ECI_PRESET_VOICES; ++i) {
+    std::memcpy(engine->voices[i + 1], kPresetVoices[i],
+                sizeof(kPresetVoices[i]));
+    std::strncpy(engine->voice_names[i + 1], kPresetVoiceNames[i],
+                 ECI_VOICE_NAME_LENGTH);
+  }
+  std::memcpy(engine->voices[0], engine->voices[1], sizeof(engine->voices[0]));
+  std::strncpy(engine->voice_names[0], kPresetVoiceNames[0],
+               ECI_VOICE_NAME_LENGTH);
+
+  engine->char_cost_us = GetEnv("FAKE_ECI_CHAR_COST_US");
+  engine->load_ms = GetEnv("FAKE_ECI_LOAD_MS");
+  Spin(engine->load_ms * 1000);
+  return engine;
+}
+
+ECIHand eciNew(void) {
+  return eciNewEx(static_cast<ECILanguageDialect>(
+      g_default_params[eciLanguageDialect]));
+}
+
+int eciGetAvailableLanguages(enum ECILanguageDialect* languages,
+                             int* num_languages) {
+  const int count = sizeof(kLanguages) / sizeof(kLanguages[0]);
+  if (languages != nullptr) {
+    const int n = *num_languages < count ? *num_languages : count;
+    std::memcpy(languages, kLanguages, n * sizeof(kLanguages[0]));
+    *num_languages = n;
+  } else {
+    *num_languages = count;
+  }
+  return 0;
+}
+
+ECIHand eciDelete(ECIHand handle) {
+  delete Get(handle);
+  return NULL_ECI_HAND;
+}
+
+Boolean eciReset(ECIHand handle) {
+  Engine* engine = Get(handle);
+  engine->input.clear();
+  engine->output.clear();
+  engine->position = 0;
+  engine->unprocessed = 0;
+  engine->paused = false;
+  return ECITrue;
+}
+
+Boolean eciIsBeingReentered(ECIHand handle) { return ECIFalse; }
+
+void eciVersion(char* buffer) { std::strcpy(buffer, "6.7.4 (fake)"); }
+
+int eciProgStatus(ECIHand handle) { return ECI_NOERROR; }
+
+void eciErrorMessage(ECIHand handle, void* buffer) {
+  std::strcpy(static_cast<char*>(buffer), "No error.");
+}
+
+void eciClearErrors(ECIHand handle) {}
+
+Boolean eciTestPhrase(ECIHand handle) { return ECITrue; }
+
+Boolean eciSpeakText(ECIInputText text, Boolean annotations) {
+  return ECITrue;
+}
+
+Boolean eciSpeakTextEx(ECIInputText text, Boolean annotations,
+                       enum ECILanguageDialect language) {
+  return ECITrue;
+}
+
+int eciGetParam(ECIHand handle, enum ECIParam parameter) {
+  if (parameter < 0 || parameter >= eciNumParams) return -1;
+  return Get(handle)->params[parameter];
+}
+
+int eciSetParam(ECIHand handle, enum ECIParam parameter, int value) {
+  if (parameter < 0 || parameter >= eciNumParams) return -1;
+  Engine* engine = Get(handle);
+  if (parameter == eciLanguageDialect) {
+    if (!IsAvailable(value)) return -1;
+    // Reloading the language data is what makes this call expensive on the
+    // real library.
+    Spin(engine->load_ms * 1000);
+    engine->language = static_cast<ECILanguageDialect>(value);
+  }
+  const int previous = engine->params[parameter];
+  engine->params[parameter] = value;
+  return previous;
+}
+
+int eciGetDefaultParam(enum ECIParam parameter) {
+  if (parameter < 0 || parameter >= eciNumParams) return -1;
+  return g_default_params[parameter];
+}
+
+int eciSetDefaultParam(enum ECIParam parameter, int value) {
+  if (parameter < 0 || parameter >= eciNumParams) return -1;
+  const int previous = g_default_params[parameter];
+  g_default_params[parameter] = value;
+  return previous;
+}
+
+Boolean eciCopyVoice(ECIHand handle, int voice_from, int voice_to) {
+  if (voice_from < 0 || voice_from >= kNumVoices || voice_to < 0 ||
+      voice_to >= kNumVoices) {
+    return ECIFalse;
+  }
+  Engine* engine = Get(handle);
+  std::memcpy(engine->voices[voice_to], engine->voices[voice_from],
+              sizeof(engine->voices[0]));
+  std::memcpy(engine->voice_names[voice_to], engine->voice_names[voice_from],
+              sizeof(engine->voice_names[0]));
+  return ECITrue;
+}
+
+Boolean eciGetVoiceName(ECIHand handle, int voice, void* buffer) {
+  if (voice < 0 || voice >= kNumVoices) return ECIFalse;
+  std::strcpy(static_cast<char*>(buffer), Get(handle)->voice_names[voice]);
+  return ECITrue;
+}
+
+Boolean eciSetVoiceName(ECIHand handle, int voice, const void* buffer) {
+  if (voice < 0 || voice >= kNumVoices) return ECIFalse;
+  std::strncpy(Get(handle)->voice_names[voice],
+               static_cast<const char*>(buffer), ECI_VOICE_NAME_LENGTH);
+  return ECITrue;
+}
+
+int eciGetVoiceParam(ECIHand handle, int voice,
+                     enum ECIVoiceParam parameter) {
+  if (voice < 0 || voice >= kNumVoices || parameter < 0 ||
+      parameter >= eciNumVoiceParams) {
+    return -1;
+  }
+  return Get(handle)->voices[voice][parameter];
+}
+
+int eciSetVoiceParam(ECIHand handle, int voice, enum ECIVoiceParam parameter,
+                     int value) {
+  if (voice < 0 || voice >= kNumVoices || parameter < 0 ||
+      parameter >= eciNumVoiceParams) {
+    return -1;
+  }
+  int* voice_params = Get(handle)->voices[voice];
+  const int previous = voice_params[parameter];
+  voice_params[parameter] = value;
+  return previous;
+}
+
+Boolean eciAddText(ECIHand handle, ECIInputText text) {
+  AddText(Get(handle), static_cast<const char*>(text));
+  return ECITrue;
+}
+
+Boolean eciInsertIndex(ECIHand handle, int index) {
+  Get(handle)->input.push_back({Item::INDEX, index, 0, 0});
+  return ECITrue;
+}
+
+Boolean eciSynthesize(ECIHand handle) {
+  Engine* engine = Get(handle);
+  engine->output.insert(engine->output.end(), engine->input.begin(),
+                        engine->input.end());
+  engine->input.clear();
+  return ECITrue;
+}
+
+Boolean eciSynthesizeFile(ECIHand handle, const void* filename) {
+  return ECIFalse;
+}
+
+Boolean eciClearInput(ECIHand handle) {
+  Get(handle)->input.clear();
+  return ECITrue;
+}
+
+Boolean eciGeneratePhonemes(ECIHand handle, int size, void* buffer) {
+  return ECIFalse;
+}
+
+int eciGetIndex(ECIHand handle) { return Get(handle)->last_index; }
+
+Boolean eciStop(ECIHand handle) {
+  Engine* engine = Get(handle);
+  engine->input.clear();
+  engine->output.clear();
+  engine->position = 0;
+  engine->unprocessed = 0;
+  engine->paused = false;
+  return ECITrue;
+}
+
+Boolean eciSpeaking(ECIHand handle) { return Step(Get(handle)); }
+
+Boolean eciSynchronize(ECIHand handle) {
+  Engine* engine = Get(handle);
+  engine->paused = false;
+
+  // Output that cannot be delivered, because the callback does not process
+  // it or there is no output buffer, is retried for a while, and then left
+  // pending for eciSpeaking() rather than waited for forever.
+  int retries = 0;
+  while (Step(engine)) {
+    if (engine->unprocessed == 0 && engine->buffer_size > 0) {
+      retries = 0;
+    } else if (++retries > kMaxSynchronizeRetries) {
+      return ECIFalse;
+    } else {
+      std::this_thread::sleep_for(kSynchronizeRetryDelay);
+    }
+  }
+  return ECITrue;
+}
+
+Boolean eciSetOutputBuffer(ECIHand handle, int size, short* buffer) {
+  Engine* engine = Get(handle);
+  engine->buffer_size = buffer != nullptr ? size : 0;
+  engine->buffer = buffer;
+  return ECITrue;
+}
+
+Boolean eciSetOutputFilename(ECIHand handle, const void* filename) {
+  return ECIFalse;
+}
+
+Boolean eciSetOutputDevice(ECIHand handle, int device) { return ECITrue; }
+
+Boolean eciPause(ECIHand handle, Boolean on) {
+  Get(handle)->paused = on;
+  return ECITrue;
+}
+
+void eciRegisterCallback(ECIHand handle, ECICallback callback, void* data) {
+  Engine* engine = Get(handle);
+  engine->callback = callback;
+  engine->callback_data = data;
+}
+
+}  // extern "C"
@@ -0,0 +1,147 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "file_sink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+// Number of frames produced at once. A large period means fewer callbacks
+// from the speech engine per second of audio.
+const std::size_t kPeriodSize = 4096;
+
+// WAV format tags.
+const std::uint16_t kWavFormatPcm = 1;
+const std::uint16_t kWavFormatFloat = 3;
+
+// Size of the canonical WAV header, in bytes.
+const std::size_t kWavHeaderSize = 44;
+
+bool HasWavExtension(const std::string& file_path) {
+  if (file_path.size() < 4) return false;
+  std::string extension = file_path.substr(file_path.size() - 4);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) { return std::tolower(c); });
+  return extension == ".wav";
+}
+
+// Appends a little-endian integer of the given size to the string.
+void PutLE(std::string* out, std::uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+}  // namespace
+
+FileSink::FileSink(const std::string& file_path,
+                   snd_pcm_format_t sample_format, unsigned int sample_rate,
+                   unsigned int channels)
+    : AudioSink(sample_format, sample_rate, channels),
+      file_(file_path, std::ios::binary | std::ios::trunc),
+      wav_(HasWavExtension(file_path)) {
+  SetBufferSize(kPeriodSize, kPeriodSize);
+  if (!file_) {
+    throw std::system_error(errno, std::system_category(),
+                            "FileSink: Failed to open " + file_path);
+  }
+  fd_ = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "FileSink: Failed to create the eventfd");
+  }
+  if (wav_) {
+    WriteWavHeader();
+  }
+}
+
+FileSink::~FileSink() {
+  Drain();
+  close(fd_);
+}
+
+std::chrono::duration<double> FileSink::duration() const {
+  return std::chrono::duration<double>(static_cast<double>(frames_written_) /
+                                       sample_rate());
+}
+
+std::vector<struct pollfd> FileSink::GetPollDescriptors() const {
+  struct pollfd fd = {};
+  fd.fd = fd_;
+  fd.events = POLLIN;
+  return {fd};
+}
+
+int FileSink::GetPollEvents(struct pollfd* fds, int nfds) const {
+  return POLLOUT;
+}
+
+std::size_t FileSink::Write(const char* data, std::size_t count) {
+  if (count == 0) return 0;
+
+  file_.write(data, count * frame_size());
+  if (!file_) {
+    throw std::system_error(errno, std::system_category(),
+                            "FileSink: Failed to write audio");
+  }
+  frames_written_ += count;
+  return count;
+}
+
+void FileSink::Drain() {
+  if (wav_) {
+    WriteWavHeader();
+  }
+  file_.flush();
+}
+
+void FileSink::WriteWavHeader() {
+  const std::uint32_t bits = snd_pcm_format_physical_width(sample_format());
+  const std::uint32_t data_size = frames_written_ * frame_size();
+
+  std::string header;
+  header.reserve(kWavHeaderSize);
+  header.append("RIFF");
+  PutLE(&header, kWavHeaderSize - 8 + data_size, 4);
+  header.append("WAVE");
+  header.append("fmt ");
+  PutLE(&header, 16, 4);
+  PutLE(&header,
+        snd_pcm_format_float(sample_format()) ? kWavFormatFloat
+                                              : kWavFormatPcm,
+        2);
+  PutLE(&header, channels(), 2);
+  PutLE(&header, sample_rate(), 4);
+  PutLE(&header, sample_rate() * frame_size(), 4);
+  PutLE(&header, frame_size(), 2);
+  PutLE(&header, bits, 2);
+  header.append("data");
+  PutLE(&header, data_size, 4);
+
+  // Rewrite the header at the start of the file, keeping the write position.
+  const std::streampos position = file_.tellp();
+  file_.seekp(0);
+  file_.write(header.data(), header.size());
+  if (position > static_cast<std::streampos>(kWavHeaderSize)) {
+    file_.seekp(position);
+  }
+}
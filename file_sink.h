@@ -0,0 +1,67 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FILE_SINK_H_
+#define FILE_SINK_H_
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "audio_sink.h"
+
+// Audio sink that renders to a file.
+//
+// This sink does not open any sound device. Instead, it writes all audio to
+// a file as soon as it is produced, so the speech server renders its input as
+// fast as the CPU allows. If the file name ends in ".wav", the audio is
+// written in WAV format, otherwise raw samples are written.
+class FileSink : public AudioSink {
+ public:
+  FileSink(const std::string& file_path, snd_pcm_format_t sample_format,
+           unsigned int sample_rate, unsigned int channels);
+  ~FileSink() override;
+
+  // Returns the duration of the audio written so far.
+  std::chrono::duration<double> duration() const;
+
+  // AudioSink overrides.
+  bool offline() const override { return true; }
+  bool running() const override { return false; }
+  void Reconfigure(std::chrono::microseconds buffer_time) override {}
+  std::vector<struct pollfd> GetPollDescriptors() const override;
+  int GetPollEvents(struct pollfd* fds, int nfds) const override;
+  void Drain() override;
+  bool Pause() override { return true; }
+  void Resume() override {}
+  snd_pcm_sframes_t GetDelay() const override { return 0; }
+  void Idle() override {}
+  void Interrupt() override {}
+
+ protected:
+  std::size_t Write(const char* data, std::size_t count) override;
+
+ private:
+  // Writes or updates the WAV header, for the frames written so far.
+  void WriteWavHeader();
+
+  std::ofstream file_;
+  const bool wav_;
+
+  // Descriptor that is always ready, since the file always takes more audio.
+  int fd_ = -1;
+  std::size_t frames_written_ = 0;
+};
+
+#endif  // FILE_SINK_H_
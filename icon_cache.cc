@@ -0,0 +1,200 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "icon_cache.h"
+
+#include <cerrno>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <system_error>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "resampler.h"
+
+using std::string;
+
+namespace {
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const string& file_path) {
+    const int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "IconCache: Failed to open " + file_path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      size_ = info.st_size;
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const char*>(data);
+      }
+    }
+    const int error = errno;
+    close(fd);
+    if (data_ == nullptr) {
+      throw std::system_error(error, std::system_category(),
+                              "IconCache: Failed to map " + file_path);
+    }
+  }
+
+  ~MappedFile() { munmap(const_cast<char*>(data_), size_); }
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// Returns the canonical form of the path, so the same file is cached once.
+string CanonicalPath(const string& file_path) {
+  char buffer[PATH_MAX];
+  if (realpath(file_path.c_str(), buffer) == nullptr) {
+    return file_path;
+  }
+  return buffer;
+}
+
+// Converts the clip to the given number of channels. Mono output mixes all
+// channels. Otherwise, each output channel takes the matching input channel,
+// or the last one.
+std::vector<float> MapChannels(const AudioClip& clip, unsigned int channels) {
+  const std::size_t frames = clip.frames();
+  std::vector<float> out(frames * channels);
+  for (std::size_t i = 0; i < frames; ++i) {
+    const float* in = &clip.samples[i * clip.channels];
+    for (unsigned int c = 0; c < channels; ++c) {
+      const unsigned int first =
+          channels == 1 ? 0 : std::min(c, clip.channels - 1);
+      const unsigned int last = channels == 1 ? clip.channels : first + 1;
+      float sum = 0;
+      for (unsigned int k = first; k < last; ++k) {
+        sum += in[k];
+      }
+      out[i * channels + c] = sum / (last - first);
+    }
+  }
+  return out;
+}
+
+// Resamples the interleaved samples to the given sample rate, compensating
+// the delay of the filter so the icon starts and ends as the original.
+std::vector<float> Resample(const std::vector<float>& samples,
+                            unsigned int channels, unsigned int input_rate,
+                            unsigned int output_rate) {
+  Resampler resampler(input_rate, output_rate, channels, Resampler::HIGH);
+  const std::size_t frames = samples.size() / channels;
+  const std::size_t delay = resampler.delay();
+
+  std::vector<float> in(samples);
+  in.resize((frames + delay) * channels, 0.0f);
+  std::vector<float> out(resampler.MaxOutputFrames(frames + delay) *
+                         channels);
+  const std::size_t written =
+      resampler.Process(in.data(), frames + delay, out.data());
+
+  const std::size_t skip = static_cast<std::uint64_t>(delay) * output_rate /
+                           input_rate;
+  const std::size_t length =
+      std::min<std::size_t>(written - std::min(skip, written),
+                            static_cast<std::uint64_t>(frames) * output_rate /
+                                input_rate);
+  return std::vector<float>(out.begin() + skip * channels,
+                            out.begin() + (skip + length) * channels);
+}
+
+}  // namespace
+
+IconCache::IconCache(snd_pcm_format_t sample_format, unsigned int sample_rate,
+                     unsigned int channels)
+    : format_(sample_format), sample_rate_(sample_rate), channels_(channels) {
+  decoders_.emplace_back(new WavDecoder());
+}
+
+IconCache::~IconCache() {}
+
+void IconCache::AddDecoder(std::unique_ptr<AudioDecoder> decoder) {
+  decoders_.push_back(std::move(decoder));
+}
+
+std::shared_ptr<const Icon> IconCache::Get(const string& file_path) {
+  const string key = CanonicalPath(file_path);
+  auto it = icons_.find(key);
+  if (it != icons_.end()) {
+    return it->second;
+  }
+
+  std::shared_ptr<const Icon> icon = Load(key);
+  memory_ += icon->data.size();
+  icons_.emplace(key, icon);
+  return icon;
+}
+
+std::size_t IconCache::Preload(const string& directory) {
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    throw std::system_error(errno, std::system_category(),
+                            "IconCache: Failed to open " + directory);
+  }
+
+  std::size_t loaded = 0;
+  while (const struct dirent* entry = readdir(dir)) {
+    const string file_path = directory + "/" + entry->d_name;
+    struct stat info;
+    if (stat(file_path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+      continue;
+    }
+    try {
+      Get(file_path);
+      ++loaded;
+    } catch (std::exception& e) {
+      // Theme directories may contain other files, skip them.
+    }
+  }
+  closedir(dir);
+  return loaded;
+}
+
+std::shared_ptr<const Icon> IconCache::Load(const string& file_path) const {
+  MappedFile file(file_path);
+
+  for (const auto& decoder : decoders_) {
+    if (!decoder->CanDecode(file.data(), file.size())) continue;
+
+    const AudioClip clip = decoder->Decode(file.data(), file.size());
+    std::vector<float> samples = MapChannels(clip, channels_);
+    if (clip.sample_rate != sample_rate_) {
+      samples = Resample(samples, channels_, clip.sample_rate, sample_rate_);
+    }
+
+    std::shared_ptr<Icon> icon(new Icon());
+    icon->frames = samples.size() / channels_;
+    icon->data.resize(samples.size() * format_.sample_size());
+    format_.FromFloat(samples.data(), samples.size(), icon->data.data());
+    return icon;
+  }
+
+  throw DecodeError("IconCache: Unknown format of " + file_path);
+}
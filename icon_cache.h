@@ -0,0 +1,79 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ICON_CACHE_H_
+#define ICON_CACHE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "audio_decoder.h"
+#include "pcm_format.h"
+
+// Auditory icon, ready to be played: its samples are already in the sample
+// format, sample rate and number of channels of the player.
+struct Icon {
+  std::vector<char> data;
+  std::size_t frames = 0;
+};
+
+// Cache of decoded auditory icons.
+//
+// Emacspeak plays the same few icons over and over. This class decodes each
+// file the first time it is requested, reading it through a memory mapping,
+// converts it to the output format of the player and keeps the result, so
+// playing an icon again is only a copy to the device. A whole theme directory
+// may also be loaded upfront. Files are decoded by the first registered
+// decoder that recognizes them; a WAV decoder is always available.
+class IconCache {
+ public:
+  IconCache(snd_pcm_format_t sample_format, unsigned int sample_rate,
+            unsigned int channels);
+  ~IconCache();
+
+  // Registers another decoder, tried after the ones already registered.
+  void AddDecoder(std::unique_ptr<AudioDecoder> decoder);
+
+  // Returns the icon of the given file, decoding it if it is not cached.
+  // Throws DecodeError or std::system_error if the file cannot be decoded.
+  std::shared_ptr<const Icon> Get(const std::string& file_path);
+
+  // Decodes all the files of the given directory that can be decoded, and
+  // returns how many icons were loaded.
+  std::size_t Preload(const std::string& directory);
+
+  // Returns the number of cached icons, and the memory used by their
+  // samples, in bytes.
+  std::size_t size() const { return icons_.size(); }
+  std::size_t memory() const { return memory_; }
+
+ private:
+  // Decodes the file and converts it to the output format.
+  std::shared_ptr<const Icon> Load(const std::string& file_path) const;
+
+  const PcmFormat format_;
+  const unsigned int sample_rate_;
+  const unsigned int channels_;
+
+  std::vector<std::unique_ptr<AudioDecoder>> decoders_;
+
+  // Cached icons, by canonical file path.
+  std::unordered_map<std::string, std::shared_ptr<const Icon>> icons_;
+  std::size_t memory_ = 0;
+};
+
+#endif  // ICON_CACHE_H_
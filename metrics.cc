@@ -0,0 +1,245 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#include <cmath>
+#include <sstream>
+
+using std::string;
+
+namespace {
+
+const char* GetTypeName(Metrics::Type type) {
+  switch (type) {
+    case Metrics::COUNTER:
+      return "counter";
+    case Metrics::GAUGE:
+      return "gauge";
+    case Metrics::HISTOGRAM:
+      return "histogram";
+  }
+  return "untyped";
+}
+
+// Returns the value as written in the Prometheus text format.
+string FormatValue(double value) {
+  if (std::isinf(value)) {
+    return value > 0 ? "+Inf" : "-Inf";
+  }
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  std::ostringstream out;
+  out.precision(12);
+  out << value;
+  return out.str();
+}
+
+// Returns the name of a sample with the given labels and an extra label, if
+// any.
+string SampleName(const string& name, const string& labels,
+                  const string& extra = "") {
+  if (labels.empty() && extra.empty()) {
+    return name;
+  }
+  string result = name + "{" + labels;
+  if (!labels.empty() && !extra.empty()) {
+    result += ",";
+  }
+  return result + extra + "}";
+}
+
+}  // namespace
+
+// Histogram
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds),
+      buckets_(new std::atomic<std::uint64_t>[bounds.size() + 1]) {
+  for (std::size_t i = 0; i <= bounds_.size(); ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(double value) {
+  // There are few buckets, a linear search is as fast as a binary one.
+  std::size_t i = 0;
+  while (i < bounds_.size() && value > bounds_[i]) {
+    ++i;
+  }
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+
+  double sum = sum_.load(std::memory_order_relaxed);
+  while (!sum_.compare_exchange_weak(sum, sum + value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+// Metrics
+
+Metrics::Metrics() {}
+
+Metrics::~Metrics() {}
+
+Metrics* Metrics::Default() {
+  static Metrics metrics;
+  return &metrics;
+}
+
+Metrics::Series* Metrics::GetSeries(const string& name, const string& help,
+                                    Type type, const string& labels) {
+  auto it = families_.find(name);
+  if (it == families_.end()) {
+    it = families_.emplace(name, Family()).first;
+    it->second.type = type;
+    it->second.help = help;
+  } else if (it->second.type != type) {
+    throw std::invalid_argument("Metrics: " + name + " is already a " +
+                                GetTypeName(it->second.type));
+  }
+  return &it->second.series[labels];
+}
+
+Counter* Metrics::GetCounter(const string& name, const string& help,
+                             const string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series* series = GetSeries(name, help, COUNTER, labels);
+  if (series->counter == nullptr) {
+    series->counter.reset(new Counter());
+  }
+  return series->counter.get();
+}
+
+Gauge* Metrics::GetGauge(const string& name, const string& help,
+                         const string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series* series = GetSeries(name, help, GAUGE, labels);
+  if (series->gauge == nullptr) {
+    series->gauge.reset(new Gauge());
+  }
+  return series->gauge.get();
+}
+
+Histogram* Metrics::GetHistogram(const string& name, const string& help,
+                                 const std::vector<double>& bounds,
+                                 const string& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series* series = GetSeries(name, help, HISTOGRAM, labels);
+  if (series->histogram == nullptr) {
+    series->histogram.reset(new Histogram(bounds));
+  }
+  return series->histogram.get();
+}
+
+void Metrics::AddCallback(const string& name, const string& help, Type type,
+                          const string& labels, std::function<double()> value,
+                          const void* owner) {
+  if (type == HISTOGRAM) {
+    throw std::invalid_argument("Metrics: " + name +
+                                " cannot be read by a function");
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series* series = GetSeries(name, help, type, labels);
+  series->callback = std::move(value);
+  series->owner = owner;
+}
+
+void Metrics::RemoveCallbacks(const void* owner) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto family = families_.begin(); family != families_.end();) {
+    std::map<string, Series>& series = family->second.series;
+    for (auto it = series.begin(); it != series.end();) {
+      if (it->second.callback && it->second.owner == owner) {
+        it = series.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (series.empty()) {
+      family = families_.erase(family);
+    } else {
+      ++family;
+    }
+  }
+}
+
+void Metrics::Write(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& family : families_) {
+    const string& name = family.first;
+    out << "# HELP " << name << " " << family.second.help << "\n";
+    out << "# TYPE " << name << " " << GetTypeName(family.second.type)
+        << "\n";
+
+    for (const auto& entry : family.second.series) {
+      const string& labels = entry.first;
+      const Series& series = entry.second;
+      if (series.callback) {
+        out << SampleName(name, labels) << " "
+            << FormatValue(series.callback()) << "\n";
+      } else if (series.counter != nullptr) {
+        out << SampleName(name, labels) << " " << series.counter->value()
+            << "\n";
+      } else if (series.gauge != nullptr) {
+        out << SampleName(name, labels) << " "
+            << FormatValue(series.gauge->value()) << "\n";
+      } else if (series.histogram != nullptr) {
+        const Histogram& histogram = *series.histogram;
+        const std::vector<double>& bounds = histogram.bounds();
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i <= bounds.size(); ++i) {
+          cumulative += histogram.bucket(i);
+          const string bound = i < bounds.size() ? FormatValue(bounds[i])
+                                                 : string("+Inf");
+          out << SampleName(name + "_bucket", labels, Label("le", bound))
+              << " " << cumulative << "\n";
+        }
+        out << SampleName(name + "_sum", labels) << " "
+            << FormatValue(histogram.sum()) << "\n";
+        out << SampleName(name + "_count", labels) << " " << histogram.count()
+            << "\n";
+      }
+    }
+  }
+}
+
+string Metrics::ToString() const {
+  std::ostringstream out;
+  Write(out);
+  return out.str();
+}
+
+string Metrics::Label(const string& name, const string& value) {
+  string escaped;
+  escaped.reserve(value.size());
+  for (const char c : value) {
+    switch (c) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += c;
+        break;
+    }
+  }
+  return name + "=\"" + escaped + "\"";
+}
@@ -0,0 +1,188 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Monotonic count of events.
+class Counter {
+ public:
+  Counter() = default;
+
+  void Increment(std::uint64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<std::uint64_t> value_{0};
+};
+
+// Value that goes up and down, e.g. the length of a queue.
+class Gauge {
+ public:
+  Gauge() = default;
+
+  void Set(double value) { value_.store(value, std::memory_order_relaxed); }
+
+  double value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_{0.0};
+};
+
+// Distribution of observed values, counted in buckets of fixed upper bounds,
+// plus a last bucket for the values above all of them.
+class Histogram {
+ public:
+  // The bounds must be sorted in increasing order.
+  explicit Histogram(const std::vector<double>& bounds);
+
+  void Observe(double value);
+
+  const std::vector<double>& bounds() const { return bounds_; }
+
+  // Returns the number of values in the given bucket, not cumulative. The
+  // bucket bounds().size() holds the values above the last bound.
+  std::uint64_t bucket(std::size_t i) const {
+    return buckets_[i].load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+ private:
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+  std::atomic<std::uint64_t> count_{0};
+  std::atomic<double> sum_{0.0};
+};
+
+// Observes the time from its construction to its destruction, in seconds, in
+// a histogram.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Histogram* histogram)
+      : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() {
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_;
+    histogram_->Observe(elapsed.count());
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Histogram* histogram_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+// Registry of the metrics of the server.
+//
+// Metrics are registered once by name, and optionally by labels, e.g.
+// command="q", and the returned objects are kept for the lifetime of the
+// registry, so the code that updates them holds a pointer and pays only for
+// a relaxed atomic operation, from any thread. Values that are already kept
+// elsewhere, e.g. the statistics of the audio manager, are instead read by a
+// function when the metrics are written. Metrics are written in the
+// Prometheus text exposition format.
+class Metrics {
+ public:
+  enum Type {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM,
+  };
+
+  Metrics();
+  ~Metrics();
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  // Returns the registry of the process.
+  static Metrics* Default();
+
+  // Return the metric of the given name and labels, registering it the first
+  // time. The help text describes all the metrics of the same name. Throws
+  // std::invalid_argument if the name was registered with another type.
+  Counter* GetCounter(const std::string& name, const std::string& help,
+                      const std::string& labels = "");
+  Gauge* GetGauge(const std::string& name, const std::string& help,
+                  const std::string& labels = "");
+  Histogram* GetHistogram(const std::string& name, const std::string& help,
+                          const std::vector<double>& bounds,
+                          const std::string& labels = "");
+
+  // Registers a counter or gauge whose value is returned by the function,
+  // called from the thread writing the metrics, on behalf of the given owner.
+  // Replaces the previous function of the same name and labels.
+  void AddCallback(const std::string& name, const std::string& help,
+                   Type type, const std::string& labels,
+                   std::function<double()> value, const void* owner);
+
+  // Removes the functions registered on behalf of the owner, which must be
+  // called before it is destroyed.
+  void RemoveCallbacks(const void* owner);
+
+  // Writes all the metrics in the Prometheus text format.
+  void Write(std::ostream& out) const;
+  std::string ToString() const;
+
+  // Returns the label with the given name and value, escaped for the
+  // Prometheus text format, e.g. command="q".
+  static std::string Label(const std::string& name, const std::string& value);
+
+ private:
+  // Metric of a given name and labels.
+  struct Series {
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+    std::function<double()> callback;
+    const void* owner = nullptr;
+  };
+
+  // Metrics of the same name, by labels.
+  struct Family {
+    Type type;
+    std::string help;
+    std::map<std::string, Series> series;
+  };
+
+  // Returns the series of the given name and labels, registering them if
+  // needed.
+  Series* GetSeries(const std::string& name, const std::string& help,
+                    Type type, const std::string& labels);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
+#endif  // METRICS_H_
@@ -0,0 +1,157 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics_exporter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace {
+
+// Longest wait for a descriptor to become writable while sending.
+const int kSendTimeoutMs = 100;
+
+}  // namespace
+
+MetricsExporter::MetricsExporter(EventLoop* loop, Metrics* metrics,
+                                 const Options& options)
+    : loop_(loop), metrics_(metrics), options_(options) {
+  if (!options_.socket_path.empty()) {
+    const string& path = options_.socket_path;
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+      throw std::system_error(ENAMETOOLONG, std::system_category(),
+                              "MetricsExporter: Invalid socket path " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+      unlink(path.c_str());
+    }
+
+    const int fd =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "MetricsExporter: Failed to create socket");
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+            0 ||
+        listen(fd, SOMAXCONN) != 0) {
+      const int error = errno;
+      close(fd);
+      throw std::system_error(error, std::system_category(),
+                              "MetricsExporter: Failed to listen on " + path);
+    }
+    listen_fd_ = fd;
+    loop_->Add(listen_fd_, EPOLLIN,
+               [this](std::uint32_t events) { AcceptClients(); });
+  }
+
+  if (!options_.file.empty()) {
+    timer_.reset(new Timer(loop_, [this]() { WriteFile(); }));
+    timer_->Start(options_.interval, options_.interval);
+  }
+}
+
+MetricsExporter::~MetricsExporter() {
+  if (listen_fd_ >= 0) {
+    loop_->Remove(listen_fd_);
+    close(listen_fd_);
+    unlink(options_.socket_path.c_str());
+  }
+  if (!options_.file.empty()) {
+    timer_.reset();
+    WriteFile();
+  }
+}
+
+void MetricsExporter::WriteFile() {
+  // Written next to the file, and renamed over it.
+  const string temp_path = options_.file + ".tmp";
+  {
+    std::ofstream out(temp_path);
+    metrics_->Write(out);
+    if (!out.flush()) {
+      std::cerr << "MetricsExporter: Failed to write " << temp_path
+                << std::endl;
+      return;
+    }
+  }
+  if (std::rename(temp_path.c_str(), options_.file.c_str()) != 0) {
+    std::cerr << "MetricsExporter: Failed to replace " << options_.file
+              << ": " << std::strerror(errno) << std::endl;
+  }
+}
+
+void MetricsExporter::AcceptClients() {
+  for (;;) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        std::cerr << "MetricsExporter: Failed to accept a client: "
+                  << std::strerror(errno) << std::endl;
+      }
+      return;
+    }
+    Send(fd, metrics_->ToString());
+    close(fd);
+  }
+}
+
+bool MetricsExporter::Send(int fd, const string& text) {
+  bool socket = true;
+  std::size_t sent = 0;
+  while (sent < text.size()) {
+    const char* data = text.data() + sent;
+    const std::size_t size = text.size() - sent;
+    ssize_t result = -1;
+    if (socket) {
+      result = send(fd, data, size, MSG_NOSIGNAL);
+      if (result < 0 && errno == ENOTSOCK) {
+        socket = false;
+        continue;
+      }
+    } else {
+      result = write(fd, data, size);
+    }
+
+    if (result >= 0) {
+      sent += result;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      pollfd pfd = {fd, POLLOUT, 0};
+      if (poll(&pfd, 1, kSendTimeoutMs) <= 0) return false;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METRICS_EXPORTER_H_
+#define METRICS_EXPORTER_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "event_loop.h"
+#include "metrics.h"
+
+// Exports the metrics of a registry from an event loop, in the Prometheus
+// text format.
+//
+// The metrics may be written to a file periodically, replacing it at once so
+// a reader never sees half of it, e.g. for the textfile collector of the node
+// exporter, and to every client that connects to a Unix domain socket, which
+// is closed right after.
+class MetricsExporter {
+ public:
+  struct Options {
+    Options() noexcept {}
+
+    // File to write the metrics to, if any, and how often.
+    std::string file;
+    std::chrono::milliseconds interval{10000};
+
+    // Path of the socket, if any.
+    std::string socket_path;
+  };
+
+  // Throws std::system_error if the socket cannot be created.
+  MetricsExporter(EventLoop* loop, Metrics* metrics, const Options& options);
+
+  // Writes the file a last time.
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter&) = delete;
+  MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+  // Writes the metrics to the file now.
+  void WriteFile();
+
+  // Writes the whole text to the descriptor, a socket or not, waiting a
+  // little if it is not writable, without raising SIGPIPE. Returns false on
+  // failure.
+  static bool Send(int fd, const std::string& text);
+
+ private:
+  // Sends the metrics to the clients waiting to connect to the socket.
+  void AcceptClients();
+
+  EventLoop* loop_;
+  Metrics* metrics_;
+  const Options options_;
+
+  std::unique_ptr<Timer> timer_;
+  int listen_fd_ = -1;
+};
+
+#endif  // METRICS_EXPORTER_H_
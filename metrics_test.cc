@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+#include "metrics_exporter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+bool Contains(const string& text, const string& line) {
+  return text.find(line + "\n") != string::npos;
+}
+
+int main() {
+  // Counters are updated from several threads without losing increments.
+  {
+    Metrics metrics;
+    Counter* counter = metrics.GetCounter("events_total", "Events.");
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([counter]() {
+        for (int j = 0; j < 100000; ++j) counter->Increment();
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    Check("Concurrent increments", counter->value() == 400000,
+          counter->value());
+    Check("Same counter by name",
+          metrics.GetCounter("events_total", "Events.") == counter, 0);
+  }
+
+  // Histograms count values in cumulative buckets.
+  {
+    Metrics metrics;
+    Histogram* histogram =
+        metrics.GetHistogram("latency_seconds", "Latency.", {0.01, 0.1});
+    histogram->Observe(0.005);
+    histogram->Observe(0.01);
+    histogram->Observe(0.05);
+    histogram->Observe(1.0);
+    const string text = metrics.ToString();
+    Check("Histogram type",
+          Contains(text, "# TYPE latency_seconds histogram"), 0);
+    Check("First bucket",
+          Contains(text, "latency_seconds_bucket{le=\"0.01\"} 2"), 0);
+    Check("Second bucket",
+          Contains(text, "latency_seconds_bucket{le=\"0.1\"} 3"), 0);
+    Check("Last bucket",
+          Contains(text, "latency_seconds_bucket{le=\"+Inf\"} 4"), 0);
+    Check("Count", Contains(text, "latency_seconds_count 4"), 0);
+    Check("Sum", histogram->sum() > 1.064 && histogram->sum() < 1.066,
+          histogram->sum());
+  }
+
+  // Labels are escaped, and each set of labels is a series of its own.
+  {
+    Metrics metrics;
+    metrics.GetCounter("statements_total", "Statements.",
+                       Metrics::Label("command", "q"))->Increment(3);
+    metrics.GetCounter("statements_total", "Statements.",
+                       Metrics::Label("command", "a\"b"))->Increment();
+    const string text = metrics.ToString();
+    Check("Labelled series",
+          Contains(text, "statements_total{command=\"q\"} 3"), 0);
+    Check("Escaped label",
+          Contains(text, "statements_total{command=\"a\\\"b\"} 1"), 0);
+    Check("One help line per name",
+          text.find("# HELP statements_total") ==
+              text.rfind("# HELP statements_total"),
+          0);
+
+    bool thrown = false;
+    try {
+      metrics.GetGauge("statements_total", "Statements.");
+    } catch (std::invalid_argument& e) {
+      thrown = true;
+    }
+    Check("Type mismatch", thrown, 0);
+  }
+
+  // Functions are read when the metrics are written, until their owner
+  // removes them.
+  {
+    Metrics metrics;
+    int depth = 2;
+    metrics.AddCallback("queue_depth", "Depth.", Metrics::GAUGE, "",
+                        [&depth]() { return depth; }, &depth);
+    depth = 5;
+    Check("Read on write", Contains(metrics.ToString(), "queue_depth 5"),
+          depth);
+    metrics.RemoveCallbacks(&depth);
+    Check("Removed", metrics.ToString().empty(), 0);
+  }
+
+  // The exporter writes the metrics to each client of its socket, and to its
+  // file.
+  {
+    Metrics metrics;
+    metrics.GetCounter("events_total", "Events.")->Increment(7);
+    const string path =
+        "/tmp/metrics_test." + std::to_string(getpid()) + ".sock";
+    const string file =
+        "/tmp/metrics_test." + std::to_string(getpid()) + ".prom";
+
+    EventLoop loop;
+    {
+      MetricsExporter::Options options;
+      options.socket_path = path;
+      options.file = file;
+      MetricsExporter exporter(&loop, &metrics, options);
+
+      const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address;
+      std::memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      std::strcpy(address.sun_path, path.c_str());
+      const bool connected =
+          connect(fd, reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)) == 0;
+      Check("Connected", connected, 0);
+      loop.RunOnce(100);
+
+      string received;
+      char buffer[256];
+      ssize_t size;
+      while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+        received.append(buffer, size);
+      }
+      close(fd);
+      Check("Sent to the client", Contains(received, "events_total 7"),
+            received.size());
+    }
+
+    std::ifstream in(file);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    Check("Written to the file", Contains(contents.str(), "events_total 7"),
+          contents.str().size());
+    std::remove(file.c_str());
+    Check("Socket removed", access(path.c_str(), F_OK) != 0, 0);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,154 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mixer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#warning "SSE2 is not enabled: the mixer uses its scalar code."
+#endif
+
+namespace {
+
+const bool kNativeLittleEndian =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+// Adds count samples of in, scaled by the Q15 gain, to out, saturating.
+void MixS16(std::int16_t* out, const std::int16_t* in, std::size_t count,
+            std::int32_t gain_q15) {
+  std::size_t i = 0;
+#ifdef __SSE2__
+  if (gain_q15 >= 32768) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i* dst = reinterpret_cast<__m128i*>(out + i);
+      const __m128i src =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      _mm_storeu_si128(dst, _mm_adds_epi16(_mm_loadu_si128(dst), src));
+    }
+  } else {
+    // The full 32-bit products are assembled from their low and high halves,
+    // so the result is the same as the scalar code below.
+    const __m128i gain = _mm_set1_epi16(static_cast<std::int16_t>(gain_q15));
+    for (; i + 8 <= count; i += 8) {
+      __m128i* dst = reinterpret_cast<__m128i*>(out + i);
+      const __m128i src =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      const __m128i lo = _mm_mullo_epi16(src, gain);
+      const __m128i hi = _mm_mulhi_epi16(src, gain);
+      const __m128i scaled = _mm_packs_epi32(
+          _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15),
+          _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15));
+      _mm_storeu_si128(dst, _mm_adds_epi16(_mm_loadu_si128(dst), scaled));
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    const std::int32_t sum = out[i] + ((in[i] * gain_q15) >> 15);
+    out[i] = static_cast<std::int16_t>(std::min(32767, std::max(-32768, sum)));
+  }
+}
+
+// Adds count samples of in, scaled by gain, to out, clipping to [-1, 1].
+void MixFloat(float* out, const float* in, std::size_t count, float gain) {
+  for (std::size_t i = 0; i < count; ++i) {
+    const float sum = out[i] + in[i] * gain;
+    out[i] = sum < -1.0f ? -1.0f : (sum > 1.0f ? 1.0f : sum);
+  }
+}
+
+}  // namespace
+
+Mixer::Mixer(snd_pcm_format_t sample_format, unsigned int channels)
+    : format_(sample_format), channels_(channels) {}
+
+std::size_t Mixer::remaining() const {
+  std::size_t frames = 0;
+  for (const Voice& voice : voices_) {
+    frames = std::max(frames, voice.icon->frames - voice.position);
+  }
+  return frames;
+}
+
+void Mixer::Add(std::shared_ptr<const Icon> icon, float gain, int source) {
+  if (icon == nullptr || icon->frames == 0) return;
+
+  gain = std::min(1.0f, std::max(0.0f, gain));
+  const std::int32_t gain_q15 = std::lround(gain * 32768);
+  voices_.push_back(Voice{std::move(icon), source, 0, gain, gain_q15});
+}
+
+void Mixer::Clear(int source) {
+  voices_.erase(std::remove_if(voices_.begin(), voices_.end(),
+                               [source](const Voice& voice) {
+                                 return voice.source == source;
+                               }),
+                voices_.end());
+}
+
+void Mixer::Mix(char* out, std::size_t frames) {
+  const snd_pcm_format_t format = format_.format();
+  const bool native_s16 =
+      snd_pcm_format_width(format) == 16 &&
+      snd_pcm_format_physical_width(format) == 16 &&
+      snd_pcm_format_signed(format) == 1 &&
+      (snd_pcm_format_little_endian(format) == 1) == kNativeLittleEndian;
+  const bool native_float = format == SND_PCM_FORMAT_FLOAT;
+
+  // Other formats are converted to floating point once for all voices.
+  const bool convert = !native_s16 && !native_float;
+  float* mix = reinterpret_cast<float*>(out);
+  if (convert) {
+    mix_.resize(frames * channels_);
+    format_.ToFloat(out, mix_.size(), mix_.data());
+    mix = mix_.data();
+  }
+
+  const std::size_t frame_size = channels_ * format_.sample_size();
+  for (const Voice& voice : voices_) {
+    const std::size_t count =
+        std::min(frames, voice.icon->frames - voice.position) * channels_;
+    const char* in = voice.icon->data.data() + voice.position * frame_size;
+
+    if (native_s16) {
+      MixS16(reinterpret_cast<std::int16_t*>(out),
+             reinterpret_cast<const std::int16_t*>(in), count,
+             voice.gain_q15);
+    } else if (native_float) {
+      MixFloat(mix, reinterpret_cast<const float*>(in), count, voice.gain);
+    } else {
+      voice_.resize(count);
+      format_.ToFloat(in, count, voice_.data());
+      MixFloat(mix, voice_.data(), count, voice.gain);
+    }
+  }
+
+  if (convert) {
+    format_.FromFloat(mix_.data(), mix_.size(), out);
+  }
+}
+
+void Mixer::Advance(std::size_t frames) {
+  for (Voice& voice : voices_) {
+    voice.position = std::min(voice.icon->frames, voice.position + frames);
+  }
+  voices_.erase(std::remove_if(voices_.begin(), voices_.end(),
+                               [](const Voice& voice) {
+                                 return voice.position == voice.icon->frames;
+                               }),
+                voices_.end());
+}
@@ -0,0 +1,86 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MIXER_H_
+#define MIXER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "icon_cache.h"
+#include "pcm_format.h"
+
+// Software mixer of auditory icons over the output of the audio tasks.
+//
+// Each voice plays one icon, already in the output format of the player, with
+// its own gain, on behalf of a source, as the tasks of the AudioManager. The player adds the active voices to every block of audio it
+// accepts, so icons overlap speech instead of waiting for it to finish. The
+// sum saturates at the limits of the sample format instead of wrapping
+// around. 16-bit native samples, by far the most common, are mixed with SSE2
+// when available; other formats go through floating point.
+class Mixer {
+ public:
+  Mixer(snd_pcm_format_t sample_format, unsigned int channels);
+
+  const PcmFormat& format() const { return format_; }
+
+  // Returns whether any voice is playing.
+  bool active() const { return !voices_.empty(); }
+
+  // Returns the number of frames left to play by the longest voice.
+  std::size_t remaining() const;
+
+  // Starts a voice playing the given icon, scaled by gain, which must be
+  // between 0 and 1, on behalf of the given source. The voice starts with the
+  // next frame mixed.
+  void Add(std::shared_ptr<const Icon> icon, float gain, int source = 0);
+
+  // Adds the next frames of all voices to the given frames of audio. The
+  // voices do not advance until Advance() is called, so the same frames can
+  // be mixed again if the player did not accept them.
+  void Mix(char* out, std::size_t frames);
+
+  // Advances all voices by the given number of frames, removing the ones
+  // that finished.
+  void Advance(std::size_t frames);
+
+  // Stops all voices.
+  void Clear() { voices_.clear(); }
+
+  // Stops the voices of the given source.
+  void Clear(int source);
+
+ private:
+  struct Voice {
+    std::shared_ptr<const Icon> icon;
+    int source;
+    std::size_t position;
+    float gain;
+    // Gain in Q15 fixed point, for integer samples.
+    std::int32_t gain_q15;
+  };
+
+  const PcmFormat format_;
+  const unsigned int channels_;
+  std::vector<Voice> voices_;
+
+  // Samples converted to floating point, for formats mixed in floating
+  // point.
+  std::vector<float> mix_;
+  std::vector<float> voice_;
+};
+
+#endif  // MIXER_H_
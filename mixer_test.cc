@@ -0,0 +1,140 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mixer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << "\n";
+  }
+}
+
+// Returns an icon with the given 16-bit samples.
+std::shared_ptr<const Icon> MakeIcon(const std::vector<std::int16_t>& samples,
+                                     unsigned int channels) {
+  std::shared_ptr<Icon> icon(new Icon());
+  icon->data.resize(samples.size() * sizeof(std::int16_t));
+  std::memcpy(icon->data.data(), samples.data(), icon->data.size());
+  icon->frames = samples.size() / channels;
+  return icon;
+}
+
+int main() {
+  {
+    Mixer mixer(SND_PCM_FORMAT_S16, 1);
+    mixer.Add(MakeIcon({1000, 20000, -20000, 500}, 1), 1.0f);
+    std::vector<std::int16_t> out = {100, 20000, -20000};
+    mixer.Mix(reinterpret_cast<char*>(out.data()), out.size());
+    Check("Saturating sum",
+          out[0] == 1100 && out[1] == 32767 && out[2] == -32768);
+
+    mixer.Advance(3);
+    Check("Voice active until the end", mixer.active() &&
+                                            mixer.remaining() == 1);
+    mixer.Advance(3);
+    Check("Voice removed at the end", !mixer.active());
+  }
+
+  {
+    // Compare the vectorized loop with a reference sum, with a number of
+    // samples that is not a multiple of the vector size.
+    std::vector<std::int16_t> samples(1001);
+    std::vector<std::int16_t> out(samples.size());
+    std::srand(1);
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      samples[i] = std::rand() % 65536 - 32768;
+      out[i] = std::rand() % 65536 - 32768;
+    }
+
+    Mixer mixer(SND_PCM_FORMAT_S16, 1);
+    mixer.Add(MakeIcon(samples, 1), 0.5f);
+    std::vector<std::int16_t> expected = out;
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      const int sum = expected[i] + ((samples[i] * 16384) >> 15);
+      expected[i] = std::min(32767, std::max(-32768, sum));
+    }
+    mixer.Mix(reinterpret_cast<char*>(out.data()), out.size());
+    Check("Gain and saturation", out == expected);
+  }
+
+  {
+    Mixer mixer(SND_PCM_FORMAT_S16, 2);
+    mixer.Add(MakeIcon({1000, 2000}, 2), 1.0f);
+    mixer.Add(MakeIcon({10, 20, 30, 40}, 2), 1.0f);
+    std::vector<std::int16_t> out(4, 0);
+    mixer.Mix(reinterpret_cast<char*>(out.data()), 2);
+    Check("Several voices", out == std::vector<std::int16_t>({1010, 2020, 30,
+                                                              40}));
+  }
+
+  {
+    Mixer mixer(SND_PCM_FORMAT_S16, 1);
+    mixer.Add(MakeIcon({1, 2, 3, 4}, 1), 1.0f, 1);
+    mixer.Add(MakeIcon({1, 2}, 1), 1.0f, 2);
+    mixer.Clear(1);
+    Check("Voices of a source stopped",
+          mixer.active() && mixer.remaining() == 2);
+  }
+
+  {
+    Mixer mixer(SND_PCM_FORMAT_FLOAT, 1);
+    std::shared_ptr<Icon> icon(new Icon());
+    const float samples[] = {0.5f, 0.75f};
+    icon->data.assign(reinterpret_cast<const char*>(samples),
+                      reinterpret_cast<const char*>(samples + 2));
+    icon->frames = 2;
+    mixer.Add(icon, 0.5f);
+    float out[] = {0.25f, 0.9f};
+    mixer.Mix(reinterpret_cast<char*>(out), 2);
+    Check("Floating point samples", out[0] == 0.5f && out[1] == 1.0f);
+  }
+
+  {
+    // Formats without a fast path are mixed through floating point.
+    const PcmFormat format(SND_PCM_FORMAT_S16_BE);
+    const float samples[] = {0.5f, -0.25f};
+    const float base[] = {0.25f, -0.25f};
+    std::shared_ptr<Icon> icon(new Icon());
+    icon->data.resize(4);
+    format.FromFloat(samples, 2, icon->data.data());
+    icon->frames = 2;
+    char out[4];
+    format.FromFloat(base, 2, out);
+
+    Mixer mixer(SND_PCM_FORMAT_S16_BE, 1);
+    mixer.Add(icon, 1.0f);
+    mixer.Mix(out, 2);
+    float result[2];
+    format.ToFloat(out, 2, result);
+    Check("Other sample formats", std::fabs(result[0] - 0.75f) < 1e-3f &&
+                                      std::fabs(result[1] + 0.5f) < 1e-3f);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
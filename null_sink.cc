@@ -0,0 +1,234 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "null_sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <system_error>
+#include <thread>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+constexpr int NullSink::kPeriods;
+
+namespace {
+
+// Returns the number of frames of the given duration, at the given rate.
+std::size_t ToFrames(std::chrono::microseconds duration, unsigned int rate) {
+  return std::max<std::uint64_t>(
+      NullSink::kPeriods,
+      static_cast<std::uint64_t>(duration.count()) * rate / 1000000);
+}
+
+}  // namespace
+
+NullSink::NullSink(const Options& options)
+    : AudioSink(options.sample_format, options.sample_rate, options.channels),
+      options_(options),
+      epoch_(std::chrono::steady_clock::now()) {
+  if (options_.clock == REAL_TIME) {
+    fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  } else {
+    // The virtual device is always ready, so the descriptor always is.
+    fd_ = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+  if (fd_ < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "NullSink: Failed to create the clock descriptor");
+  }
+
+  const std::size_t buffer_size =
+      ToFrames(options_.buffer_time, options_.sample_rate);
+  SetBufferSize(buffer_size / kPeriods, buffer_size);
+  ArmTimer();
+}
+
+NullSink::~NullSink() {
+  close(fd_);
+}
+
+std::chrono::nanoseconds NullSink::now() const {
+  if (options_.clock == VIRTUAL) return virtual_time_;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - epoch_);
+}
+
+void NullSink::AdvanceClock(std::chrono::nanoseconds duration) {
+  if (options_.clock != VIRTUAL) return;
+  virtual_time_ += duration;
+  CheckUnderrun(virtual_time_);
+}
+
+std::uint64_t NullSink::Played(std::chrono::nanoseconds time) const {
+  if (!running_) return played_;
+  const std::uint64_t elapsed =
+      static_cast<std::uint64_t>((time - start_time_).count()) *
+      sample_rate() / 1000000000;
+  return std::min(written_, played_ + elapsed);
+}
+
+std::chrono::nanoseconds NullSink::Duration(std::uint64_t frames) const {
+  return std::chrono::nanoseconds(
+      (frames * 1000000000 + sample_rate() - 1) / sample_rate());
+}
+
+void NullSink::Start(std::chrono::nanoseconds time) {
+  if (running_ || paused_ || written_ == played_) return;
+  start_time_ = time;
+  running_ = true;
+}
+
+void NullSink::CheckUnderrun(std::chrono::nanoseconds time) {
+  if (!running_ || Played(time) < written_) return;
+
+  played_ = written_;
+  running_ = false;
+  if (!idle_) {
+    ++underruns_;
+    if (options_.verbose) {
+      std::cerr << "NullSink: Sound buffer underrun." << std::endl;
+    }
+  }
+}
+
+std::size_t NullSink::Write(const char* data, std::size_t count) {
+  std::chrono::nanoseconds time = now();
+  CheckUnderrun(time);
+
+  std::uint64_t free = buffer_size() - (written_ - Played(time));
+  if (options_.clock == VIRTUAL && free < count && !paused_) {
+    // The producer would wait for the device to play enough audio.
+    Start(time);
+    const std::uint64_t needed = std::min<std::uint64_t>(
+        count - free, written_ - Played(time));
+    const std::uint64_t target = Played(time) + needed;
+    virtual_time_ = start_time_ + Duration(target - played_);
+    time = virtual_time_;
+    free = buffer_size() - (written_ - Played(time));
+  }
+
+  const std::size_t accepted = std::min<std::uint64_t>(count, free);
+  if (accepted > 0) {
+    written_ += accepted;
+    idle_ = false;
+  }
+
+  // As with the start threshold of ALSA, play once a period is written.
+  if (written_ - Played(time) >= period_size()) {
+    Start(time);
+  }
+  ArmTimer();
+  return accepted;
+}
+
+void NullSink::ArmTimer() {
+  if (options_.clock != REAL_TIME) return;
+
+  // The timer stays expired, so the descriptor ready, until it is armed
+  // again after the next write.
+  const std::chrono::nanoseconds time = now();
+  const std::uint64_t free = buffer_size() - (written_ - Played(time));
+  std::chrono::nanoseconds wait(1);
+  if (free < period_size()) {
+    if (!running_) {
+      wait = std::chrono::nanoseconds(0);  // Disarmed while paused.
+    } else {
+      wait = std::max(wait, start_time_ +
+                                Duration(Played(time) - played_ +
+                                         period_size() - free) -
+                                time);
+    }
+  }
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = wait.count() / 1000000000;
+  spec.it_value.tv_nsec = wait.count() % 1000000000;
+  if (timerfd_settime(fd_, 0, &spec, nullptr) < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "NullSink: Failed to arm the timer");
+  }
+}
+
+std::vector<struct pollfd> NullSink::GetPollDescriptors() const {
+  struct pollfd fd = {};
+  fd.fd = fd_;
+  fd.events = POLLIN;
+  return {fd};
+}
+
+int NullSink::GetPollEvents(struct pollfd* fds, int nfds) const {
+  return nfds > 0 && (fds[0].revents & POLLIN) ? POLLOUT : 0;
+}
+
+bool NullSink::running() const {
+  return running_ && Played(now()) < written_;
+}
+
+void NullSink::Reconfigure(std::chrono::microseconds buffer_time) {
+  Interrupt();
+  const std::size_t buffer_size = ToFrames(buffer_time, sample_rate());
+  SetBufferSize(buffer_size / kPeriods, buffer_size);
+  ArmTimer();
+}
+
+void NullSink::Drain() {
+  Start(now());
+  const std::uint64_t remaining = written_ - Played(now());
+  if (running_ && remaining > 0) {
+    if (options_.clock == VIRTUAL) {
+      virtual_time_ += Duration(remaining);
+    } else {
+      std::this_thread::sleep_for(Duration(remaining));
+    }
+  }
+  played_ = written_;
+  running_ = false;
+  ArmTimer();
+}
+
+bool NullSink::Pause() {
+  played_ = Played(now());
+  running_ = false;
+  paused_ = true;
+  ArmTimer();
+  return true;
+}
+
+void NullSink::Resume() {
+  if (!paused_) return;
+  paused_ = false;
+  Start(now());
+  ArmTimer();
+}
+
+snd_pcm_sframes_t NullSink::GetDelay() const {
+  return written_ - Played(now()) + staged();
+}
+
+void NullSink::Idle() {
+  // Whatever was written is played, even if it is less than a period.
+  Start(now());
+  idle_ = true;
+}
+
+void NullSink::Interrupt() {
+  DropStaged();
+  played_ = written_;
+  running_ = false;
+  ArmTimer();
+}
@@ -0,0 +1,131 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NULL_SINK_H_
+#define NULL_SINK_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "audio_sink.h"
+
+// Audio sink that discards the audio, as a sound device would play it.
+//
+// The sink behaves as a device with a buffer of the given duration, which is
+// played at the sample rate, so producers see the same flow control, delay
+// and underruns as with a real device, without any sound hardware. The
+// playback follows one of two clocks:
+//
+// - REAL_TIME: the wall clock. The poll descriptor is a timerfd that fires
+//   when a period of the buffer is free, so the main loop is paced as by a
+//   sound device.
+// - VIRTUAL: a clock that only advances when audio is written to a full
+//   buffer, by just as much as the producer would have waited, or with
+//   AdvanceClock(). The poll descriptor is an eventfd that is always ready,
+//   so the audio is produced as fast as possible, while the timing seen by
+//   the producer stays that of a device.
+class NullSink : public AudioSink {
+ public:
+  enum Clock { REAL_TIME, VIRTUAL };
+
+  // Sink options.
+  struct Options {
+    Options() noexcept {}
+
+    // Whether to report underruns.
+    bool verbose = false;
+
+    // Format of the audio.
+    snd_pcm_format_t sample_format = SND_PCM_FORMAT_S16;
+    unsigned int sample_rate = 11025;  // Hz
+    unsigned int channels = 1;
+
+    // Duration of the buffer of the simulated device, which is split in
+    // kPeriods periods.
+    std::chrono::microseconds buffer_time = std::chrono::milliseconds(100);
+
+    Clock clock = REAL_TIME;
+  };
+
+  static constexpr int kPeriods = 4;
+
+  explicit NullSink(const Options& options = Options());
+  ~NullSink() override;
+
+  // Returns the time of the clock of the sink, since it was created.
+  std::chrono::nanoseconds now() const;
+
+  // Advances the virtual clock by the given duration, playing the audio
+  // written meanwhile. Has no effect on the real time clock.
+  void AdvanceClock(std::chrono::nanoseconds duration);
+
+  // Returns the number of frames written to the device and played so far.
+  std::uint64_t frames_written() const { return written_; }
+  std::uint64_t frames_played() const { return Played(now()); }
+
+  // AudioSink overrides.
+  bool offline() const override { return options_.clock == VIRTUAL; }
+  bool running() const override;
+  int underruns() const override { return underruns_; }
+  void Reconfigure(std::chrono::microseconds buffer_time) override;
+  std::vector<struct pollfd> GetPollDescriptors() const override;
+  int GetPollEvents(struct pollfd* fds, int nfds) const override;
+  void Drain() override;
+  bool Pause() override;
+  void Resume() override;
+  snd_pcm_sframes_t GetDelay() const override;
+  void Idle() override;
+  void Interrupt() override;
+
+ protected:
+  std::size_t Write(const char* data, std::size_t count) override;
+
+ private:
+  // Returns the number of frames played at the given time.
+  std::uint64_t Played(std::chrono::nanoseconds time) const;
+
+  // Returns the duration of the given number of frames, rounded up.
+  std::chrono::nanoseconds Duration(std::uint64_t frames) const;
+
+  // Starts playing from the given time.
+  void Start(std::chrono::nanoseconds time);
+
+  // Stops playing once all the audio written was played, counting an
+  // underrun unless it was expected.
+  void CheckUnderrun(std::chrono::nanoseconds time);
+
+  // Arms the timer to fire when one period of the buffer is free.
+  void ArmTimer();
+
+  const Options options_;
+  const std::chrono::steady_clock::time_point epoch_;
+
+  // Descriptor polled for the device to be ready: a timerfd for the real
+  // time clock, or an eventfd for the virtual clock.
+  int fd_ = -1;
+
+  std::chrono::nanoseconds virtual_time_ = std::chrono::nanoseconds(0);
+
+  // Frames written to the device. While running, the playback started at
+  // start_time_ from frame played_, otherwise played_ frames were played.
+  std::uint64_t written_ = 0;
+  std::uint64_t played_ = 0;
+  std::chrono::nanoseconds start_time_ = std::chrono::nanoseconds(0);
+  bool running_ = false;
+  bool paused_ = false;
+  bool idle_ = false;
+  int underruns_ = 0;
+};
+
+#endif  // NULL_SINK_H_
@@ -0,0 +1,156 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pcm_format.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const bool kNativeLittleEndian =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+inline float Clip(float x) {
+  return x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x);
+}
+
+// Stores the lowest size bytes of value in the given byte order.
+inline void Store(std::uint64_t value, std::size_t size, bool little_endian,
+                  char* out) {
+  for (std::size_t i = 0; i < size; ++i) {
+    const std::size_t shift = 8 * (little_endian ? i : size - 1 - i);
+    out[i] = static_cast<char>((value >> shift) & 0xff);
+  }
+}
+
+// Loads size bytes in the given byte order.
+inline std::uint64_t Load(const char* in, std::size_t size,
+                          bool little_endian) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    const std::size_t shift = 8 * (little_endian ? i : size - 1 - i);
+    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[i]))
+             << shift;
+  }
+  return value;
+}
+
+}  // namespace
+
+PcmFormat::PcmFormat(snd_pcm_format_t format)
+    : format_(format),
+      sample_size_(snd_pcm_format_physical_width(format) / 8),
+      width_(snd_pcm_format_width(format)),
+      signed_(snd_pcm_format_signed(format) == 1),
+      float_(snd_pcm_format_float(format) == 1),
+      little_endian_(snd_pcm_format_little_endian(format) == 1) {}
+
+void PcmFormat::FromFloat(const float* in, std::size_t count,
+                          char* out) const {
+  const bool native = little_endian_ == kNativeLittleEndian;
+
+  // Fast paths for the formats used in practice, written so the compiler can
+  // vectorize them.
+  if (native && !float_ && signed_ && sample_size_ == 2) {
+    std::int16_t* samples = reinterpret_cast<std::int16_t*>(out);
+    for (std::size_t i = 0; i < count; ++i) {
+      samples[i] = static_cast<std::int16_t>(Clip(in[i]) * 32767.0f);
+    }
+    return;
+  }
+  if (native && float_ && sample_size_ == sizeof(float)) {
+    float* samples = reinterpret_cast<float*>(out);
+    for (std::size_t i = 0; i < count; ++i) {
+      samples[i] = Clip(in[i]);
+    }
+    return;
+  }
+
+  for (std::size_t i = 0; i < count; ++i, out += sample_size_) {
+    const float x = Clip(in[i]);
+    std::uint64_t bits;
+    if (float_) {
+      if (sample_size_ == sizeof(double)) {
+        const double value = x;
+        std::memcpy(&bits, &value, sizeof(value));
+      } else {
+        std::uint32_t value_bits;
+        std::memcpy(&value_bits, &x, sizeof(x));
+        bits = value_bits;
+      }
+    } else {
+      const double scale = static_cast<double>((1LL << (width_ - 1)) - 1);
+      std::int64_t value = static_cast<std::int64_t>(x * scale);
+      if (!signed_) {
+        value += 1LL << (width_ - 1);
+      }
+      bits = static_cast<std::uint64_t>(value);
+    }
+    Store(bits, sample_size_, little_endian_, out);
+  }
+}
+
+void PcmFormat::ToFloat(const char* in, std::size_t count, float* out) const {
+  const bool native = little_endian_ == kNativeLittleEndian;
+
+  if (native && !float_ && signed_ && sample_size_ == 2) {
+    const std::int16_t* samples = reinterpret_cast<const std::int16_t*>(in);
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = samples[i] / 32767.0f;
+    }
+    return;
+  }
+  if (native && float_ && sample_size_ == sizeof(float)) {
+    std::memcpy(out, in, count * sizeof(float));
+    return;
+  }
+
+  for (std::size_t i = 0; i < count; ++i, in += sample_size_) {
+    const std::uint64_t bits = Load(in, sample_size_, little_endian_);
+    if (float_) {
+      if (sample_size_ == sizeof(double)) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        out[i] = value;
+      } else {
+        const std::uint32_t value_bits = bits;
+        std::memcpy(&out[i], &value_bits, sizeof(float));
+      }
+    } else {
+      // Sign-extend the sample from the width of the format.
+      std::int64_t value = static_cast<std::int64_t>(bits << (64 - width_)) >>
+                           (64 - width_);
+      if (!signed_) {
+        value = static_cast<std::int64_t>(bits & ((1ULL << width_) - 1)) -
+                (1LL << (width_ - 1));
+      }
+      out[i] = value / static_cast<double>((1LL << (width_ - 1)) - 1);
+    }
+  }
+}
+
+void PcmFormat::FillSilence(char* out, std::size_t count) const {
+  if (signed_ || float_) {
+    std::memset(out, 0, count * sample_size_);
+    return;
+  }
+
+  // Unsigned formats are centered at half their range.
+  const float zero = 0;
+  FromFloat(&zero, 1, out);
+  for (std::size_t i = 1; i < count; ++i) {
+    std::memcpy(out + i * sample_size_, out, sample_size_);
+  }
+}
@@ -0,0 +1,55 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PCM_FORMAT_H_
+#define PCM_FORMAT_H_
+
+#include <cstddef>
+
+#include <alsa/asoundlib.h>
+
+// Conversion of samples between floating point and an ALSA sample format.
+//
+// Audio generated in the server is computed as floating point samples in the
+// range [-1, 1], and converted with this class to whatever sample format the
+// device was opened with: signed or unsigned, 8 to 32 bits, either
+// endianness, or floating point.
+class PcmFormat {
+ public:
+  explicit PcmFormat(snd_pcm_format_t format);
+
+  snd_pcm_format_t format() const { return format_; }
+
+  // Returns the size of one sample in memory, in bytes.
+  std::size_t sample_size() const { return sample_size_; }
+
+  // Converts count samples to this format, clipping them to [-1, 1].
+  void FromFloat(const float* in, std::size_t count, char* out) const;
+
+  // Converts count samples in this format to floating point.
+  void ToFloat(const char* in, std::size_t count, float* out) const;
+
+  // Writes count samples of silence in this format.
+  void FillSilence(char* out, std::size_t count) const;
+
+ private:
+  const snd_pcm_format_t format_;
+  const std::size_t sample_size_;
+  const int width_;
+  const bool signed_;
+  const bool float_;
+  const bool little_endian_;
+};
+
+#endif  // PCM_FORMAT_H_
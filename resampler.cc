@@ -0,0 +1,215 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#warning "SSE is not enabled: the resampler uses its scalar code."
+#endif
+
+constexpr std::size_t Resampler::kMaxPhases;
+
+namespace {
+
+struct QualityPreset {
+  std::size_t taps;
+  // Cutoff frequency, relative to the lowest of the two Nyquist frequencies.
+  double rolloff;
+  // Kaiser window shape.
+  double beta;
+};
+
+const QualityPreset kPresets[] = {
+    {8, 0.80, 5.0},   // LOW
+    {16, 0.90, 7.0},  // MEDIUM
+    {32, 0.94, 9.0},  // HIGH
+};
+
+std::uint64_t Gcd(std::uint64_t a, std::uint64_t b) {
+  while (b != 0) {
+    const std::uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth order modified Bessel function of the first kind.
+double BesselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+double Sinc(double x) {
+  return x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+}
+
+// Returns the dot product of count floats, count being a multiple of four.
+inline float Dot(const float* a, const float* b, std::size_t count) {
+#ifdef __SSE__
+  __m128 sum = _mm_setzero_ps();
+  for (std::size_t i = 0; i < count; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+  float sum[4] = {0, 0, 0, 0};
+  for (std::size_t i = 0; i < count; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      sum[k] += a[i + k] * b[i + k];
+    }
+  }
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+#endif
+}
+
+}  // namespace
+
+Resampler::Resampler(unsigned int input_rate, unsigned int output_rate,
+                     unsigned int channels, Quality quality)
+    : input_rate_(input_rate),
+      output_rate_(output_rate),
+      channels_(channels),
+      history_(channels) {
+  const QualityPreset& preset = kPresets[quality];
+  const std::uint64_t gcd = Gcd(input_rate, output_rate);
+  up_ = output_rate / gcd;
+  down_ = input_rate / gcd;
+
+  // When decimating, the cutoff is lower in terms of input samples, so the
+  // filter needs proportionally more taps for the same transition band. This
+  // also guarantees that one output never skips more than a filter length.
+  taps_ = preset.taps * ((down_ + up_ - 1) / up_);
+  num_phases_ = std::min<std::uint64_t>(up_, kMaxPhases);
+
+  // Windowed sinc filter, with the cutoff below the Nyquist frequency of the
+  // lowest rate, in cycles per input sample.
+  const double cutoff =
+      preset.rolloff * 0.5 * std::min(1.0, static_cast<double>(output_rate) /
+                                               input_rate);
+  const double center = taps_ / 2.0;
+  const double window_scale = 1 / BesselI0(preset.beta);
+
+  coefficients_.resize(num_phases_ * taps_);
+  for (std::size_t phase = 0; phase < num_phases_; ++phase) {
+    // Each phase interpolates at a fraction of an input sample after the
+    // newest input sample it uses.
+    const double fraction = static_cast<double>(phase) / num_phases_;
+    float* c = &coefficients_[phase * taps_];
+    double sum = 0;
+    for (std::size_t i = 0; i < taps_; ++i) {
+      // Distance from the output to the input sample multiplied by c[i].
+      const double t = (taps_ - 1 - i) + fraction;
+      const double x = (t - center) / center;
+      const double window =
+          x * x < 1 ? BesselI0(preset.beta * std::sqrt(1 - x * x)) : 1;
+      const double value =
+          2 * cutoff * Sinc(2 * cutoff * (t - center)) * window * window_scale;
+      c[i] = value;
+      sum += value;
+    }
+    // Unity gain at DC for every phase.
+    for (std::size_t i = 0; i < taps_; ++i) {
+      c[i] /= sum;
+    }
+  }
+
+  Reset();
+}
+
+std::size_t Resampler::MaxOutputFrames(std::size_t input_frames) const {
+  return (input_frames * up_) / down_ + 2;
+}
+
+std::size_t Resampler::Process(const float* in, std::size_t count,
+                               float* out) {
+  for (unsigned int c = 0; c < channels_; ++c) {
+    std::vector<float>& history = history_[c];
+    const std::size_t size = history.size();
+    history.resize(size + count);
+    for (std::size_t i = 0; i < count; ++i) {
+      history[size + i] = in[i * channels_ + c];
+    }
+  }
+
+  const std::size_t available = history_[0].size();
+  const std::size_t step = down_ / up_;
+  const std::uint64_t step_fraction = down_ % up_;
+  std::size_t written = 0;
+  while (index_ < available) {
+    const std::size_t phase =
+        num_phases_ == up_ ? fraction_ : fraction_ * num_phases_ / up_;
+    const float* c = &coefficients_[phase * taps_];
+    for (unsigned int k = 0; k < channels_; ++k) {
+      out[written * channels_ + k] =
+          Dot(c, &history_[k][index_ + 1 - taps_], taps_);
+    }
+    ++written;
+
+    index_ += step;
+    fraction_ += step_fraction;
+    if (fraction_ >= up_) {
+      fraction_ -= up_;
+      ++index_;
+    }
+  }
+
+  // Drop the input that no further output needs.
+  const std::size_t consumed = index_ + 1 - taps_;
+  for (std::vector<float>& history : history_) {
+    history.erase(history.begin(), history.begin() + consumed);
+  }
+  index_ -= consumed;
+  return written;
+}
+
+void Resampler::Reset() {
+  for (std::vector<float>& history : history_) {
+    history.assign(taps_ - 1, 0.0f);
+  }
+  index_ = taps_ - 1;
+  fraction_ = 0;
+}
+
+bool Resampler::ParseQuality(const std::string& name, Quality* quality) {
+  if (name == "low") {
+    *quality = LOW;
+  } else if (name == "medium") {
+    *quality = MEDIUM;
+  } else if (name == "high") {
+    *quality = HIGH;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Resampler::UsesSse() {
+#ifdef __SSE__
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,97 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Polyphase sample rate converter.
+//
+// Converts between any two sample rates by their exact ratio L/M, reduced by
+// their greatest common divisor: the input is conceptually upsampled by L,
+// low-pass filtered and decimated by M, which only requires computing one
+// output sample every M steps with one of the L phases of a windowed sinc
+// filter. Ratios with too many phases use the nearest of kMaxPhases phases.
+// The inner loop is a dot product between the filter phase and the input,
+// computed with SSE when available.
+class Resampler {
+ public:
+  // Quality presets, trading CPU time for a sharper and more attenuated
+  // anti-aliasing filter.
+  enum Quality {
+    LOW,     // 8 taps per phase, when upsampling.
+    MEDIUM,  // 16 taps per phase, when upsampling.
+    HIGH,    // 32 taps per phase, when upsampling.
+  };
+
+  static constexpr std::size_t kMaxPhases = 1024;
+
+  Resampler(unsigned int input_rate, unsigned int output_rate,
+            unsigned int channels, Quality quality = MEDIUM);
+
+  unsigned int input_rate() const { return input_rate_; }
+  unsigned int output_rate() const { return output_rate_; }
+
+  // Returns the delay introduced by the filter, in input frames.
+  std::size_t delay() const { return taps_ / 2; }
+
+  // Returns the maximum number of frames that Process() may write for the
+  // given number of input frames.
+  std::size_t MaxOutputFrames(std::size_t input_frames) const;
+
+  // Converts count interleaved input frames, writing the output frames to
+  // out and returning how many were written. Input frames that are still
+  // needed by the filter are kept for the next call.
+  std::size_t Process(const float* in, std::size_t count, float* out);
+
+  // Forgets the input kept from previous calls.
+  void Reset();
+
+  // Parses the name of a quality preset, "low", "medium" or "high". Returns
+  // false if the name is not valid.
+  static bool ParseQuality(const std::string& name, Quality* quality);
+
+  // Returns whether the dot product of the inner loop is computed with SSE
+  // in this build, rather than with the scalar code.
+  static bool UsesSse();
+
+ private:
+  const unsigned int input_rate_;
+  const unsigned int output_rate_;
+  const unsigned int channels_;
+  std::size_t taps_;
+
+  // Upsampling and decimation factors.
+  std::uint64_t up_;
+  std::uint64_t down_;
+
+  // Filter coefficients, taps_ per phase, in the order of the input samples
+  // they multiply.
+  std::size_t num_phases_;
+  std::vector<float> coefficients_;
+
+  // Input samples of each channel, starting with the taps_ - 1 samples
+  // before the next output, and position of the next output: the index of
+  // the newest input sample it uses, plus a fraction in units of 1/up_
+  // input samples.
+  std::vector<std::vector<float>> history_;
+  std::size_t index_ = 0;
+  std::uint64_t fraction_ = 0;
+};
+
+#endif  // RESAMPLER_H_
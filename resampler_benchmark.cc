@@ -0,0 +1,128 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the CPU time the Resampler spends per second of speech, for each
+// quality preset, converting from a synthesis rate of the speech engine to a
+// usual device rate, and reports whether the dot product uses SSE, e.g.:
+//
+//   resampler_benchmark --from 22050 --to 48000 --seconds 60
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "resampler.h"
+
+namespace po = boost::program_options;
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+namespace {
+
+// Number of input frames converted at once, about the size of a buffer of
+// the speech engine.
+const std::size_t kBlockFrames = 1024;
+
+// Resamples the given duration of a tone, returning the CPU time it took in
+// seconds.
+double Run(unsigned int from, unsigned int to, Resampler::Quality quality,
+           double seconds) {
+  Resampler resampler(from, to, 1, quality);
+
+  // One second of a tone, converted over and over, so only the resampler
+  // is measured.
+  std::vector<float> in((from / kBlockFrames + 1) * kBlockFrames);
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    in[i] = 0.5 * std::sin(2 * M_PI * 440.0 * i / from);
+  }
+  std::vector<float> out(resampler.MaxOutputFrames(kBlockFrames));
+  const std::size_t total_frames = seconds * from;
+  float checksum = 0;
+
+  const std::clock_t cpu_start = std::clock();
+  for (std::size_t t = 0; t < total_frames; t += kBlockFrames) {
+    const std::size_t written = resampler.Process(
+        &in[t % in.size()], kBlockFrames, out.data());
+    if (written > 0) checksum += out[written - 1];
+  }
+  const double cpu_seconds =
+      static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  // Keeps the compiler from optimizing the work away.
+  if (checksum == 12345) cout << "";
+  return cpu_seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  /* clang-format off */
+  po::options_description options("Benchmark options");
+  options.add_options()
+      ("help,h", "Display this help message.")
+      ("from", po::value<unsigned int>()->value_name("hz"),
+       "Input sample rate (default: 11025).")
+      ("to", po::value<unsigned int>()->value_name("hz"),
+       "Output sample rate (default: 48000).")
+      ("seconds", po::value<double>()->value_name("seconds"),
+       "Duration of the audio converted with each preset (default: 60).");
+  /* clang-format on */
+
+  po::variables_map args;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), args);
+    po::notify(args);
+  } catch (po::error& e) {
+    cerr << "Error parsing command line options:\n" << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (args.count("help")) {
+    cerr << options << "\n";
+    return EXIT_SUCCESS;
+  }
+
+  const unsigned int from =
+      args.count("from") ? args["from"].as<unsigned int>() : 11025;
+  const unsigned int to =
+      args.count("to") ? args["to"].as<unsigned int>() : 48000;
+  const double seconds =
+      args.count("seconds") ? args["seconds"].as<double>() : 60.0;
+
+  const struct {
+    const char* name;
+    Resampler::Quality quality;
+  } kPresets[] = {
+      {"low", Resampler::LOW},
+      {"medium", Resampler::MEDIUM},
+      {"high", Resampler::HIGH},
+  };
+  cout << "Dot product: " << (Resampler::UsesSse() ? "SSE" : "scalar")
+       << "." << std::endl;
+  for (const auto& preset : kPresets) {
+    const double cpu_seconds = Run(from, to, preset.quality, seconds);
+    cout << preset.name << ": " << from << "Hz to " << to << "Hz, "
+         << 1000 * cpu_seconds / seconds << "ms of CPU per second of audio."
+         << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
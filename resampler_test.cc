@@ -0,0 +1,125 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "resampler.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Resamples a sine wave in blocks of odd sizes, and returns the error of the
+// output compared to the ideal sine wave at the output rate, in dB relative
+// to the amplitude of the sine.
+double SineError(unsigned int input_rate, unsigned int output_rate,
+                 double frequency, Resampler::Quality quality,
+                 std::size_t* output_frames) {
+  Resampler resampler(input_rate, output_rate, 1, quality);
+  const std::size_t frames = input_rate;
+  std::vector<float> in(frames);
+  for (std::size_t i = 0; i < frames; ++i) {
+    in[i] = 0.5 * std::sin(2 * M_PI * frequency * i / input_rate);
+  }
+
+  std::vector<float> out(resampler.MaxOutputFrames(frames) + 1000);
+  std::size_t written = 0;
+  for (std::size_t i = 0; i < frames;) {
+    const std::size_t count = std::min<std::size_t>(frames - i, 97);
+    written += resampler.Process(&in[i], count, &out[written]);
+    i += count;
+  }
+  *output_frames = written;
+
+  // Skip the start of the output, where the filter is filling up, and
+  // compensate the delay of the filter.
+  const double delay =
+      static_cast<double>(resampler.delay()) * output_rate / input_rate;
+  double error = 0;
+  std::size_t count = 0;
+  for (std::size_t j = output_rate / 10; j < written - output_rate / 10;
+       ++j) {
+    const double t = (j - delay) / output_rate;
+    const double expected = 0.5 * std::sin(2 * M_PI * frequency * t);
+    error = std::max(error, std::fabs(out[j] - expected));
+    ++count;
+  }
+  return 20 * std::log10(error / 0.5);
+}
+
+int main() {
+  std::size_t frames = 0;
+
+  double error = SineError(11025, 48000, 1000, Resampler::MEDIUM, &frames);
+  Check("11025 to 48000 Hz, error in dB", error < -40, error);
+  Check("11025 to 48000 Hz, frames", frames >= 47980 && frames <= 48000,
+        frames);
+
+  error = SineError(22050, 44100, 3000, Resampler::HIGH, &frames);
+  Check("22050 to 44100 Hz, error in dB", error < -60, error);
+
+  error = SineError(22050, 47999, 1000, Resampler::HIGH, &frames);
+  Check("Ratio with more than the maximum phases, error in dB", error < -60,
+        error);
+
+  error = SineError(48000, 11025, 1000, Resampler::MEDIUM, &frames);
+  Check("48000 to 11025 Hz, error in dB", error < -40, error);
+
+  {
+    // A tone above the Nyquist frequency of the output must be filtered out.
+    Resampler resampler(48000, 8000, 1, Resampler::HIGH);
+    std::vector<float> in(48000);
+    for (std::size_t i = 0; i < in.size(); ++i) {
+      in[i] = std::sin(2 * M_PI * 6000 * i / 48000.0);
+    }
+    std::vector<float> out(resampler.MaxOutputFrames(in.size()));
+    const std::size_t written = resampler.Process(in.data(), in.size(),
+                                                  out.data());
+    double peak = 0;
+    for (std::size_t j = 800; j < written; ++j) {
+      peak = std::max(peak, std::fabs(static_cast<double>(out[j])));
+    }
+    const double attenuation = 20 * std::log10(peak);
+    Check("Aliasing attenuation in dB", attenuation < -60, attenuation);
+  }
+
+  {
+    Resampler resampler(8000, 22050, 2, Resampler::LOW);
+    std::vector<float> in(2000, 0.25f);
+    for (std::size_t i = 1; i < in.size(); i += 2) in[i] = -0.5f;
+    std::vector<float> out(2 * resampler.MaxOutputFrames(1000));
+    const std::size_t written = resampler.Process(in.data(), 1000,
+                                                  out.data());
+    const float left = out[2 * (written - 1)];
+    const float right = out[2 * (written - 1) + 1];
+    Check("Unity gain on both channels",
+          std::fabs(left - 0.25f) < 1e-5 && std::fabs(right + 0.5f) < 1e-5,
+          left);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <chrono>
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
 
@@ -20,8 +21,15 @@
 
 #include "alsa_player.h"
 #include "audio_manager.h"
+#include "buffer_tuner.h"
 #include "eci-c++.h"
+#include "file_sink.h"
+#include "metrics.h"
+#include "null_sink.h"
+#include "resampler.h"
 #include "speech_server.h"
+#include "threaded_sink.h"
+#include "tracer.h"
 #include "tts.h"
 
 namespace po = boost::program_options;
@@ -38,25 +46,146 @@ po::options_description GetOptionsDescription() {
       ("eci-library", po::value<string>()->value_name("path"),
        "Path to libibmeci.so library file to load.")
       ("default_language,L", po::value<string>()->value_name("language"),
-       "Default language to load the speech server. Choose between [en_US|en_GB|es_ES|es_MX|fr_FR|fr_CA|de_DE|it_IT|pt_BR|fi_FI].");
+       "Default language to load the speech server. Choose between [en_US|en_GB|es_ES|es_MX|fr_FR|fr_CA|de_DE|it_IT|pt_BR|fi_FI].")
+      ("preload-languages",
+       "Initialize the engines of all available languages at startup, instead "
+       "of the first time each language is selected.")
+      ("listen", po::value<string>()->value_name("path"),
+       "Also accept clients on a Unix domain socket at the given path. Each "
+       "client has its own settings and queue, and all of them share the "
+       "speech engines and the audio output, taking turns. The server keeps "
+       "running after the end of the standard input.")
+      ("queue-max-bytes", po::value<std::size_t>()->value_name("bytes"),
+       "Limit the text each client has queued for speech, beyond the "
+       "utterance being spoken, to the given number of bytes.")
+      ("queue-max-seconds", po::value<double>()->value_name("seconds"),
+       "Limit the speech each client has queued, beyond the utterance being "
+       "spoken, to the given estimated duration.")
+      ("queue-policy", po::value<string>()->value_name("policy"),
+       "What to do when a client goes over the limits of its queue, "
+       "[drop-oldest|keep-latest|summarize]. drop-oldest removes the oldest "
+       "queued speech until the rest fits, keep-latest removes everything "
+       "but the latest text, and summarize removes the oldest speech as "
+       "drop-oldest but says how many lines were skipped. Defaults to "
+       "drop-oldest.")
+      ("metrics-file", po::value<string>()->value_name("file"),
+       "Write the metrics of the server to the given file periodically, in "
+       "the Prometheus text format, replacing it at once. The metrics are "
+       "also written by the tts_stats command.")
+      ("metrics-interval", po::value<double>()->value_name("seconds"),
+       "How often to write the metrics file. Defaults to 10 seconds.")
+      ("metrics-socket", po::value<string>()->value_name("path"),
+       "Write the metrics of the server, in the Prometheus text format, to "
+       "every client that connects to a Unix domain socket at the given "
+       "path.")
+      ("trace-file", po::value<string>()->value_name("file"),
+       "Trace the lifecycle of every statement, from the moment it is read "
+       "to the end of its audio, to the given file in the Chrome trace-event "
+       "format, which chrome://tracing and Perfetto open.")
+      ("trace-ring", po::value<std::size_t>()->value_name("events"),
+       "Instead of writing all the events to the trace file, keep only the "
+       "given number of latest events in memory, and write them to the file "
+       "when the server gets SIGUSR1. Requires --trace-file.");
 
   po::options_description audio_options("Audio options");
   audio_options.add_options()
       ("device,D", po::value<string>()->value_name("name"),
        "ALSA device to play audio output.")
       ("rate,r", po::value<unsigned int>()->value_name("hz"),
-       "Audio sample rate.")
+       "Audio sample rate. Speech is resampled if the rate is not supported by "
+       "ECI (8000, 11025 or 22050Hz), so the device can be opened at its "
+       "native rate, e.g. 48000Hz.")
+      ("resample-quality", po::value<string>()->value_name("quality"),
+       "Quality of the resampling of speech, [low|medium|high]. Defaults to "
+       "medium.")
+      ("trim-silence",
+       "Remove the silence that the speech engine adds at the start and at "
+       "the end of each utterance, keeping the pauses within it.")
+      ("trim-leading", po::value<unsigned int>()->value_name("ms"),
+       "Maximum silence removed from the start of each utterance. Defaults "
+       "to 200ms. Implies --trim-silence.")
+      ("trim-trailing", po::value<unsigned int>()->value_name("ms"),
+       "Maximum silence removed from the end of each utterance. Defaults to "
+       "200ms. Implies --trim-silence.")
+      ("silence-threshold", po::value<double>()->value_name("db"),
+       "Level below which speech is silence, in dBFS. Defaults to -50.")
       ("realtime",
        "Force a small buffer size, equivalent to --buffer-time=0.025.")
       ("buffer-time", po::value<double>()->value_name("seconds"),
        "Set the desired audio buffer time in seconds, which also affects the "
-       "maximum audio latency.");
+       "maximum audio latency.")
+      ("adaptive-buffer",
+       "Adjust the audio buffer time between utterances, shrinking it toward "
+       "the lowest latency that plays without underruns, and growing it back "
+       "after an underrun. Starts from --buffer-time, if given.")
+      ("icon-dir", po::value<string>()->value_name("dir"),
+       "Decode all the auditory icons of the given directory at startup, so "
+       "playing them never waits for the disk.")
+      ("icon-volume", po::value<float>()->value_name("gain"),
+       "Volume of the auditory icons mixed over speech, from 0 to 1.")
+      ("urgent-letters",
+       "Speak the letters echoed while typing at once, interrupting the "
+       "utterance being played, which continues afterwards from the "
+       "interrupted word. By default, letters wait for the end of the "
+       "utterance, but not for the rest of the queued speech.")
+      ("audio-thread",
+       "Play the audio from a thread of its own, fed by the main loop through "
+       "a buffer as large as the buffer of the device, so a busy main loop "
+       "does not make the device underrun. The thread runs with real-time "
+       "priority and the memory of the server is locked, when permitted. The "
+       "audio of that buffer is dropped on a stop, so stopping takes no "
+       "longer.")
+      ("audio-priority", po::value<int>()->value_name("priority"),
+       "SCHED_FIFO priority of the audio thread, from 1 to 99, or 0 to run it "
+       "with the normal policy. Defaults to 50. Implies --audio-thread.")
+      ("audio-cpu", po::value<int>()->value_name("cpu"),
+       "Pin the audio thread to the given CPU. Implies --audio-thread.")
+      ("control-cpu", po::value<int>()->value_name("cpu"),
+       "Pin the main thread, which reads commands and runs the speech "
+       "engine, to the given CPU.")
+      ("mmap",
+       "Write audio directly into the sound device buffer through mmap, when "
+       "supported by the device.")
+      ("render-to", po::value<string>()->value_name("file"),
+       "Instead of playing audio on a sound device, render it to the given "
+       "file as fast as possible, in WAV format if the file name ends in .wav, "
+       "or as raw samples otherwise. Reports the real-time factor on exit.")
+      ("null-output", po::value<string>()->value_name("clock"),
+       "Instead of playing audio on a sound device, discard it as a device "
+       "would play it, on a [realtime|virtual] clock. The virtual clock only "
+       "advances when the device buffer is full, so audio is produced as fast "
+       "as possible.");
   options.add(audio_options);
 
   /* clang-format on */
   return options;
 }
 
+// Reports how long the tasks of each lane of the audio manager waited.
+void ReportLanes(const AudioManager& audio) {
+  for (int i = 0; i < AudioManager::kNumLanes; ++i) {
+    const AudioManager::Lane lane = static_cast<AudioManager::Lane>(i);
+    const AudioManager::LaneStats stats = audio.lane_stats(lane);
+    if (stats.pushed == 0) continue;
+
+    cerr << "AudioManager: " << stats.pushed << " "
+         << AudioManager::GetLaneName(lane) << " task(s) waited "
+         << stats.total_wait.count() / stats.pushed / 1000.0
+         << "ms on average and " << stats.max_wait.count() / 1000.0
+         << "ms at most, up to " << stats.max_depth << " queued";
+    if (stats.preempted > 0) {
+      cerr << ", " << stats.preempted << " interrupted";
+    }
+    if (stats.dropped > 0) {
+      cerr << ", " << stats.dropped << " dropped";
+    }
+    if (stats.merged > 0) {
+      cerr << ", " << stats.merged << " skipped with a notice";
+    }
+    cerr << "." << std::endl;
+  }
+}
+
 int main(int argc, char** argv) {
   po::options_description options = GetOptionsDescription();
   po::variables_map args;
@@ -107,6 +236,9 @@ int main(int argc, char** argv) {
     }
   }
 
+  tts_options.preload_languages = args.count("preload-languages");
+  tts_options.verbose = verbose;
+
   // Initialize the ALSA player.
   alsa_options.verbose = verbose;
   if (args.count("device")) {
@@ -119,11 +251,39 @@ int main(int argc, char** argv) {
       tts_options.sample_rate =
           TTS::GetSampleRateConfig(alsa_options.sample_rate);
     } catch (TTSError& e) {
-      cerr << "Error: The selected sample rate "
-           << "(" << alsa_options.sample_rate << "Hz) "
-           << "is not supported by ECI. Expect distorted sound." << std::endl;
+      // Speech is synthesized at the highest rate supported by ECI, and
+      // resampled to the rate of the device.
+      tts_options.sample_rate = TTS::R_22050;
+      if (verbose) {
+        cerr << "Resampling speech from 22050Hz to "
+             << alsa_options.sample_rate << "Hz." << std::endl;
+      }
     }
   }
+  if (args.count("resample-quality") &&
+      !Resampler::ParseQuality(args["resample-quality"].as<string>(),
+                               &tts_options.resample_quality)) {
+    cerr << "Invalid resampling quality, choose between [low|medium|high]."
+         << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  SilenceTrimmer::Options& trim_options = tts_options.trim_options;
+  tts_options.trim_silence = args.count("trim-silence") ||
+                             args.count("trim-leading") ||
+                             args.count("trim-trailing");
+  if (args.count("trim-leading")) {
+    trim_options.max_leading =
+        std::chrono::milliseconds(args["trim-leading"].as<unsigned int>());
+  }
+  if (args.count("trim-trailing")) {
+    trim_options.max_trailing =
+        std::chrono::milliseconds(args["trim-trailing"].as<unsigned int>());
+  }
+  if (args.count("silence-threshold")) {
+    trim_options.threshold_db = args["silence-threshold"].as<double>();
+  }
+  trim_options.log = verbose;
 
   if (args.count("realtime")) {
     alsa_options.buffer_time = std::chrono::milliseconds(25);
@@ -134,16 +294,165 @@ int main(int argc, char** argv) {
         std::chrono::duration_cast<std::chrono::microseconds>(duration);
   }
 
-  std::unique_ptr<AlsaPlayer> alsa_player(new AlsaPlayer(alsa_options));
+  alsa_options.mmap = args.count("mmap");
+
+  std::unique_ptr<BufferTuner> buffer_tuner;
+  if (args.count("adaptive-buffer") && !args.count("render-to")) {
+    buffer_tuner.reset(new BufferTuner(
+        alsa_options.buffer_time > std::chrono::microseconds(0)
+            ? alsa_options.buffer_time
+            : std::chrono::milliseconds(100)));
+    alsa_options.buffer_time = buffer_tuner->buffer_time();
+  }
+
+  std::unique_ptr<AudioSink> sink;
+  FileSink* file_sink = nullptr;
+  if (args.count("render-to")) {
+    file_sink = new FileSink(args["render-to"].as<string>(),
+                             alsa_options.sample_format,
+                             alsa_options.sample_rate, alsa_options.channels);
+    sink.reset(file_sink);
+  } else if (args.count("null-output")) {
+    NullSink::Options null_options;
+    null_options.verbose = verbose;
+    null_options.sample_format = alsa_options.sample_format;
+    null_options.sample_rate = alsa_options.sample_rate;
+    null_options.channels = alsa_options.channels;
+    if (alsa_options.buffer_time > std::chrono::microseconds(0)) {
+      null_options.buffer_time = alsa_options.buffer_time;
+    }
+    const string clock = args["null-output"].as<string>();
+    if (clock == "realtime") {
+      null_options.clock = NullSink::REAL_TIME;
+    } else if (clock == "virtual") {
+      null_options.clock = NullSink::VIRTUAL;
+    } else {
+      cerr << "Invalid clock, choose between [realtime|virtual]." << std::endl;
+      return EXIT_FAILURE;
+    }
+    sink.reset(new NullSink(null_options));
+  } else {
+    sink.reset(new AlsaPlayer(alsa_options));
+  }
+  const bool offline = sink->offline();
+
+  if (!offline && (args.count("audio-thread") || args.count("audio-priority") ||
+                   args.count("audio-cpu"))) {
+    ThreadedSink::Options thread_options;
+    thread_options.verbose = verbose;
+    if (args.count("audio-priority")) {
+      thread_options.priority = args["audio-priority"].as<int>();
+    }
+    if (args.count("audio-cpu")) {
+      thread_options.cpu = args["audio-cpu"].as<int>();
+    }
+    sink.reset(new ThreadedSink(std::move(sink), thread_options));
+  }
+
+  // Pinned once the audio thread exists, so it does not inherit the CPU.
+  if (args.count("control-cpu") &&
+      !ThreadedSink::PinThread(args["control-cpu"].as<int>())) {
+    cerr << "Failed to pin the main thread to CPU "
+         << args["control-cpu"].as<int>() << "." << std::endl;
+  }
 
   // Initialize the audio manager and the TTS manager.
-  AudioManager audio(std::move(alsa_player));
+  AudioManager audio(std::move(sink));
+  audio.set_buffer_tuner(std::move(buffer_tuner));
   TTS tts(&audio, tts_options);
 
+  AudioManager::QueueBudget budget;
+  if (args.count("queue-max-bytes")) {
+    budget.max_bytes = args["queue-max-bytes"].as<std::size_t>();
+  }
+  if (args.count("queue-max-seconds")) {
+    std::chrono::duration<double> duration(
+        args["queue-max-seconds"].as<double>());
+    budget.max_duration =
+        std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+  }
+  if (args.count("queue-policy") &&
+      !AudioManager::ParsePolicy(args["queue-policy"].as<string>(),
+                                 &budget.policy)) {
+    cerr << "Invalid queue policy, choose between "
+         << "[drop-oldest|keep-latest|summarize]." << std::endl;
+    return EXIT_FAILURE;
+  }
+  budget.make_notice = [&tts](std::size_t skipped) {
+    return std::unique_ptr<AudioTask>(tts.MakeNotice(
+        std::to_string(skipped) + (skipped == 1 ? " line" : " lines") +
+        " skipped"));
+  };
+  audio.set_budget(budget);
+  audio.ExportMetrics(Metrics::Default());
+
+  MetricsExporter::Options metrics_options;
+  if (args.count("metrics-file")) {
+    metrics_options.file = args["metrics-file"].as<string>();
+  }
+  if (args.count("metrics-interval")) {
+    std::chrono::duration<double> interval(
+        args["metrics-interval"].as<double>());
+    if (interval.count() <= 0) {
+      cerr << "The metrics interval must be positive." << std::endl;
+      return EXIT_FAILURE;
+    }
+    metrics_options.interval =
+        std::chrono::duration_cast<std::chrono::milliseconds>(interval);
+  }
+  if (args.count("metrics-socket")) {
+    metrics_options.socket_path = args["metrics-socket"].as<string>();
+  }
+
   // Run the speech server.
+  Tracer::Options trace_options;
+  if (args.count("trace-file")) {
+    trace_options.file = args["trace-file"].as<string>();
+  }
+  if (args.count("trace-ring")) {
+    trace_options.ring_size = args["trace-ring"].as<std::size_t>();
+    if (trace_options.file.empty() || trace_options.ring_size == 0) {
+      cerr << "--trace-ring requires --trace-file and a positive number of "
+           << "events." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
   try {
+    std::unique_ptr<Tracer> tracer;
+    if (!trace_options.file.empty()) {
+      tracer.reset(new Tracer(trace_options));
+      Tracer::Install(tracer.get());
+    }
+
     SpeechServer speech_server(&audio, &tts);
+    if (tracer != nullptr && trace_options.ring_size > 0) {
+      speech_server.DumpTraceOnSignal(tracer.get(), SIGUSR1);
+    }
     speech_server.set_verbose(verbose);
+    speech_server.set_finish_on_eof(offline);
+    speech_server.set_urgent_letters(args.count("urgent-letters"));
+    if (args.count("listen")) {
+      speech_server.Listen(args["listen"].as<string>());
+    }
+    if (!metrics_options.file.empty() ||
+        !metrics_options.socket_path.empty()) {
+      speech_server.ExportMetrics(metrics_options);
+    }
+    if (args.count("icon-volume")) {
+      speech_server.set_icon_gain(args["icon-volume"].as<float>());
+    }
+
+    if (args.count("icon-dir")) {
+      IconCache* icons = speech_server.icon_cache();
+      const std::size_t loaded =
+          icons->Preload(args["icon-dir"].as<string>());
+      if (verbose) {
+        cerr << "Loaded " << loaded << " auditory icons, using "
+             << icons->memory() / 1024 << " KiB.\n";
+      }
+    }
 
     speech_server.MainLoop();
   } catch (std::exception& e) {
@@ -152,5 +461,24 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  if (file_sink != nullptr) {
+    file_sink->Drain();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_time;
+    const double audio_seconds = file_sink->duration().count();
+    cerr << "Rendered " << audio_seconds << "s of audio in "
+         << elapsed.count() << "s";
+    if (audio_seconds > 0) {
+      cerr << " (real-time factor " << elapsed.count() / audio_seconds
+           << ", " << audio_seconds / elapsed.count()
+           << "x faster than real time)";
+    }
+    cerr << "." << std::endl;
+  }
+
+  if (verbose) {
+    ReportLanes(audio);
+  }
+
   return EXIT_SUCCESS;
 }
@@ -19,8 +19,11 @@
 
 using std::string;
 
-ServerState::ServerState(AudioManager* audio)
-    : audio_(audio), text_formatter_(new ECITextFormatter()) {}
+ServerState::ServerState(AudioManager* audio, TextFormatter* text_formatter,
+                         IconCache* icon_cache)
+    : audio_(audio),
+      text_formatter_(text_formatter),
+      icon_cache_(icon_cache) {}
 
 void ServerState::ClearQueue() {
   if (queue_.size() == 0) {
@@ -21,11 +21,17 @@
 
 #include "audio_manager.h"
 #include "audio_tasks.h"
+#include "icon_cache.h"
 #include "text_formatter.h"
+#include "tts.h"
 
+// State of the server for one client: its settings and the tasks it queued
+// and did not dispatch yet. The text formatter and the icon cache are shared
+// by all clients.
 class ServerState {
  public:
-  explicit ServerState(AudioManager* audio);
+  ServerState(AudioManager* audio, TextFormatter* text_formatter,
+              IconCache* icon_cache);
   ~ServerState() = default;
 
   AudioManager* audio() { return audio_; }
@@ -33,11 +39,23 @@ class ServerState {
 
   void ClearQueue();
 
-  TextFormatter* text_formatter() { return text_formatter_.get(); }
+  TextFormatter* text_formatter() { return text_formatter_; }
+
+  // Cache of the auditory icons, in the output format of the audio player.
+  IconCache* icon_cache() { return icon_cache_; }
+
+  // Gain of the auditory icons mixed over speech, between 0 and 1.
+  float icon_gain() const { return icon_gain_; }
+  void set_icon_gain(float value) { icon_gain_ = value; }
 
   bool verbose() const { return verbose_; }
   void set_verbose(bool value) { verbose_ = value; }
 
+  // Whether letters interrupt the utterance being played, instead of waiting
+  // for its end.
+  bool urgent_letters() const { return urgent_letters_; }
+  void set_urgent_letters(bool value) { urgent_letters_ = value; }
+
   TextFormatter::PunctuationMode punctuation_mode() const {
     return punctuation_mode_;
   }
@@ -64,13 +82,25 @@ class ServerState {
     tts_allcaps_beep_ = tts_allcaps_beep;
   }
 
+  // Speech rate, voice and language of the client, given to the TTS while
+  // its commands run.
+  int speech_rate() const { return speech_rate_; }
+  void set_speech_rate(int speech_rate) { speech_rate_ = speech_rate; }
+  TTS::ECIVoiceAnnotation voice() const { return voice_; }
+  void set_voice(TTS::ECIVoiceAnnotation voice) { voice_ = voice; }
+  ECILanguageDialect language() const { return language_; }
+  void set_language(ECILanguageDialect language) { language_ = language; }
+
  private:
   AudioManager* audio_;
   std::queue<std::unique_ptr<AudioTask>> queue_;
 
-  std::unique_ptr<TextFormatter> text_formatter_;
+  TextFormatter* text_formatter_;
+  IconCache* icon_cache_;
 
   bool verbose_ = false;
+  bool urgent_letters_ = false;
+  float icon_gain_ = 1.0f;
   TextFormatter::PunctuationMode punctuation_mode_ = TextFormatter::ALL;
 
   // Set state of split caps processing. Set this to true to
@@ -84,6 +114,10 @@ class ServerState {
   //         words that are in
   //  all-caps, e.g. abbreviations.
   bool tts_allcaps_beep_ = false;
+
+  int speech_rate_ = 50;
+  TTS::ECIVoiceAnnotation voice_ = TTS::DEFAULT_VOICE;
+  ECILanguageDialect language_ = eciGeneralAmericanEnglish;
 };
 
 #endif  // SERVER_STATE_H_
@@ -0,0 +1,188 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "silence_trimmer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#warning "SSE2 is not enabled: the silence trimmer uses its scalar code."
+#endif
+
+constexpr int SilenceTrimmer::kBlockMs;
+
+namespace {
+
+// Returns the sum of the squares of count samples.
+std::uint64_t SumOfSquares(const short* samples, std::size_t count) {
+  std::uint64_t sum = 0;
+  std::size_t i = 0;
+#ifdef __SSE2__
+  // Each pair of squares fits in 32 bits once -32768 is clamped, and the
+  // pairs are accumulated in 64 bits.
+  const __m128i min = _mm_set1_epi16(-32767);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 8 <= count; i += 8) {
+    __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+    x = _mm_max_epi16(x, min);
+    const __m128i squares = _mm_madd_epi16(x, x);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(squares, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(squares, zero));
+  }
+  std::uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < count; ++i) {
+    const std::int32_t x = std::max<std::int32_t>(samples[i], -32767);
+    sum += static_cast<std::uint64_t>(x * x);
+  }
+  return sum;
+}
+
+}  // namespace
+
+SilenceTrimmer::SilenceTrimmer(unsigned int sample_rate,
+                               const Options& options)
+    : options_(options),
+      sample_rate_(sample_rate),
+      block_size_(std::max(1u, sample_rate * kBlockMs / 1000)),
+      max_leading_(ToSamples(options.max_leading)),
+      max_trailing_(ToSamples(options.max_trailing)),
+      margin_(ToSamples(options.margin)) {
+  const double amplitude = 32767 * std::pow(10.0, options.threshold_db / 20);
+  threshold_ = amplitude * amplitude * block_size_;
+  block_.reserve(block_size_);
+}
+
+std::size_t SilenceTrimmer::ToSamples(
+    std::chrono::milliseconds duration) const {
+  return duration.count() * sample_rate_ / 1000;
+}
+
+void SilenceTrimmer::BeginUtterance() {
+  speaking_ = false;
+  block_.clear();
+  held_.clear();
+  leading_removed_ = 0;
+  trailing_removed_ = 0;
+}
+
+const short* SilenceTrimmer::Process(const short* in, std::size_t count,
+                                     std::size_t* out_count) {
+  output_.clear();
+
+  // Complete the block started by the previous call.
+  if (!block_.empty()) {
+    const std::size_t fill = std::min(count, block_size_ - block_.size());
+    block_.insert(block_.end(), in, in + fill);
+    in += fill;
+    count -= fill;
+    if (block_.size() < block_size_) {
+      *out_count = 0;
+      return output_.data();
+    }
+    AddBlock(block_.data(), block_.size());
+    block_.clear();
+  }
+
+  for (; count >= block_size_; in += block_size_, count -= block_size_) {
+    AddBlock(in, block_size_);
+  }
+  block_.assign(in, in + count);
+
+  *out_count = output_.size();
+  return output_.data();
+}
+
+const short* SilenceTrimmer::EndUtterance(std::size_t* out_count) {
+  output_.clear();
+  if (!block_.empty()) {
+    AddBlock(block_.data(), block_.size());
+    block_.clear();
+  }
+
+  // Trailing silence, or a silent utterance, keeps only the margin.
+  const std::size_t kept = std::min(held_.size(), margin_);
+  if (speaking_) {
+    trailing_removed_ += held_.size() - kept;
+    total_removed_ += held_.size() - kept;
+  }
+  Release(kept);
+  held_.clear();
+
+  if (options_.log && (leading_removed_ > 0 || trailing_removed_ > 0)) {
+    std::cerr << "SilenceTrimmer: Removed "
+              << leading_removed_ * 1000 / sample_rate_ << "ms of leading and "
+              << trailing_removed_ * 1000 / sample_rate_
+              << "ms of trailing silence." << std::endl;
+  }
+  leading_removed_ = 0;
+  trailing_removed_ = 0;
+
+  *out_count = output_.size();
+  return output_.data();
+}
+
+std::chrono::milliseconds SilenceTrimmer::saved() const {
+  return std::chrono::milliseconds(total_removed_ * 1000 / sample_rate_);
+}
+
+void SilenceTrimmer::AddBlock(const short* samples, std::size_t count) {
+  const bool silent =
+      SumOfSquares(samples, count) * block_size_ <= threshold_ * count;
+
+  if (!silent) {
+    // The held silence was a pause within the speech.
+    Release(held_.size());
+    output_.insert(output_.end(), samples, samples + count);
+    speaking_ = true;
+    return;
+  }
+
+  held_.insert(held_.end(), samples, samples + count);
+  if (!speaking_) {
+    // Leading silence, of which only the margin is kept.
+    if (held_.size() <= margin_) return;
+    const std::size_t excess = held_.size() - margin_;
+    const std::size_t removed =
+        std::min(excess, max_leading_ - leading_removed_);
+    Drop(removed);
+    leading_removed_ += removed;
+    total_removed_ += removed;
+    if (removed < excess) {
+      // The maximum was removed, the rest of the silence is played.
+      Release(excess - removed);
+      speaking_ = true;
+    }
+  } else if (held_.size() > margin_ + max_trailing_) {
+    // More silence than can be removed, the oldest part is played.
+    Release(held_.size() - margin_ - max_trailing_);
+  }
+}
+
+void SilenceTrimmer::Release(std::size_t count) {
+  output_.insert(output_.end(), held_.begin(), held_.begin() + count);
+  held_.erase(held_.begin(), held_.begin() + count);
+}
+
+void SilenceTrimmer::Drop(std::size_t count) {
+  held_.erase(held_.begin(), held_.begin() + count);
+}
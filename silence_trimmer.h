@@ -0,0 +1,122 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SILENCE_TRIMMER_H_
+#define SILENCE_TRIMMER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Removes the silence padding at the start and at the end of each utterance
+// of the speech engine.
+//
+// The engine output is classified in blocks of kBlockMs by their energy.
+// Silent blocks before the first loud one are dropped, and silent blocks
+// after a loud one are held back until either speech resumes, in which case
+// they were a pause and are played, or the utterance ends, in which case they
+// are dropped. A short margin of silence is always kept next to the speech,
+// so soft onsets and decays are not cut, and at most the configured amount of
+// silence is removed from each end, so holding it back never delays the
+// speech by more than that.
+class SilenceTrimmer {
+ public:
+  struct Options {
+    Options() noexcept {}
+
+    // Level below which a block is silence, in dB relative to full scale.
+    double threshold_db = -50;
+
+    // Maximum silence removed from the start and from the end of each
+    // utterance.
+    std::chrono::milliseconds max_leading = std::chrono::milliseconds(200);
+    std::chrono::milliseconds max_trailing = std::chrono::milliseconds(200);
+
+    // Silence kept next to the speech.
+    std::chrono::milliseconds margin = std::chrono::milliseconds(10);
+
+    // Whether to report the silence removed from each utterance to stderr.
+    bool log = false;
+  };
+
+  static constexpr int kBlockMs = 5;
+
+  explicit SilenceTrimmer(unsigned int sample_rate,
+                          const Options& options = Options());
+
+  // Starts a new utterance, dropping anything held from the previous one.
+  void BeginUtterance();
+
+  // Trims count samples. Returns the samples to play, which remain valid
+  // until the next call, and sets *out_count to their number.
+  const short* Process(const short* in, std::size_t count,
+                       std::size_t* out_count);
+
+  // Ends the utterance. Returns the last samples to play, as Process() does.
+  const short* EndUtterance(std::size_t* out_count);
+
+  // Returns the maximum number of samples that Process() may return for the
+  // given number of input samples.
+  std::size_t MaxOutputSamples(std::size_t count) const {
+    return held_.size() + block_.size() + count;
+  }
+
+  // Returns the maximum number of samples that may be held at any time.
+  std::size_t MaxHeldSamples() const {
+    return margin_ + std::max(max_leading_, max_trailing_) + 2 * block_size_;
+  }
+
+  // Returns the total duration of silence removed so far.
+  std::chrono::milliseconds saved() const;
+
+ private:
+  // Classifies one block and moves it to the output or to the held silence.
+  void AddBlock(const short* samples, std::size_t count);
+
+  // Moves the first count held samples to the output.
+  void Release(std::size_t count);
+
+  // Drops the first count held samples.
+  void Drop(std::size_t count);
+
+  std::size_t ToSamples(std::chrono::milliseconds duration) const;
+
+  const Options options_;
+  const unsigned int sample_rate_;
+  const std::size_t block_size_;
+  const std::size_t max_leading_;
+  const std::size_t max_trailing_;
+  const std::size_t margin_;
+
+  // Maximum sum of squares of a silent block.
+  std::uint64_t threshold_;
+
+  // Whether a loud block was seen in the current utterance, or the maximum
+  // leading silence was already removed.
+  bool speaking_ = false;
+
+  // Samples of the current incomplete block, held silence and output.
+  std::vector<short> block_;
+  std::vector<short> held_;
+  std::vector<short> output_;
+
+  // Silence removed from the current utterance, and in total, in samples.
+  std::size_t leading_removed_ = 0;
+  std::size_t trailing_removed_ = 0;
+  std::uint64_t total_removed_ = 0;
+};
+
+#endif  // SILENCE_TRIMMER_H_
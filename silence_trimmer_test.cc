@@ -0,0 +1,171 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "silence_trimmer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+const unsigned int kSampleRate = 11025;
+
+// One block of the trimmer, and the default limits, in samples.
+const std::size_t kBlock = kSampleRate * SilenceTrimmer::kBlockMs / 1000;
+const std::size_t kMaxTrim = 2205;
+const std::size_t kMargin = 110;
+
+// Appends the given number of samples of a tone of the given amplitude.
+void AddTone(std::vector<short>* samples, std::size_t count,
+             double amplitude) {
+  for (std::size_t i = 0; i < count; ++i) {
+    samples->push_back(amplitude * 32767 *
+                       std::sin(2 * M_PI * 440 * i / kSampleRate));
+  }
+}
+
+void AddSilence(std::vector<short>* samples, std::size_t count) {
+  samples->insert(samples->end(), count, 0);
+}
+
+// Trims one utterance, given in chunks of the given size.
+std::vector<short> Trim(SilenceTrimmer* trimmer,
+                        const std::vector<short>& samples, std::size_t chunk,
+                        bool* bounded) {
+  std::vector<short> out;
+  trimmer->BeginUtterance();
+  for (std::size_t i = 0; i < samples.size(); i += chunk) {
+    const std::size_t count = std::min(chunk, samples.size() - i);
+    const std::size_t max = trimmer->MaxOutputSamples(count);
+    std::size_t written = 0;
+    const short* data = trimmer->Process(&samples[i], count, &written);
+    if (written > max) *bounded = false;
+    out.insert(out.end(), data, data + written);
+  }
+  std::size_t written = 0;
+  const short* data = trimmer->EndUtterance(&written);
+  out.insert(out.end(), data, data + written);
+  return out;
+}
+
+int main() {
+  // Long silences are trimmed by at most the maximum, pauses are kept.
+  std::vector<short> in;
+  std::vector<short> expected;
+  AddSilence(&in, 100 * kBlock);
+  AddTone(&in, 60 * kBlock, 0.3);
+  AddSilence(&in, 20 * kBlock);
+  AddTone(&in, 60 * kBlock, 0.3);
+  AddSilence(&in, 100 * kBlock);
+  AddSilence(&expected, 100 * kBlock - kMaxTrim);
+  AddTone(&expected, 60 * kBlock, 0.3);
+  AddSilence(&expected, 20 * kBlock);
+  AddTone(&expected, 60 * kBlock, 0.3);
+  AddSilence(&expected, 100 * kBlock - kMaxTrim);
+
+  for (std::size_t chunk : {kBlock, std::size_t(97), std::size_t(1000)}) {
+    SilenceTrimmer trimmer(kSampleRate);
+    bool bounded = true;
+    const std::vector<short> out = Trim(&trimmer, in, chunk, &bounded);
+    const string name = "Long silences, chunks of " + std::to_string(chunk);
+    Check(name + ", output", out == expected, out.size());
+    Check(name + ", bounded", bounded, trimmer.MaxHeldSamples());
+    Check(name + ", saved ms", trimmer.saved().count() == 400,
+          trimmer.saved().count());
+  }
+
+  // Short silences keep only the margin, and the speech is untouched.
+  {
+    in.clear();
+    expected.clear();
+    AddSilence(&in, 10 * kBlock);
+    AddTone(&in, 40 * kBlock, 0.3);
+    AddSilence(&in, 10 * kBlock);
+    AddSilence(&expected, kMargin);
+    AddTone(&expected, 40 * kBlock, 0.3);
+    AddSilence(&expected, kMargin);
+
+    SilenceTrimmer trimmer(kSampleRate);
+    bool bounded = true;
+    const std::vector<short> out = Trim(&trimmer, in, 128, &bounded);
+    Check("Short silences", out == expected, out.size());
+
+    // Each utterance is trimmed on its own.
+    const std::vector<short> again = Trim(&trimmer, in, 128, &bounded);
+    Check("Second utterance", again == expected, again.size());
+  }
+
+  // Limits of zero disable the trimming of each end.
+  {
+    SilenceTrimmer::Options options;
+    options.max_leading = std::chrono::milliseconds(0);
+    options.max_trailing = std::chrono::milliseconds(0);
+    SilenceTrimmer trimmer(kSampleRate, options);
+    bool bounded = true;
+    const std::vector<short> out = Trim(&trimmer, in, 128, &bounded);
+    Check("No trimming", out == in, out.size());
+  }
+
+  // An utterance of silence keeps the margin.
+  {
+    in.assign(30 * kBlock, 0);
+    SilenceTrimmer trimmer(kSampleRate);
+    bool bounded = true;
+    const std::vector<short> out = Trim(&trimmer, in, 128, &bounded);
+    Check("Only silence", out.size() == kMargin, out.size());
+  }
+
+  // The threshold separates quiet noise from speech, and full scale samples
+  // do not overflow the energy.
+  const struct {
+    double amplitude;
+    bool silent;
+  } kLevels[] = {{0.0005, true}, {0.002, true}, {0.01, false}, {1.0, false}};
+  for (const auto& level : kLevels) {
+    in.clear();
+    AddTone(&in, 40 * kBlock, level.amplitude);
+    std::vector<short> square(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) {
+      square[i] = in[i] >= 0 ? 32767 : -32768;
+    }
+    const std::vector<short>& samples = level.amplitude == 1.0 ? square : in;
+    SilenceTrimmer trimmer(kSampleRate);
+    bool bounded = true;
+    const std::vector<short> out = Trim(&trimmer, samples, 128, &bounded);
+    const bool silent = out.size() < samples.size();
+    Check("Level " + std::to_string(level.amplitude), silent == level.silent,
+          out.size());
+  }
+
+  if (!good) {
+    std::cout << "Some test failed.\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "speech_converter.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+const bool kNativeLittleEndian =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+}  // namespace
+
+SpeechConverter::SpeechConverter(unsigned int input_rate,
+                                 const AudioSink& player,
+                                 Resampler::Quality quality)
+    : input_rate_(input_rate),
+      output_rate_(player.sample_rate()),
+      channels_(player.channels()),
+      format_(player.sample_format()),
+      stretcher_(input_rate) {
+  const snd_pcm_format_t native_s16 =
+      kNativeLittleEndian ? SND_PCM_FORMAT_S16_LE : SND_PCM_FORMAT_S16_BE;
+  passthrough_ = input_rate_ == output_rate_ && channels_ == 1 &&
+                 format_.format() == native_s16;
+  if (input_rate_ != output_rate_) {
+    resampler_.reset(new Resampler(input_rate_, output_rate_, 1, quality));
+  }
+}
+
+void SpeechConverter::EnableTrimming(const SilenceTrimmer::Options& options) {
+  trimmer_.reset(new SilenceTrimmer(input_rate_, options));
+}
+
+void SpeechConverter::Begin() {
+  if (trimmer_ != nullptr) {
+    trimmer_->BeginUtterance();
+  }
+}
+
+std::size_t SpeechConverter::InputFrames(std::size_t output_frames) const {
+  if (resampler_ == nullptr) return output_frames;
+  // Leave room for the rounding of MaxOutputFrames().
+  const std::size_t frames = output_frames > 2 ? output_frames - 2 : 1;
+  return std::max<std::size_t>(
+      1, static_cast<std::uint64_t>(frames) * input_rate_ / output_rate_);
+}
+
+void SpeechConverter::set_tempo(double tempo) {
+  stretcher_.set_tempo(tempo);
+  if (stretcher_.tempo() != 1.0) {
+    stretching_ = true;
+  }
+}
+
+std::size_t SpeechConverter::MaxOutputFrames(std::size_t input_frames) const {
+  if (trimmer_ != nullptr) {
+    input_frames = trimmer_->MaxOutputSamples(input_frames);
+  }
+  if (stretching_) {
+    input_frames = stretcher_.MaxOutputSamples(input_frames);
+  }
+  if (resampler_ == nullptr) return input_frames;
+  return resampler_->MaxOutputFrames(input_frames);
+}
+
+std::size_t SpeechConverter::MaxOutputFramesAtAnyTempo(
+    std::size_t input_frames) const {
+  if (trimmer_ != nullptr) {
+    input_frames += trimmer_->MaxHeldSamples();
+  }
+  const std::size_t latency = stretcher_.latency();
+  const std::size_t stretched =
+      (input_frames + latency) / TimeStretcher::kMinTempo + latency;
+  if (resampler_ == nullptr) return stretched;
+  return resampler_->MaxOutputFrames(stretched);
+}
+
+const char* SpeechConverter::Convert(const short* in, std::size_t count,
+                                     std::size_t* frames) {
+  if (trimmer_ != nullptr) {
+    in = trimmer_->Process(in, count, &count);
+  }
+  if (passthrough()) {
+    *frames = count;
+    return reinterpret_cast<const char*>(in);
+  }
+
+  input_.resize(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    input_[i] = in[i] / 32768.0f;
+  }
+  return ConvertFloat(input_.data(), count, frames);
+}
+
+const char* SpeechConverter::Drain(std::size_t* frames) {
+  *frames = 0;
+  const short* tail = nullptr;
+  std::size_t count = 0;
+  if (trimmer_ != nullptr) {
+    tail = trimmer_->EndUtterance(&count);
+  }
+  if (passthrough()) {
+    *frames = count;
+    return reinterpret_cast<const char*>(tail);
+  }
+
+  input_.resize(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    input_[i] = tail[i] / 32768.0f;
+  }
+  // Silence pushes the rest of the utterance out of the stretcher, which
+  // then starts the next utterance afresh.
+  const bool flush = stretching_ && (count > 0 || stretcher_.pending());
+  if (flush) {
+    input_.resize(count + stretcher_.latency(), 0.0f);
+  }
+  if (input_.empty()) return nullptr;
+
+  const char* data = ConvertFloat(input_.data(), input_.size(), frames);
+  if (flush) {
+    stretcher_.Reset();
+    stretching_ = stretcher_.tempo() != 1.0;
+  }
+  return data;
+}
+
+const char* SpeechConverter::ConvertFloat(const float* in, std::size_t count,
+                                          std::size_t* frames) {
+  const float* samples = in;
+  std::size_t output_frames = count;
+  if (stretching_) {
+    stretched_.resize(stretcher_.MaxOutputSamples(count));
+    output_frames = stretcher_.Process(samples, count, stretched_.data());
+    samples = stretched_.data();
+  }
+  if (resampler_ != nullptr) {
+    resampled_.resize(resampler_->MaxOutputFrames(output_frames));
+    output_frames =
+        resampler_->Process(samples, output_frames, resampled_.data());
+    samples = resampled_.data();
+  }
+
+  // Speech is the same on every channel.
+  if (channels_ > 1) {
+    frames_.resize(output_frames * channels_);
+    for (std::size_t i = 0; i < output_frames; ++i) {
+      std::fill_n(&frames_[i * channels_], channels_, samples[i]);
+    }
+    samples = frames_.data();
+  }
+
+  output_.resize(output_frames * channels_ * format_.sample_size());
+  format_.FromFloat(samples, output_frames * channels_, output_.data());
+  *frames = output_frames;
+  return output_.data();
+}
+
+void SpeechConverter::Reset() {
+  Begin();
+  if (resampler_ != nullptr) {
+    resampler_->Reset();
+  }
+  stretcher_.Reset();
+  stretching_ = stretcher_.tempo() != 1.0;
+}
@@ -0,0 +1,108 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SPEECH_CONVERTER_H_
+#define SPEECH_CONVERTER_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "audio_sink.h"
+#include "pcm_format.h"
+#include "resampler.h"
+#include "silence_trimmer.h"
+#include "time_stretcher.h"
+
+// Converter of the speech engine output to the output format of the player.
+//
+// The engine always produces 16-bit mono samples, at one of the few rates it
+// supports. When the player uses the same format, the audio goes to the
+// player untouched. Otherwise it is resampled to the rate of the player,
+// converted to its sample format and copied to each of its channels, so the
+// device can be opened at its native rate without a conversion in ALSA.
+//
+// The tempo of the speech can also be changed while it plays, with a time
+// stretcher applied before resampling, at the rate of the engine, and the
+// silence at both ends of each utterance may be removed before anything else.
+class SpeechConverter {
+ public:
+  SpeechConverter(unsigned int input_rate, const AudioSink& player,
+                  Resampler::Quality quality);
+
+  // Removes the silence at both ends of each utterance from now on.
+  void EnableTrimming(const SilenceTrimmer::Options& options);
+  const SilenceTrimmer* trimmer() const { return trimmer_.get(); }
+
+  // Starts a new utterance.
+  void Begin();
+
+  // Returns whether the engine output can be played without conversion.
+  bool passthrough() const { return passthrough_ && !stretching_; }
+
+  // Sets the tempo of the speech, e.g. 1.5 to play it 50% faster, from the
+  // next samples converted. See TimeStretcher for the valid range.
+  void set_tempo(double tempo);
+  double tempo() const { return stretcher_.tempo(); }
+
+  // Returns the number of input frames that produce at most the given number
+  // of output frames.
+  std::size_t InputFrames(std::size_t output_frames) const;
+
+  // Returns the maximum number of output frames for the given number of
+  // input frames, at the current tempo, and at any tempo and with as much
+  // silence held back as possible.
+  std::size_t MaxOutputFrames(std::size_t input_frames) const;
+  std::size_t MaxOutputFramesAtAnyTempo(std::size_t input_frames) const;
+
+  // Converts count samples of the engine. Returns the converted frames, which
+  // remain valid until the next call, and sets *frames to their number.
+  const char* Convert(const short* in, std::size_t count, std::size_t* frames);
+
+  // Returns the audio still held by the silence trimmer and the time
+  // stretcher at the end of an utterance, as Convert() does.
+  const char* Drain(std::size_t* frames);
+
+  // Forgets the samples kept by the silence trimmer, the time stretcher and
+  // the resampler, when the speech is interrupted.
+  void Reset();
+
+ private:
+  const unsigned int input_rate_;
+  const unsigned int output_rate_;
+  const unsigned int channels_;
+  bool passthrough_;
+
+  PcmFormat format_;
+  std::unique_ptr<SilenceTrimmer> trimmer_;
+  std::unique_ptr<Resampler> resampler_;
+
+  // Whether the speech goes through the time stretcher. Once the tempo
+  // changes, it does until the end of the utterance, even if the tempo goes
+  // back to one, so the audio stays continuous.
+  TimeStretcher stretcher_;
+  bool stretching_ = false;
+
+  // Converts count samples at the rate of the engine, in floating point.
+  const char* ConvertFloat(const float* in, std::size_t count,
+                           std::size_t* frames);
+
+  std::vector<float> input_;
+  std::vector<float> stretched_;
+  std::vector<float> resampled_;
+  std::vector<float> frames_;
+  std::vector<char> output_;
+};
+
+#endif  // SPEECH_CONVERTER_H_
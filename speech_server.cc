@@ -15,11 +15,18 @@
 #include "speech_server.h"
 
 #include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <system_error>
+#include <vector>
 
-#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "audio_manager.h"
@@ -27,101 +34,431 @@
 using std::cout;
 using std::string;
 
+namespace {
+
+// Notifier of the main loop waiting for the signal that dumps the trace.
+Notifier* trace_notifier = nullptr;
+
+void OnTraceSignal(int signal) {
+  // Only writes to an eventfd, which is safe from a signal handler.
+  const int error = errno;
+  if (trace_notifier != nullptr) {
+    trace_notifier->Notify();
+  }
+  errno = error;
+}
+
+}  // namespace
+
 SpeechServer::SpeechServer(AudioManager* audio, TTS* tts)
     : audio_(audio),
       tts_(tts),
-      server_state_(audio_),
-      cmd_registry_(new CommandRegistry()) {}
+      cmd_registry_(new CommandRegistry()),
+      text_formatter_(new ECITextFormatter()),
+      icon_cache_(new IconCache(audio->player()->sample_format(),
+                                audio->player()->sample_rate(),
+                                audio->player()->channels())) {
+  Metrics* metrics = Metrics::Default();
+  parse_errors_ = metrics->GetCounter("speech_server_parse_errors_total",
+                                      "Statements that could not be parsed.");
+  stop_latency_ = metrics->GetHistogram(
+      "speech_server_stop_seconds",
+      "Time from reading a stop command to the interruption of the audio.",
+      {0.0001, 0.0003, 0.001, 0.003, 0.01, 0.03, 0.1});
+  metrics->AddCallback("speech_server_clients", "Clients connected.",
+                       Metrics::GAUGE, "",
+                       [this]() { return clients_.size(); }, this);
+}
 
-SpeechServer::~SpeechServer() = default;
+SpeechServer::~SpeechServer() {
+  if (trace_signal_ != 0) {
+    signal(trace_signal_, SIG_DFL);
+    trace_notifier = nullptr;
+  }
 
-int SpeechServer::MainLoop() {
-  for (;;) {
-    // Always expect input from the stdin descriptor, to process commands.
-    std::vector<struct pollfd> fds(1);
-    fds[0].fd = STDIN_FILENO;
-    fds[0].events = POLLIN | POLLERR;
-
-    // If there is an audio task in the queue, expect for sound output buffer
-    // availability.
-    const bool audio_output_pending = audio_->pending();
-
-    if (audio_output_pending) {
-      auto audio_fds = audio_->GetPollDescriptors();
-      std::copy(std::make_move_iterator(audio_fds.begin()),
-                std::make_move_iterator(audio_fds.end()),
-                std::back_inserter(fds));
+  // The exporter writes the metrics a last time.
+  metrics_exporter_.reset();
+  Metrics::Default()->RemoveCallbacks(this);
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(listen_path_.c_str());
+  }
+  for (const auto& client : clients_) {
+    if (client.first != STDIN_FILENO) {
+      close(client.first);
     }
+  }
+}
 
-    // Wait for events.
-    int descriptors_ready = poll(fds.data(), fds.size(), -1);
-    if (descriptors_ready < 0) {
-      if (errno == EINTR) {
-        // Interrupted system call, try again.
-        continue;
-      }
-      throw std::system_error(errno, std::system_category());
+void SpeechServer::set_verbose(bool value) {
+  verbose_ = value;
+  for (const auto& client : clients_) {
+    client.second->server_state.set_verbose(value);
+  }
+}
+
+void SpeechServer::set_icon_gain(float value) {
+  icon_gain_ = value;
+  for (const auto& client : clients_) {
+    client.second->server_state.set_icon_gain(value);
+  }
+}
+
+void SpeechServer::set_urgent_letters(bool value) {
+  urgent_letters_ = value;
+  for (const auto& client : clients_) {
+    client.second->server_state.set_urgent_letters(value);
+  }
+}
+
+void SpeechServer::Listen(const string& path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::system_error(ENAMETOOLONG, std::system_category(),
+                            "SpeechServer: Invalid socket path " + path);
+  }
+  std::strcpy(address.sun_path, path.c_str());
+
+  // A socket left by a previous server would make bind() fail, but nothing
+  // else is removed.
+  struct stat info;
+  if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "SpeechServer: Failed to create socket");
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::system_error(error, std::system_category(),
+                            "SpeechServer: Failed to listen on " + path);
+  }
+  listen_fd_ = fd;
+  listen_path_ = path;
+}
+
+void SpeechServer::ExportMetrics(const MetricsExporter::Options& options) {
+  metrics_exporter_.reset(
+      new MetricsExporter(&loop_, Metrics::Default(), options));
+}
+
+void SpeechServer::DumpTraceOnSignal(Tracer* tracer, int signal) {
+  trace_notifier_.reset(new Notifier(&loop_, [this, tracer]() {
+    const std::size_t events = tracer->Dump();
+    if (verbose_) {
+      std::cerr << "SpeechServer: Wrote " << events << " trace events."
+                << std::endl;
     }
+  }));
+  trace_notifier = trace_notifier_.get();
 
-    // If there was any audio tasks enqueued and the sound output is ready,
-    // run those tasks now.
-    if (audio_output_pending &&
-        audio_->GetPollEvents(fds.data() + 1, fds.size() - 1)) {
-      audio_->Run();
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = OnTraceSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(signal, &action, nullptr) != 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "SpeechServer: Failed to handle the signal");
+  }
+  trace_signal_ = signal;
+}
+
+void SpeechServer::AddClient(int fd) {
+  std::unique_ptr<Client> client(new Client(
+      fd, audio_, text_formatter_.get(), icon_cache_.get()));
+  ServerState& state = client->server_state;
+  state.set_verbose(verbose_);
+  state.set_icon_gain(icon_gain_);
+  state.set_urgent_letters(urgent_letters_);
+  state.set_speech_rate(tts_->GetSpeechRate());
+  state.set_voice(tts_->GetVoice());
+  state.set_language(tts_->GetLanguage());
+
+  Client* raw_client = client.get();
+  loop_.Add(fd, EPOLLIN, [this, raw_client](std::uint32_t events) {
+    if (!ReadInput(raw_client)) {
+      EndInput(raw_client);
     }
+  });
+  clients_[fd] = std::move(client);
 
-    // If there was an input event, possibly process a server command.
-    if (fds[0].fd == STDIN_FILENO && fds[0].revents != 0) {
-      // Read the input waiting at the standard input.
-      char buffer[4096];
-      int size = read(STDIN_FILENO, buffer, sizeof(buffer));
-
-      if (size < 0) {
-        if (errno == EINTR) { /* Interrupted --> restart read() */
-          continue;
-        } else { /* Some other error*/
-          throw std::system_error(errno, std::system_category());
-        }
-      } else if (size == 0) { /* Found EOF */
-        break;
+  if (verbose_ && fd != STDIN_FILENO) {
+    std::cerr << "SpeechServer: Client connected, " << clients_.size()
+              << " client(s)." << std::endl;
+  }
+}
+
+void SpeechServer::RemoveClient(Client* client) {
+  const int fd = client->fd;
+  tts_->RemoveSource(fd);
+  loop_.Remove(fd);
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  clients_.erase(fd);
+
+  if (verbose_ && fd != STDIN_FILENO) {
+    std::cerr << "SpeechServer: Client disconnected, " << clients_.size()
+              << " client(s)." << std::endl;
+  }
+}
+
+void SpeechServer::AcceptClients() {
+  for (;;) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        std::cerr << "SpeechServer: Failed to accept a client: "
+                  << std::strerror(errno) << std::endl;
       }
+      return;
+    }
+    AddClient(fd);
+  }
+}
 
-      // Feed the input to the parser.
-      input_parser_.Feed(buffer, size);
+void SpeechServer::EndInput(Client* client) {
+  // Without other clients, the server is done at the end of the standard
+  // input.
+  if (client->fd == STDIN_FILENO && listen_fd_ < 0) {
+    if (finish_on_eof_) {
+      while (audio_->pending()) {
+        audio_->Run();
+      }
+    }
+    done_ = true;
+    return;
+  }
+  RemoveClient(client);
+}
+
+int SpeechServer::MainLoop() {
+  // Always expect input from the stdin descriptor, to process commands, and
+  // from the clients connecting to the socket, if any.
+  AddClient(STDIN_FILENO);
+  if (listen_fd_ >= 0) {
+    loop_.Add(listen_fd_, EPOLLIN,
+              [this](std::uint32_t events) { AcceptClients(); });
+  }
+
+  // The descriptors of the sound output are registered once, and only
+  // watched while there is audio to play.
+  audio_fds_ = audio_->GetPollDescriptors();
+  for (std::size_t i = 0; i < audio_fds_.size(); ++i) {
+    loop_.Add(audio_fds_[i].fd, audio_fds_[i].events,
+              [this, i](std::uint32_t events) {
+                audio_fds_[i].revents = events;
+                audio_ready_ = true;
+              });
+    loop_.Enable(audio_fds_[i].fd, false);
+  }
+  audio_timer_.reset(new Timer(&loop_, [this]() { audio_ready_ = true; }));
+
+  while (!done_) {
+    WatchAudio();
+    loop_.RunOnce();
 
-      // Process any complete statements from the input.
-      ProcessCommands();
+    // If the sound output is ready, run the audio tasks now.
+    if (audio_ready_) {
+      audio_ready_ = false;
+      if (audio_->GetPollEvents(audio_fds_.data(), audio_fds_.size())) {
+        audio_->Run();
+      }
+      for (auto& fd : audio_fds_) {
+        fd.revents = 0;
+      }
     }
   }
 
+  audio_timer_.reset();
+  for (const auto& fd : audio_fds_) {
+    loop_.Remove(fd.fd);
+  }
+  for (const auto& client : clients_) {
+    loop_.Remove(client.first);
+  }
+  if (listen_fd_ >= 0) {
+    loop_.Remove(listen_fd_);
+  }
   return 0;
 }
 
-void SpeechServer::ProcessCommands() {
+void SpeechServer::WatchAudio() {
+  // Some players ask to be polled periodically instead, e.g. while the
+  // device is suspended.
+  const bool pending = audio_->pending();
+  const int timeout = pending ? audio_->GetPollTimeout() : -1;
+
+  const bool watch = pending && timeout < 0;
+  if (watch != audio_watched_) {
+    for (const auto& fd : audio_fds_) {
+      loop_.Enable(fd.fd, watch);
+    }
+    audio_watched_ = watch;
+  }
+
+  if (pending && timeout >= 0) {
+    if (!audio_timer_->armed()) {
+      audio_timer_->Start(std::chrono::milliseconds(timeout));
+    }
+  } else {
+    audio_timer_->Stop();
+  }
+}
+
+bool SpeechServer::ReadInput(Client* client) {
+  // Read the input waiting from the client.
+  char buffer[4096];
+  int size = read(client->fd, buffer, sizeof(buffer));
+
+  if (size < 0) {
+    if (errno == EINTR || errno == EAGAIN) { /* Retry on the next event. */
+      return true;
+    } else if (client->fd == STDIN_FILENO) { /* Some other error*/
+      throw std::system_error(errno, std::system_category());
+    } else { /* A broken connection ends like a closed one. */
+      return false;
+    }
+  } else if (size == 0) { /* Found EOF */
+    return false;
+  }
+
+  // Feed the input to the parser.
+  client->input_parser.Feed(buffer, size);
+
+  // Process any complete statements from the input.
+  ProcessCommands(client);
+  return true;
+}
+
+void SpeechServer::ProcessCommands(Client* client) {
+  const auto received = std::chrono::steady_clock::now();
+
+  // Parse all the complete statements first, so that text queued right
+  // before a stop is not even formatted.
+  std::vector<std::unique_ptr<StatementInfo>> statements;
+  std::vector<std::uint64_t> trace_ids;
   for (;;) {
     try {
       // Try to parse the next pending command.
-      std::unique_ptr<StatementInfo> statement = input_parser_.Parse();
+      std::unique_ptr<StatementInfo> statement = client->input_parser.Parse();
       if (statement == nullptr) {
         break;
       }
+      if (Tracer::enabled()) {
+        const std::uint64_t trace_id = Tracer::NextId();
+        Tracer::Begin("Statement", trace_id, statement->command.c_str(),
+                      received);
+        Tracer::Mark("Parse", trace_id);
+        trace_ids.push_back(trace_id);
+      }
+      statements.push_back(std::move(statement));
+    } catch (InputParsingError& error) {
+      parse_errors_->Increment();
+      cout << error.what() << std::endl;
+    }
+  }
 
-      Command* command = cmd_registry_->GetCommand(statement->command);
+  std::vector<Command*> commands(statements.size());
+  std::vector<bool> skipped(statements.size());
+  bool stopped = false;
+  for (std::size_t i = statements.size(); i-- > 0;) {
+    Command* command = cmd_registry_->GetCommand(statements[i]->command);
+    commands[i] = command;
+    GetStatementCounter(command != nullptr ? statements[i]->command
+                                           : "unknown")->Increment();
+    if (command == nullptr) continue;
 
-      if (command != nullptr) {
-        CommandContext context;
-        context.tts = tts_;
-        context.server_state = &server_state_;
-        bool result = command->Run(*statement, context);
+    // A stop clears the queue, dropping anything that was queued and not
+    // dispatched before it.
+    if (statements[i]->command == "s") {
+      stopped = true;
+    } else if (statements[i]->command == "d") {
+      stopped = false;
+    } else if (stopped && command->QueuesOnly()) {
+      skipped[i] = true;
+    }
+  }
+
+  // The TTS acts on behalf of the client, with its speech rate, voice and
+  // language, while its commands run.
+  ServerState& state = client->server_state;
+  tts_->set_source(client->fd);
+  tts_->SetSpeechRate(state.speech_rate());
+  tts_->SetVoice(state.voice());
+  tts_->SelectLanguage(state.language());
 
-        if (verbose()) {
-          cout << *statement << " :: Result: " << result << std::endl;
-        }
-      } else if (verbose()) {
-        cout << *statement << " :: No such command." << std::endl;
+  for (std::size_t i = 0; i < statements.size(); ++i) {
+    const StatementInfo& statement = *statements[i];
+    Command* command = commands[i];
+    const std::uint64_t trace_id = trace_ids.empty() ? 0 : trace_ids[i];
+    bool queued = false;
+
+    if (command == nullptr) {
+      if (verbose()) {
+        cout << statement << " :: No such command." << std::endl;
+      }
+    } else if (skipped[i]) {
+      Tracer::Mark("Skipped", trace_id);
+      if (verbose()) {
+        cout << statement << " :: Skipped, stopped before dispatch."
+             << std::endl;
+      }
+    } else {
+      CommandContext context;
+      context.tts = tts_;
+      context.server_state = &state;
+      context.output_fd =
+          client->fd == STDIN_FILENO ? STDOUT_FILENO : client->fd;
+      context.trace_id = trace_id;
+      bool result = command->Run(statement, context);
+
+      if (statement.command == "s") {
+        const std::chrono::duration<double> latency =
+            std::chrono::steady_clock::now() - received;
+        stop_latency_->Observe(latency.count());
+      }
+
+      // The lifecycle of a queued statement goes on with its task.
+      if (trace_id != 0 && result && command->QueuesOnly() &&
+          !state.queue().empty()) {
+        state.queue().back()->set_trace_id(trace_id);
+        Tracer::Mark("Enqueue", trace_id);
+        queued = true;
+      }
+
+      if (verbose()) {
+        cout << statement << " :: Result: " << result << std::endl;
       }
-    } catch (InputParsingError& error) {
-      cout << error.what() << std::endl;
     }
+
+    if (!queued) {
+      Tracer::End("Statement", trace_id);
+    }
+  }
+
+  state.set_speech_rate(tts_->GetSpeechRate());
+  state.set_voice(tts_->GetVoice());
+  state.set_language(tts_->GetLanguage());
+}
+
+Counter* SpeechServer::GetStatementCounter(const string& command) {
+  auto it = statement_counters_.find(command);
+  if (it == statement_counters_.end()) {
+    Counter* counter = Metrics::Default()->GetCounter(
+        "speech_server_statements_total", "Statements parsed, by command.",
+        Metrics::Label("command", command));
+    it = statement_counters_.emplace(command, counter).first;
   }
+  return it->second;
 }
@@ -15,35 +15,149 @@
 #ifndef SPEECH_SERVER_H_
 #define SPEECH_SERVER_H_
 
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
 
 #include "audio_manager.h"
 #include "command_generator.h"
+#include "event_loop.h"
+#include "icon_cache.h"
 #include "input_parser.h"
-#include "tts.h"
+#include "metrics.h"
+#include "metrics_exporter.h"
 #include "server_state.h"
+#include "text_formatter.h"
+#include "tracer.h"
+#include "tts.h"
 
+// Speech server for Emacspeak.
+//
+// Reads commands from the standard input and, optionally, from clients
+// connected to a Unix domain socket. Each client has its own settings, e.g.
+// its speech rate, voice and language, and queue, and all of them share the
+// speech engines and the audio output, where their tasks and icons take
+// turns. A stop only affects the speech and icons of its client, but a pause
+// holds the output of all of them.
 class SpeechServer {
  public:
   SpeechServer(AudioManager* audio, TTS* tts);
   ~SpeechServer();
 
+  // Listens for clients on a Unix domain socket at the given path, replacing
+  // any socket left there. The server then keeps running after the end of the
+  // standard input. Throws std::system_error on failure.
+  void Listen(const std::string& path);
+
+  // Exports the metrics of the server as given, while it runs. Throws
+  // std::system_error on failure.
+  void ExportMetrics(const MetricsExporter::Options& options);
+
+  // Writes the events of the tracer to its file when the process gets the
+  // given signal, e.g. SIGUSR1, from the main loop. Throws std::system_error
+  // on failure.
+  void DumpTraceOnSignal(Tracer* tracer, int signal);
+
   int MainLoop();
 
-  bool verbose() const { return server_state_.verbose(); }
-  void set_verbose(bool value) { server_state_.set_verbose(value); }
+  // Settings of all the clients, before they change them.
+  bool verbose() const { return verbose_; }
+  void set_verbose(bool value);
+
+  IconCache* icon_cache() { return icon_cache_.get(); }
+  void set_icon_gain(float value);
+
+  void set_urgent_letters(bool value);
+
+  // Whether to finish all pending audio when the input ends, instead of
+  // exiting immediately.
+  bool finish_on_eof() const { return finish_on_eof_; }
+  void set_finish_on_eof(bool value) { finish_on_eof_ = value; }
 
  private:
-  void ProcessCommands();
+  // Client of the server, reading commands from a descriptor, which is also
+  // the source of its tasks for the audio manager.
+  struct Client {
+    Client(int fd, AudioManager* audio, TextFormatter* text_formatter,
+           IconCache* icon_cache)
+        : fd(fd), server_state(audio, text_formatter, icon_cache) {}
+
+    const int fd;
+    InputParser input_parser;
+    ServerState server_state;
+  };
+
+  // Adds a client reading from the given descriptor, with the current
+  // settings, and watches its input.
+  void AddClient(int fd);
+
+  // Stops the audio of the client and closes its connection.
+  void RemoveClient(Client* client);
+
+  // Accepts the clients waiting to connect to the socket.
+  void AcceptClients();
+
+  // Reads the input waiting from the client and processes the complete
+  // commands. Returns false at the end of the input.
+  bool ReadInput(Client* client);
+  void ProcessCommands(Client* client);
+
+  // Handles the end of the input of the client.
+  void EndInput(Client* client);
+
+  // Watches the sound output while there is audio to play.
+  void WatchAudio();
+
+  // Returns the counter of the statements of the given command.
+  Counter* GetStatementCounter(const std::string& command);
 
   AudioManager* audio_;
   TTS* tts_;
-  ServerState server_state_;
-  InputParser input_parser_;
   std::unique_ptr<CommandRegistry> cmd_registry_;
+  bool finish_on_eof_ = false;
+
+  // Shared by all clients.
+  std::unique_ptr<TextFormatter> text_formatter_;
+  std::unique_ptr<IconCache> icon_cache_;
+
+  bool verbose_ = false;
+  float icon_gain_ = 1.0f;
+  bool urgent_letters_ = false;
+
+  // Clients, by descriptor.
+  std::map<int, std::unique_ptr<Client>> clients_;
+
+  // Socket listening for clients, if any.
+  int listen_fd_ = -1;
+  std::string listen_path_;
+
+  EventLoop loop_;
+  bool done_ = false;
+
+  // Metrics of the commands, by command name, and exporter of all the
+  // metrics, if any.
+  std::unordered_map<std::string, Counter*> statement_counters_;
+  Counter* parse_errors_;
+  Histogram* stop_latency_;
+  std::unique_ptr<MetricsExporter> metrics_exporter_;
+
+  // Signal that dumps the trace, if any, and notifier of the main loop
+  // called by its handler.
+  int trace_signal_ = 0;
+  std::unique_ptr<Notifier> trace_notifier_;
+
+  // Descriptors of the sound output, with the events they got, and timer to
+  // poll it periodically instead, if it asks for it.
+  std::vector<struct pollfd> audio_fds_;
+  std::unique_ptr<Timer> audio_timer_;
+  bool audio_watched_ = false;
+  bool audio_ready_ = false;
 };
 
 // Irrecoverable error in speech server.
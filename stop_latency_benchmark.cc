@@ -0,0 +1,248 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how long the speech server takes to go silent after a stop: the
+// time from writing "s" to its input, while it is speaking, to the moment the
+// device has dropped its buffer and has nothing left to play, i.e. GetDelay()
+// is 0, both taken on the clock of the device. The server runs in this
+// process, on a null sink with a real time clock, with the fake ECI library
+// or any other, e.g.:
+//
+//   FAKE_ECI_CHAR_COST_US=20 stop_latency_benchmark
+//       --eci-library ./libfake_eci.so --stops 500 --target-p99 10
+//
+// Exits with failure if the 99th percentile is above the target.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "audio_manager.h"
+#include "eci-c++.h"
+#include "null_sink.h"
+#include "speech_server.h"
+#include "tts.h"
+
+namespace po = boost::program_options;
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+namespace {
+
+// Text queued before each stop, long enough to be still speaking.
+const char kText[] =
+    "The quick brown fox jumps over the lazy dog, while the speech server "
+    "keeps reading the text of a long paragraph, one line after another.";
+const int kLines = 20;
+
+// Null sink recording when the output goes silent after an interrupt.
+class TimedSink : public NullSink {
+ public:
+  explicit TimedSink(const NullSink::Options& options) : NullSink(options) {}
+
+  // The null sink drops its buffer at once, so the device is silent when the
+  // drop returns. The time is only recorded once GetDelay() confirms it.
+  void Interrupt() override {
+    NullSink::Interrupt();
+    const std::chrono::nanoseconds time = now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    silences_.push_back(GetDelay() == 0 ? time : kNotSilent);
+    silenced_.notify_all();
+  }
+
+  // Waits for the given number of interrupts, and returns the time of the
+  // clock of the sink at which the last one left the device silent, or
+  // kNotSilent if it did not within a second.
+  std::chrono::nanoseconds WaitForSilence(std::size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!silenced_.wait_for(lock, std::chrono::seconds(1), [=]() {
+          return silences_.size() >= count;
+        })) {
+      return kNotSilent;
+    }
+    return silences_[count - 1];
+  }
+
+  static constexpr std::chrono::nanoseconds kNotSilent{-1};
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable silenced_;
+  std::vector<std::chrono::nanoseconds> silences_;
+};
+
+constexpr std::chrono::nanoseconds TimedSink::kNotSilent;
+
+void WriteAll(int fd, const string& data) {
+  std::size_t written = 0;
+  while (written < data.size()) {
+    const ssize_t size = write(fd, data.data() + written, data.size() - written);
+    if (size < 0) {
+      throw std::system_error(errno, std::system_category(), "Write failed");
+    }
+    written += size;
+  }
+}
+
+// Feeds the server with speech and stops it after a random time, measuring
+// each stop.
+std::vector<double> RunClient(int fd, TimedSink* sink, int stops,
+                              int max_delay_ms) {
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> delay(20, max_delay_ms);
+
+  string speech;
+  for (int i = 0; i < kLines; ++i) {
+    speech += string("q {") + kText + "}\n";
+  }
+  speech += "d\n";
+
+  std::vector<double> latencies;
+  for (int i = 1; i <= stops; ++i) {
+    WriteAll(fd, speech);
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay(random)));
+
+    // The real time clock of the sink can be read from any thread.
+    const std::chrono::nanoseconds sent = sink->now();
+    WriteAll(fd, "s\n");
+    const std::chrono::nanoseconds silent = sink->WaitForSilence(i);
+    if (silent == TimedSink::kNotSilent) {
+      cerr << "Stop " << i << " did not silence the device." << std::endl;
+      break;
+    }
+    latencies.push_back(
+        std::chrono::duration<double, std::milli>(silent - sent).count());
+  }
+  return latencies;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  const std::size_t i = std::min<std::size_t>(sorted.size() * p / 100,
+                                              sorted.size() - 1);
+  return sorted[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  /* clang-format off */
+  po::options_description options("Benchmark options");
+  options.add_options()
+      ("help,h", "Display this help message.")
+      ("eci-library", po::value<string>()->value_name("path"),
+       "Path to the ECI library to load (default: libibmeci.so).")
+      ("stops", po::value<int>()->value_name("count"),
+       "Number of stops measured (default: 200).")
+      ("max-delay", po::value<int>()->value_name("ms"),
+       "Longest time speaking before each stop (default: 500).")
+      ("buffer-time", po::value<int>()->value_name("ms"),
+       "Buffer time of the null sink (default: 100).")
+      ("target-p99", po::value<double>()->value_name("ms"),
+       "Highest acceptable 99th percentile of the latency (default: 20).");
+  /* clang-format on */
+
+  po::variables_map args;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), args);
+    po::notify(args);
+  } catch (po::error& e) {
+    cerr << "Error parsing command line options:\n" << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (args.count("help")) {
+    cerr << options << "\n";
+    return EXIT_SUCCESS;
+  }
+
+  const string eci_library = args.count("eci-library")
+                                 ? args["eci-library"].as<string>()
+                                 : TTS::kEciLibraryName;
+  const int stops = args.count("stops") ? args["stops"].as<int>() : 200;
+  const int max_delay =
+      args.count("max-delay") ? args["max-delay"].as<int>() : 500;
+  const double target =
+      args.count("target-p99") ? args["target-p99"].as<double>() : 20.0;
+
+  NullSink::Options sink_options;
+  sink_options.clock = NullSink::REAL_TIME;
+  if (args.count("buffer-time")) {
+    sink_options.buffer_time =
+        std::chrono::milliseconds(args["buffer-time"].as<int>());
+  }
+
+  // The server reads its input from the standard input, so it is replaced
+  // by a pipe that the client writes to.
+  int fds[2];
+  if (pipe(fds) != 0 || dup2(fds[0], STDIN_FILENO) < 0) {
+    cerr << "Failed to create the input pipe." << std::endl;
+    return EXIT_FAILURE;
+  }
+  close(fds[0]);
+
+  std::vector<double> latencies;
+  try {
+    ECI::Init(eci_library.c_str());
+
+    TimedSink* sink = new TimedSink(sink_options);
+    AudioManager audio((std::unique_ptr<AudioSink>(sink)));
+    TTS tts(&audio);
+    SpeechServer server(&audio, &tts);
+
+    std::thread client([&]() {
+      latencies = RunClient(fds[1], sink, stops, max_delay);
+      // The end of the input ends the main loop.
+      close(fds[1]);
+    });
+    server.MainLoop();
+    client.join();
+  } catch (std::exception& e) {
+    cerr << "Fatal error while running the speech server:\n" << e.what()
+         << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (latencies.empty()) {
+    cerr << "No stops were measured." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  const double p99 = Percentile(latencies, 99);
+  cout << "Time to silence over " << latencies.size() << " stops: p50 "
+       << Percentile(latencies, 50) << "ms, p90 " << Percentile(latencies, 90)
+       << "ms, p99 " << p99 << "ms, max " << latencies.back() << "ms."
+       << std::endl;
+
+  if (p99 > target) {
+    cout << "The 99th percentile is above the target of " << target << "ms."
+         << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
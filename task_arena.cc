@@ -0,0 +1,55 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_arena.h"
+
+#include <new>
+
+constexpr std::size_t TaskArena::kGranularity;
+constexpr std::size_t TaskArena::kMaxBlockSize;
+constexpr std::size_t TaskArena::kNumClasses;
+
+TaskArena::FreeBlock* TaskArena::free_lists_[kNumClasses] = {};
+std::size_t TaskArena::free_blocks_ = 0;
+
+void* TaskArena::Allocate(std::size_t size) {
+  if (size == 0 || size > kMaxBlockSize) {
+    return ::operator new(size);
+  }
+
+  const std::size_t size_class = (size - 1) / kGranularity;
+  FreeBlock* block = free_lists_[size_class];
+  if (block == nullptr) {
+    return ::operator new((size_class + 1) * kGranularity);
+  }
+  free_lists_[size_class] = block->next;
+  --free_blocks_;
+  return block;
+}
+
+void TaskArena::Free(void* block, std::size_t size) {
+  if (block == nullptr) return;
+  if (size == 0 || size > kMaxBlockSize) {
+    ::operator delete(block);
+    return;
+  }
+
+  const std::size_t size_class = (size - 1) / kGranularity;
+  FreeBlock* free_block = static_cast<FreeBlock*>(block);
+  free_block->next = free_lists_[size_class];
+  free_lists_[size_class] = free_block;
+  ++free_blocks_;
+}
+
+std::size_t TaskArena::free_blocks() { return free_blocks_; }
@@ -0,0 +1,57 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TASK_ARENA_H_
+#define TASK_ARENA_H_
+
+#include <cstddef>
+
+// Recycled memory for audio tasks.
+//
+// The server creates and destroys a task for every utterance, tone or icon it
+// queues. This arena keeps the memory of destroyed tasks in free lists, one
+// per size class, and hands it out again to the next tasks of a similar size,
+// so queueing a task does not reach the general purpose allocator once the
+// server has warmed up. Blocks too large for the size classes are allocated
+// as usual.
+//
+// The arena is not thread-safe: tasks are created and destroyed by the main
+// loop.
+class TaskArena {
+ public:
+  // Returns a block of at least the given size.
+  static void* Allocate(std::size_t size);
+
+  // Returns a block obtained from Allocate() with the same size to the arena.
+  static void Free(void* block, std::size_t size);
+
+  // Returns the number of blocks held by the free lists.
+  static std::size_t free_blocks();
+
+ private:
+  // Block sizes are multiples of kGranularity, up to kMaxBlockSize.
+  static constexpr std::size_t kGranularity = 32;
+  static constexpr std::size_t kMaxBlockSize = 512;
+  static constexpr std::size_t kNumClasses = kMaxBlockSize / kGranularity;
+
+  // Free block, linked to the next free block of the same size class.
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static FreeBlock* free_lists_[kNumClasses];
+  static std::size_t free_blocks_;
+};
+
+#endif  // TASK_ARENA_H_
@@ -0,0 +1,395 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "threaded_sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+// Stack touched by the audio thread when it starts, so it does not page fault
+// later.
+const std::size_t kPrefaultStack = 64 * 1024;
+
+// Signals the given eventfd.
+void Notify(int fd) {
+  const std::uint64_t one = 1;
+  // The counter only overflows if it is never read, in which case it is ready
+  // anyway.
+  ssize_t result = write(fd, &one, sizeof(one));
+  (void)result;
+}
+
+// Resets the given eventfd.
+void Clear(int fd) {
+  std::uint64_t count = 0;
+  ssize_t result = read(fd, &count, sizeof(count));
+  (void)result;
+}
+
+int CreateEventFd() {
+  const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "ThreadedSink: Failed to create the eventfd");
+  }
+  return fd;
+}
+
+// Pins the given thread to the given CPU. Returns 0 or an error number.
+int SetAffinity(pthread_t thread, int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// Locks the memory of the process. The memory mapped later is only locked if
+// the limit of locked memory allows it, since otherwise allocations would
+// start failing once they reach the limit. Returns 0 or an error number.
+int LockMemory() {
+  int flags = MCL_CURRENT;
+  struct rlimit limit;
+  if (geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+                         limit.rlim_cur == RLIM_INFINITY)) {
+    flags |= MCL_FUTURE;
+  }
+  return mlockall(flags) == 0 ? 0 : errno;
+}
+
+void PrefaultStack() {
+  char stack[kPrefaultStack];
+  volatile char* page = stack;
+  for (std::size_t i = 0; i < kPrefaultStack; i += 1024) {
+    page[i] = 0;
+  }
+}
+
+}  // namespace
+
+ThreadedSink::ThreadedSink(std::unique_ptr<AudioSink> device,
+                           const Options& options)
+    : AudioSink(device->sample_format(), device->sample_rate(),
+                device->channels()),
+      options_(options),
+      device_(std::move(device)) {
+  ResizeRing();
+  SetBufferSize(device_->period_size(),
+                device_->buffer_size() + ring_slots_ - 1);
+
+  wakeup_fd_ = CreateEventFd();
+  space_fd_ = CreateEventFd();
+
+  struct pollfd wakeup = {};
+  wakeup.fd = wakeup_fd_;
+  wakeup.events = POLLIN;
+  fds_.push_back(wakeup);
+  for (const auto& fd : device_->GetPollDescriptors()) {
+    fds_.push_back(fd);
+  }
+  Publish();
+  Notify(space_fd_);
+
+  if (options_.lock_memory) {
+    const int error = LockMemory();
+    if (error != 0 && options_.verbose) {
+      std::cerr << "ThreadedSink: Failed to lock the memory: "
+                << std::system_category().message(error) << "\n";
+    }
+  }
+
+  thread_ = std::thread(&ThreadedSink::AudioLoop, this);
+
+  if (options_.priority > 0) {
+    struct sched_param param = {};
+    param.sched_priority = options_.priority;
+    const int error =
+        pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param);
+    if (options_.verbose) {
+      if (error != 0) {
+        std::cerr << "ThreadedSink: Failed to make the audio thread real-time, "
+                  << "running it with the normal policy: "
+                  << std::system_category().message(error) << "\n";
+      } else {
+        std::cerr << "ThreadedSink: Running the audio thread with SCHED_FIFO "
+                  << "priority " << options_.priority << ".\n";
+      }
+    }
+  }
+
+  if (options_.cpu >= 0) {
+    const int error = SetAffinity(thread_.native_handle(), options_.cpu);
+    if (error != 0 && options_.verbose) {
+      std::cerr << "ThreadedSink: Failed to pin the audio thread to CPU "
+                << options_.cpu << ": "
+                << std::system_category().message(error) << "\n";
+    }
+  }
+}
+
+ThreadedSink::~ThreadedSink() {
+  stop_ = true;
+  Notify(wakeup_fd_);
+  thread_.join();
+  close(wakeup_fd_);
+  close(space_fd_);
+}
+
+bool ThreadedSink::PinThread(int cpu) {
+  return SetAffinity(pthread_self(), cpu) == 0;
+}
+
+void ThreadedSink::ResizeRing() {
+  const std::size_t slots = device_->buffer_size() + 1;
+  if (slots != ring_slots_) {
+    ring_.reset(new char[slots * frame_size()]);
+    ring_slots_ = slots;
+  }
+  read_ = 0;
+  write_ = 0;
+}
+
+void ThreadedSink::AudioLoop() {
+  PrefaultStack();
+  try {
+    while (!stop_) {
+      RunCommand();
+      if (Transfer()) {
+        Notify(space_fd_);
+      }
+      Publish();
+      Wait();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    error_ = std::current_exception();
+    failed_ = true;
+    command_pending_ = false;
+    command_done_.notify_one();
+    // Wake up the main loop, so it finds out.
+    Notify(space_fd_);
+  }
+}
+
+bool ThreadedSink::Transfer() {
+  device_->Flush();
+
+  // The device stages at most a period, so the audio waits in the ring
+  // buffer, where the main loop can see it, rather than in the device.
+  bool moved = false;
+  while (!device_->pending()) {
+    const std::size_t read = read_.load(std::memory_order_relaxed);
+    const std::size_t write = write_.load(std::memory_order_acquire);
+    if (read == write) break;
+
+    const std::size_t end = write > read ? write : ring_slots_;
+    const std::size_t frames =
+        std::min<std::size_t>(end - read, device_->period_size());
+    const std::size_t played =
+        device_->Play(ring_.get() + read * frame_size(), frames);
+    read_.store((read + played) % ring_slots_, std::memory_order_release);
+    moved = moved || played > 0;
+    if (played < frames) break;
+  }
+
+  if (idle_pending_ && ring_frames() == 0 && !device_->pending()) {
+    device_->Idle();
+    idle_pending_ = false;
+  }
+  return moved;
+}
+
+void ThreadedSink::Wait() {
+  // Without audio to move, only the main loop can give the thread work.
+  const bool playing = ring_frames() > 0 || device_->pending();
+  const nfds_t nfds = playing ? fds_.size() : 1;
+  const int timeout = playing ? device_->GetPollTimeout() : -1;
+
+  if (poll(fds_.data(), nfds, timeout) < 0 && errno != EINTR) {
+    throw std::system_error(errno, std::system_category(),
+                            "ThreadedSink: Failed to poll");
+  }
+  if (fds_[0].revents & POLLIN) {
+    Clear(wakeup_fd_);
+  }
+  if (nfds > 1) {
+    device_->GetPollEvents(fds_.data() + 1, nfds - 1);
+  }
+}
+
+void ThreadedSink::Publish() {
+  running_ = device_->running();
+  underruns_ = device_->underruns();
+  device_delay_ = device_->GetDelay();
+}
+
+void ThreadedSink::RunInAudioThread(const std::function<void()>& function) {
+  {
+    // The audio thread sets failed_ under the mutex, so it cannot fail
+    // between the check and the wait without ending the wait.
+    std::unique_lock<std::mutex> lock(command_mutex_);
+    if (!failed_) {
+      command_ = &function;
+      command_pending_ = true;
+      Notify(wakeup_fd_);
+      command_done_.wait(lock,
+                         [this]() { return !command_pending_ || failed_; });
+    }
+  }
+  CheckFailure();
+}
+
+void ThreadedSink::RunCommand() {
+  // The flag spares the audio thread the mutex while there is no command,
+  // but command_ is only read under the mutex, where the flag is checked
+  // again.
+  if (!command_pending_) return;
+
+  std::lock_guard<std::mutex> lock(command_mutex_);
+  if (!command_pending_) return;
+  (*command_)();
+  command_ = nullptr;
+  command_pending_ = false;
+  command_done_.notify_one();
+}
+
+void ThreadedSink::CheckFailure() const {
+  if (!failed_) return;
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    error = error_;
+  }
+  std::rethrow_exception(error);
+}
+
+std::size_t ThreadedSink::Write(const char* data, std::size_t count) {
+  CheckFailure();
+  const std::size_t write = write_.load(std::memory_order_relaxed);
+  const std::size_t read = read_.load(std::memory_order_acquire);
+  count = std::min(count, (read + ring_slots_ - write - 1) % ring_slots_);
+  if (count == 0) return 0;
+
+  const std::size_t first = std::min(count, ring_slots_ - write);
+  std::memcpy(ring_.get() + write * frame_size(), data, first * frame_size());
+  std::memcpy(ring_.get(), data + first * frame_size(),
+              (count - first) * frame_size());
+  write_.store((write + count) % ring_slots_, std::memory_order_release);
+  Notify(wakeup_fd_);
+  return count;
+}
+
+std::vector<struct pollfd> ThreadedSink::GetPollDescriptors() const {
+  struct pollfd fd = {};
+  fd.fd = space_fd_;
+  fd.events = POLLIN;
+  return {fd};
+}
+
+int ThreadedSink::GetPollEvents(struct pollfd* fds, int nfds) const {
+  if (nfds == 0 || !(fds[0].revents & POLLIN)) return 0;
+
+  // As the descriptor of a device, it stays ready while there is room for a
+  // period, until the audio thread signals more room.
+  Clear(space_fd_);
+  if (ring_slots_ - 1 - ring_frames() >= period_size()) {
+    Notify(space_fd_);
+  }
+  return POLLOUT;
+}
+
+snd_pcm_sframes_t ThreadedSink::GetDelay() const {
+  return staged() + ring_frames() + device_delay_;
+}
+
+void ThreadedSink::Reconfigure(std::chrono::microseconds buffer_time) {
+  DropStaged();
+  RunInAudioThread([this, buffer_time]() {
+    device_->Reconfigure(buffer_time);
+    ResizeRing();
+    idle_pending_ = false;
+    fds_.resize(1);
+    for (const auto& fd : device_->GetPollDescriptors()) {
+      fds_.push_back(fd);
+    }
+    Publish();
+  });
+  SetBufferSize(device_->period_size(),
+                device_->buffer_size() + ring_slots_ - 1);
+}
+
+void ThreadedSink::Drain() {
+  // Wait for the audio thread to take all the audio, then for the device to
+  // play it. The wait has no timeout: the audio thread signals space_fd_
+  // whenever it takes audio, and also when it fails.
+  while (!Flush() || ring_frames() > 0) {
+    struct pollfd fd = {};
+    fd.fd = space_fd_;
+    fd.events = POLLIN;
+    poll(&fd, 1, -1);
+    Clear(space_fd_);
+    CheckFailure();
+  }
+  RunInAudioThread([this]() {
+    while (!device_->Flush()) {
+      poll(fds_.data() + 1, fds_.size() - 1, device_->GetPollTimeout());
+      device_->GetPollEvents(fds_.data() + 1, fds_.size() - 1);
+    }
+    device_->Drain();
+    Publish();
+  });
+}
+
+bool ThreadedSink::Pause() {
+  bool paused = false;
+  RunInAudioThread([this, &paused]() {
+    paused = device_->Pause();
+    Publish();
+  });
+  return paused;
+}
+
+void ThreadedSink::Resume() {
+  RunInAudioThread([this]() {
+    device_->Resume();
+    Publish();
+  });
+}
+
+void ThreadedSink::Idle() {
+  RunInAudioThread([this]() { idle_pending_ = true; });
+}
+
+void ThreadedSink::Interrupt() {
+  DropStaged();
+  RunInAudioThread([this]() {
+    read_.store(write_.load());
+    idle_pending_ = false;
+    device_->Interrupt();
+    Publish();
+  });
+}
@@ -0,0 +1,169 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THREADED_SINK_H_
+#define THREADED_SINK_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "audio_sink.h"
+
+// Audio sink that plays the audio of another sink from a thread of its own.
+//
+// The main loop of the server parses commands, formats text and runs the
+// speech engine, and any hiccup there, e.g. a page fault or a large regex,
+// used to delay the writes to the device until it underran. This sink splits
+// the work: the main loop writes the mixed audio into a ring buffer, and an
+// audio thread moves it from the ring buffer to the device as soon as there
+// is room. The ring buffer is single-producer single-consumer and lock-free,
+// and holds as many frames as the buffer of the device, so the audio thread
+// keeps the device fed for a whole buffer while the main loop is busy.
+//
+// The audio thread preferably runs with the SCHED_FIFO policy, possibly
+// pinned to a CPU, and the memory of the process is locked, so it is not
+// delayed by other processes or by paging. Without the privileges for it, it
+// runs as a normal thread. It allocates no memory while playing.
+//
+// Writes never block. The operations on the device, e.g. Interrupt() or
+// Pause(), are run by the audio thread while the main loop waits. The main
+// loop is woken up through the poll descriptor of this sink once the audio
+// thread takes audio out of the ring buffer.
+class ThreadedSink : public AudioSink {
+ public:
+  // Sink options.
+  struct Options {
+    Options() noexcept {}
+
+    // Whether to report how the audio thread was set up.
+    bool verbose = false;
+
+    // SCHED_FIFO priority of the audio thread, from 1 to 99, or 0 to leave it
+    // with the normal policy.
+    int priority = 50;
+
+    // CPU to pin the audio thread to, or -1 to let it run on any CPU.
+    int cpu = -1;
+
+    // Whether to lock the memory of the process with mlockall().
+    bool lock_memory = true;
+  };
+
+  // Takes ownership of the given sink, which is only used from the audio
+  // thread from now on. Throws std::system_error if the thread or its
+  // descriptors cannot be created.
+  explicit ThreadedSink(std::unique_ptr<AudioSink> device,
+                        const Options& options = Options());
+  ~ThreadedSink() override;
+
+  // Pins the calling thread to the given CPU. Returns false on failure.
+  static bool PinThread(int cpu);
+
+  // AudioSink overrides.
+  bool running() const override { return running_; }
+  int underruns() const override { return underruns_; }
+  void Reconfigure(std::chrono::microseconds buffer_time) override;
+  std::vector<struct pollfd> GetPollDescriptors() const override;
+  int GetPollEvents(struct pollfd* fds, int nfds) const override;
+  void Drain() override;
+  bool Pause() override;
+  void Resume() override;
+  snd_pcm_sframes_t GetDelay() const override;
+  void Idle() override;
+  void Interrupt() override;
+
+ protected:
+  std::size_t Write(const char* data, std::size_t count) override;
+
+ private:
+  // Body of the audio thread.
+  void AudioLoop();
+
+  // Moves audio from the ring buffer to the device, as much as the device
+  // takes without staging more than a period. Returns whether any was moved.
+  bool Transfer();
+
+  // Waits for the device, or for the main loop to write or send a command.
+  void Wait();
+
+  // Publishes the state of the device for the main loop.
+  void Publish();
+
+  // Runs the given function on the audio thread, and waits for it.
+  void RunInAudioThread(const std::function<void()>& function);
+
+  // Runs the pending command, if any. Called from the audio thread.
+  void RunCommand();
+
+  // Sizes the ring buffer after the device buffer, dropping its audio.
+  void ResizeRing();
+
+  // Returns the number of frames in the ring buffer.
+  std::size_t ring_frames() const {
+    return (write_ + ring_slots_ - read_) % ring_slots_;
+  }
+
+  // Rethrows the error of the audio thread, if it failed.
+  void CheckFailure() const;
+
+  const Options options_;
+  std::unique_ptr<AudioSink> device_;
+
+  // Ring buffer of ring_slots_ frames, which holds one less. The main loop
+  // advances write_, the audio thread read_.
+  std::unique_ptr<char[]> ring_;
+  std::size_t ring_slots_ = 0;
+  std::atomic<std::size_t> read_{0};
+  std::atomic<std::size_t> write_{0};
+
+  // Descriptors woken up by the main loop for the audio thread, and by the
+  // audio thread for the main loop when there is room in the ring buffer.
+  int wakeup_fd_ = -1;
+  int space_fd_ = -1;
+
+  // State of the device, published by the audio thread.
+  std::atomic<bool> running_{false};
+  std::atomic<int> underruns_{0};
+  std::atomic<long> device_delay_{0};
+
+  // Command for the audio thread, and whether it is pending. The mutex also
+  // guards error_.
+  mutable std::mutex command_mutex_;
+  std::condition_variable command_done_;
+  const std::function<void()>* command_ = nullptr;
+  std::atomic<bool> command_pending_{false};
+
+  // Whether the device must be set idle once the ring buffer is empty. Only
+  // used by the audio thread.
+  bool idle_pending_ = false;
+
+  // Descriptors polled by the audio thread: the wakeup descriptor, followed
+  // by those of the device.
+  std::vector<struct pollfd> fds_;
+
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+#endif  // THREADED_SINK_H_
@@ -0,0 +1,150 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "threaded_sink.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "null_sink.h"
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Writes the given number of frames of silence to the sink as the audio
+// manager does, waiting on the descriptors of the sink whenever it is not
+// ready. Returns false if the sink was not ready within a second.
+bool Produce(AudioSink* sink, std::size_t frames) {
+  std::memset(sink->buffer(), 0, sink->period_size() * sink->frame_size());
+  while (frames > 0 || sink->pending()) {
+    std::vector<struct pollfd> fds = sink->GetPollDescriptors();
+    if (poll(fds.data(), fds.size(), 1000) <= 0) return false;
+    if (!sink->GetPollEvents(fds.data(), fds.size())) continue;
+    if (!sink->Flush()) continue;
+    const std::size_t count =
+        std::min<std::size_t>(frames, sink->period_size());
+    frames -= sink->Play(count);
+  }
+  return true;
+}
+
+// Sink of a device that fails on the first write, as if it was unplugged.
+class FailingSink : public NullSink {
+ public:
+  explicit FailingSink(const Options& options) : NullSink(options) {}
+
+ protected:
+  std::size_t Write(const char* data, std::size_t count) override {
+    throw std::runtime_error("Device lost");
+  }
+};
+
+// Makes a sink playing on a null sink with a virtual clock, which the audio
+// thread fills as fast as it can.
+template <typename Device = NullSink>
+std::unique_ptr<ThreadedSink> MakeSink(NullSink** device) {
+  NullSink::Options device_options;
+  device_options.clock = NullSink::VIRTUAL;
+  *device = new Device(device_options);
+
+  ThreadedSink::Options options;
+  options.priority = 0;
+  options.lock_memory = false;
+  return std::unique_ptr<ThreadedSink>(
+      new ThreadedSink(std::unique_ptr<AudioSink>(*device), options));
+}
+
+int main() {
+  {
+    NullSink* device = nullptr;
+    std::unique_ptr<ThreadedSink> sink = MakeSink(&device);
+    Check("Period size", sink->period_size() == device->period_size(),
+          sink->period_size());
+    Check("Ring buffer as large as the device buffer",
+          sink->buffer_size() == 2 * device->buffer_size(),
+          sink->buffer_size());
+
+    const std::size_t frames = 10 * device->buffer_size() + 7;
+    const bool produced = Produce(sink.get(), frames);
+    sink->Drain();
+    Check("All the audio played", produced &&
+                                      device->frames_written() == frames &&
+                                      sink->GetDelay() == 0,
+          device->frames_written());
+    Check("No underruns", sink->underruns() == 0, sink->underruns());
+  }
+
+  {
+    NullSink* device = nullptr;
+    std::unique_ptr<ThreadedSink> sink = MakeSink(&device);
+    Produce(sink.get(), sink->buffer_size());
+    Check("Paused", sink->Pause(), sink->GetDelay());
+    sink->Resume();
+
+    sink->Interrupt();
+    Check("Interrupted", sink->GetDelay() == 0 && !sink->running(),
+          sink->GetDelay());
+
+    // The sink takes new audio after an interrupt.
+    const std::uint64_t written = device->frames_written();
+    const bool produced = Produce(sink.get(), device->period_size());
+    sink->Drain();
+    Check("Audio after the interrupt",
+          produced && device->frames_written() ==
+                          written + device->period_size(),
+          device->frames_written() - written);
+  }
+
+  {
+    // The failure of the audio thread reaches the main loop, instead of
+    // leaving it waiting for the thread.
+    NullSink* device = nullptr;
+    std::unique_ptr<ThreadedSink> sink = MakeSink<FailingSink>(&device);
+    std::memset(sink->buffer(), 0, sink->period_size() * sink->frame_size());
+    sink->Play(sink->period_size());
+
+    int failures = 0;
+    try {
+      sink->Drain();
+    } catch (std::runtime_error& e) {
+      ++failures;
+    }
+    try {
+      sink->Pause();
+    } catch (std::runtime_error& e) {
+      ++failures;
+    }
+    Check("Failure of the audio thread reported", failures == 2, failures);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,136 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "time_stretcher.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr int TimeStretcher::kHopMs;
+constexpr int TimeStretcher::kToleranceMs;
+constexpr double TimeStretcher::kMinTempo;
+constexpr double TimeStretcher::kMaxTempo;
+
+TimeStretcher::TimeStretcher(unsigned int sample_rate)
+    : hop_(std::max(1u, sample_rate * kHopMs / 1000)),
+      frame_(2 * hop_),
+      tolerance_(sample_rate * kToleranceMs / 1000),
+      window_(frame_),
+      overlap_(hop_) {
+  // Periodic Hann window, whose halves add up to one at a hop of half its
+  // length.
+  for (std::size_t i = 0; i < frame_; ++i) {
+    window_[i] = 0.5 - 0.5 * std::cos(2 * M_PI * i / frame_);
+  }
+}
+
+void TimeStretcher::set_tempo(double tempo) {
+  tempo_ = std::min(kMaxTempo, std::max(kMinTempo, tempo));
+}
+
+std::size_t TimeStretcher::MaxOutputSamples(std::size_t count) const {
+  const double hops = (input_.size() + count) / (hop_ * tempo_);
+  return (static_cast<std::size_t>(hops) + 1) * hop_;
+}
+
+std::size_t TimeStretcher::Process(const float* in, std::size_t count,
+                                   float* out) {
+  input_.insert(input_.end(), in, in + count);
+
+  std::size_t written = 0;
+  while (true) {
+    const std::size_t nominal = static_cast<std::size_t>(position_);
+    const std::size_t first =
+        primed_ ? nominal - std::min(nominal, tolerance_) : nominal;
+    const std::size_t last = primed_ ? nominal + tolerance_ : nominal;
+    if (last + frame_ > input_.size()) break;
+
+    const std::size_t start = primed_ ? FindBestFrame(first, nominal, last) : nominal;
+    const float* frame = &input_[start];
+
+    // The first frame after a reset starts at full level instead of fading
+    // in.
+    for (std::size_t i = 0; i < hop_; ++i) {
+      out[written + i] =
+          primed_ ? overlap_[i] + window_[i] * frame[i] : frame[i];
+    }
+    for (std::size_t i = 0; i < hop_; ++i) {
+      overlap_[i] = window_[hop_ + i] * frame[hop_ + i];
+    }
+    written += hop_;
+
+    previous_ = start;
+    primed_ = true;
+    position_ += hop_ * tempo_;
+  }
+
+  // Drop the input that is neither needed to search the next frame nor to
+  // continue the previous one.
+  if (primed_) {
+    const std::size_t nominal = static_cast<std::size_t>(position_);
+    const std::size_t consumed = std::min(
+        previous_ + hop_, nominal - std::min(nominal, tolerance_));
+    input_.erase(input_.begin(), input_.begin() + consumed);
+    previous_ -= consumed;
+    position_ -= consumed;
+  }
+  return written;
+}
+
+std::size_t TimeStretcher::FindBestFrame(std::size_t first,
+                                         std::size_t nominal,
+                                         std::size_t last) const {
+  // The previous frame would naturally continue one hop after its start. The
+  // candidate whose first half is most similar to that continuation, by
+  // normalized cross-correlation, overlaps it best.
+  const float* target = &input_[previous_ + hop_];
+
+  double energy = 0;
+  for (std::size_t i = 0; i < hop_; ++i) {
+    energy += input_[first + i] * input_[first + i];
+  }
+
+  std::size_t best = nominal;
+  double best_score = -1e30;
+  double nominal_score = 0;
+  for (std::size_t k = first; k <= last; ++k) {
+    const float* candidate = &input_[k];
+    float correlation = 0;
+    for (std::size_t i = 0; i < hop_; ++i) {
+      correlation += candidate[i] * target[i];
+    }
+    const double score = correlation / std::sqrt(energy + 1e-9);
+    if (score > best_score) {
+      best_score = score;
+      best = k;
+    }
+    if (k == nominal) nominal_score = score;
+    energy += candidate[hop_] * candidate[hop_] - candidate[0] * candidate[0];
+    energy = std::max(0.0, energy);
+  }
+
+  // Periodic signals match equally well one period away. Staying at the
+  // nominal position then keeps the tempo exact.
+  if (nominal_score >= best_score - 1e-4 * std::fabs(best_score)) {
+    return nominal;
+  }
+  return best;
+}
+
+void TimeStretcher::Reset() {
+  input_.clear();
+  position_ = 0;
+  previous_ = 0;
+  primed_ = false;
+}
@@ -0,0 +1,89 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TIME_STRETCHER_H_
+#define TIME_STRETCHER_H_
+
+#include <cstddef>
+#include <vector>
+
+// Time-scale modification of mono audio, changing its tempo without
+// changing its pitch, with WSOLA (waveform similarity overlap-add).
+//
+// The output is built from overlapping windowed frames of the input, one
+// every kHopMs. Frames are nominally taken from the input at the hop times
+// the tempo, but each one is shifted by up to kToleranceMs to the position
+// where it best continues the waveform of the previous frame, so the
+// overlap-add does not cancel out the periodicity of the voice. At tempo one,
+// the best position is always the nominal one and the input comes out
+// unchanged.
+class TimeStretcher {
+ public:
+  static constexpr int kHopMs = 10;
+  static constexpr int kToleranceMs = 6;
+
+  static constexpr double kMinTempo = 0.5;
+  static constexpr double kMaxTempo = 3.0;
+
+  explicit TimeStretcher(unsigned int sample_rate);
+
+  double tempo() const { return tempo_; }
+
+  // Sets the tempo, e.g. 2 to play twice as fast, clamped to
+  // [kMinTempo, kMaxTempo]. Takes effect from the next frame.
+  void set_tempo(double tempo);
+
+  // Returns whether there is input that did not come out yet.
+  bool pending() const { return !input_.empty(); }
+
+  // Returns the number of input samples kept before producing output. This
+  // many samples of silence push all the input through.
+  std::size_t latency() const { return frame_ + 2 * tolerance_; }
+
+  // Returns the maximum number of samples that Process() may write for the
+  // given number of input samples, at the current tempo.
+  std::size_t MaxOutputSamples(std::size_t count) const;
+
+  // Stretches count input samples, writing the output samples to out and
+  // returning how many were written.
+  std::size_t Process(const float* in, std::size_t count, float* out);
+
+  // Forgets the input kept from previous calls.
+  void Reset();
+
+ private:
+  // Returns the start of the frame within [first, last] that best continues
+  // the previous frame, preferring the nominal start.
+  std::size_t FindBestFrame(std::size_t first, std::size_t nominal,
+                            std::size_t last) const;
+
+  const std::size_t hop_;
+  const std::size_t frame_;
+  const std::size_t tolerance_;
+  std::vector<float> window_;
+
+  double tempo_ = 1.0;
+
+  // Input not consumed yet, nominal start of the next frame in it, and start
+  // of the previous frame.
+  std::vector<float> input_;
+  double position_ = 0;
+  std::size_t previous_ = 0;
+  bool primed_ = false;
+
+  // Second half of the previous windowed frame, to be added to the next one.
+  std::vector<float> overlap_;
+};
+
+#endif  // TIME_STRETCHER_H_
@@ -0,0 +1,123 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "time_stretcher.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+const unsigned int kSampleRate = 11025;
+
+// Returns one second of a vowel-like signal: harmonics of a pitch that varies
+// slowly, as in speech.
+std::vector<float> MakeVoice() {
+  std::vector<float> samples(kSampleRate);
+  double phase = 0;
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    const double pitch = 120 + 20 * std::sin(2 * M_PI * 2 * i / kSampleRate);
+    phase += 2 * M_PI * pitch / kSampleRate;
+    samples[i] = 0.3 * std::sin(phase) + 0.2 * std::sin(2 * phase) +
+                 0.1 * std::sin(3 * phase);
+  }
+  return samples;
+}
+
+// Stretches the samples in blocks of odd sizes, followed by silence to push
+// out the last of them.
+std::vector<float> Stretch(const std::vector<float>& samples, double tempo) {
+  TimeStretcher stretcher(kSampleRate);
+  stretcher.set_tempo(tempo);
+  std::vector<float> in(samples);
+  in.resize(in.size() + stretcher.latency(), 0.0f);
+
+  std::vector<float> out;
+  for (std::size_t i = 0; i < in.size();) {
+    const std::size_t count = std::min<std::size_t>(in.size() - i, 331);
+    std::vector<float> block(stretcher.MaxOutputSamples(count));
+    block.resize(stretcher.Process(&in[i], count, block.data()));
+    out.insert(out.end(), block.begin(), block.end());
+    i += count;
+  }
+  return out;
+}
+
+// Returns the average frequency of the samples, from their zero crossings.
+double Frequency(const std::vector<float>& samples, std::size_t count) {
+  int crossings = 0;
+  for (std::size_t i = 1; i < count; ++i) {
+    if (samples[i - 1] < 0 && samples[i] >= 0) ++crossings;
+  }
+  return crossings * static_cast<double>(kSampleRate) / count;
+}
+
+int main() {
+  const std::vector<float> voice = MakeVoice();
+
+  {
+    const std::vector<float> out = Stretch(voice, 1.0);
+    double error = 0;
+    for (std::size_t i = 0; i < voice.size() && i < out.size(); ++i) {
+      error = std::max(error, std::fabs(static_cast<double>(out[i] - voice[i])));
+    }
+    Check("Unchanged at tempo one, error", error < 1e-5, error);
+  }
+
+  {
+    // A pure tone keeps its frequency at any tempo.
+    std::vector<float> tone(kSampleRate);
+    for (std::size_t i = 0; i < tone.size(); ++i) {
+      tone[i] = 0.5 * std::sin(2 * M_PI * 200 * i / kSampleRate);
+    }
+    for (double tempo : {0.75, 1.5, 2.5}) {
+      const std::vector<float> out = Stretch(tone, tempo);
+      const double expected = tone.size() / tempo;
+      Check("Length at tempo " + std::to_string(tempo),
+            std::fabs(out.size() - expected) < 0.05 * expected, out.size());
+      const double frequency = Frequency(out, expected * 0.9);
+      Check("Pitch at tempo " + std::to_string(tempo),
+            std::fabs(frequency - 200) < 5, frequency);
+    }
+  }
+
+  {
+    // A speech-like signal keeps its level, without the cancellation of a
+    // plain overlap-add.
+    const std::vector<float> out = Stretch(voice, 1.7);
+    double in_energy = 0, out_energy = 0;
+    for (float x : voice) in_energy += x * x;
+    for (std::size_t i = 0; i < voice.size() / 1.7; ++i) {
+      out_energy += out[i] * out[i];
+    }
+    const double ratio = (out_energy * 1.7) / in_energy;
+    Check("Energy ratio at tempo 1.7", ratio > 0.9 && ratio < 1.1, ratio);
+  }
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tone_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr int Oscillator::kLanes;
+constexpr int ToneGenerator::kRampMs;
+
+// Oscillator
+
+Oscillator::Oscillator(float frequency, unsigned int sample_rate) {
+  const double step = 2 * M_PI * frequency / sample_rate;
+  for (int k = 0; k < kLanes; ++k) {
+    re_[k] = std::cos(step * k);
+    im_[k] = std::sin(step * k);
+  }
+  step_re_ = std::cos(step * kLanes);
+  step_im_ = std::sin(step * kLanes);
+}
+
+void Oscillator::Rotate() {
+  for (int k = 0; k < kLanes; ++k) {
+    const float re = re_[k] * step_re_ - im_[k] * step_im_;
+    const float im = re_[k] * step_im_ + im_[k] * step_re_;
+    re_[k] = re;
+    im_[k] = im;
+  }
+}
+
+void Oscillator::Fill(float* out, std::size_t count) {
+  std::size_t i = 0;
+
+  // Finish the block started by the previous call.
+  while (used_ > 0 && used_ < kLanes && i < count) {
+    out[i++] = im_[used_++];
+  }
+  if (used_ == kLanes) {
+    Rotate();
+    used_ = 0;
+  }
+
+  for (; i + kLanes <= count; i += kLanes) {
+    for (int k = 0; k < kLanes; ++k) {
+      out[i + k] = im_[k];
+    }
+    Rotate();
+  }
+
+  while (i < count) {
+    out[i++] = im_[used_++];
+  }
+
+  // Rounding errors slowly change the magnitude of the phasors, so bring it
+  // back to one once per call.
+  for (int k = 0; k < kLanes; ++k) {
+    const float scale = 1.0f / std::sqrt(re_[k] * re_[k] + im_[k] * im_[k]);
+    re_[k] *= scale;
+    im_[k] *= scale;
+  }
+}
+
+// ToneGenerator
+
+ToneGenerator::ToneGenerator(float frequency, float amplitude,
+                             std::size_t duration_frames,
+                             unsigned int sample_rate)
+    : oscillator_(frequency, sample_rate),
+      amplitude_(amplitude),
+      duration_(duration_frames),
+      ramp_(std::min<std::size_t>(kRampMs * sample_rate / 1000,
+                                  duration_frames / 2)) {}
+
+std::size_t ToneGenerator::Generate(float* out, std::size_t count) {
+  count = std::min(count, duration_ - position_);
+  oscillator_.Fill(out, count);
+
+  // Apply the amplitude, ramping it up at the start and down at the end.
+  for (std::size_t i = 0; i < count; ++i) {
+    const std::size_t t = position_ + i;
+    float gain = amplitude_;
+    if (t < ramp_) {
+      gain *= static_cast<float>(t) / ramp_;
+    } else if (duration_ - t <= ramp_) {
+      gain *= static_cast<float>(duration_ - t - 1) / ramp_;
+    }
+    out[i] *= gain;
+  }
+
+  position_ += count;
+  return count;
+}
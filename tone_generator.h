@@ -0,0 +1,78 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TONE_GENERATOR_H_
+#define TONE_GENERATOR_H_
+
+#include <cstddef>
+
+// Sine oscillator without per-sample trigonometric functions.
+//
+// The oscillator keeps kLanes consecutive samples of the sine wave as phasors
+// (points on the unit circle), and produces the next kLanes samples by
+// rotating all of them by kLanes times the phase step. The lanes are
+// independent of each other, so the compiler can compute them in parallel
+// with SIMD instructions.
+class Oscillator {
+ public:
+  static constexpr int kLanes = 4;
+
+  Oscillator(float frequency, unsigned int sample_rate);
+
+  // Writes the next count samples of the sine wave, with amplitude one.
+  void Fill(float* out, std::size_t count);
+
+ private:
+  // Advances all lanes to the next block of samples.
+  void Rotate();
+
+  // Phasors of the current block of samples. The samples are the imaginary
+  // parts.
+  float re_[kLanes];
+  float im_[kLanes];
+
+  // Rotation from one block to the next.
+  float step_re_;
+  float step_im_;
+
+  // Number of samples of the current block already written.
+  int used_ = 0;
+};
+
+// Sine tone with linear attack and release ramps, so it starts and stops
+// without clicks.
+class ToneGenerator {
+ public:
+  // Duration of the attack and release ramps, unless the tone is too short.
+  static constexpr int kRampMs = 5;
+
+  ToneGenerator(float frequency, float amplitude, std::size_t duration_frames,
+                unsigned int sample_rate);
+
+  // Returns whether the whole tone was generated.
+  bool done() const { return position_ == duration_; }
+
+  // Writes up to count samples of the tone, and returns how many were
+  // written.
+  std::size_t Generate(float* out, std::size_t count);
+
+ private:
+  Oscillator oscillator_;
+  const float amplitude_;
+  const std::size_t duration_;
+  const std::size_t ramp_;
+  std::size_t position_ = 0;
+};
+
+#endif  // TONE_GENERATOR_H_
@@ -0,0 +1,173 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tracer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Writes the text as a JSON string.
+void WriteString(std::ostream& out, const char* text) {
+  out << '"';
+  for (const char* c = text; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      out << '\\' << *c;
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      out << escaped;
+    } else {
+      out << *c;
+    }
+  }
+  out << '"';
+}
+
+}  // namespace
+
+Tracer* Tracer::tracer_ = nullptr;
+constexpr std::size_t Tracer::kBatchSize;
+
+Tracer::Tracer(const Options& options) : options_(options) {
+  if (options_.ring_size > 0) {
+    events_.reserve(options_.ring_size);
+    return;
+  }
+
+  file_.open(options_.file, std::ios::out | std::ios::trunc);
+  if (!file_.is_open()) {
+    throw std::system_error(errno, std::system_category(),
+                            "Tracer: Failed to open " + options_.file);
+  }
+  events_.reserve(kBatchSize);
+  WriteHeader(file_, &written_);
+}
+
+Tracer::~Tracer() {
+  if (tracer_ == this) {
+    tracer_ = nullptr;
+  }
+  if (options_.ring_size == 0) {
+    Dump();
+    file_ << "\n]\n";
+  }
+}
+
+void Tracer::Record(char phase, const char* name, std::uint64_t id,
+                    Clock::time_point time, const char* arg_name,
+                    std::int64_t arg, const char* detail) {
+  static thread_local const int thread = syscall(SYS_gettid);
+  if (time == Clock::time_point()) {
+    time = Clock::now();
+  }
+
+  Event event;
+  event.name = name;
+  event.arg_name = arg_name;
+  event.arg = arg;
+  event.id = id;
+  event.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      time.time_since_epoch()).count();
+  event.thread = thread;
+  event.phase = phase;
+  event.detail[0] = '\0';
+  if (detail != nullptr) {
+    std::strncpy(event.detail, detail, sizeof(event.detail) - 1);
+    event.detail[sizeof(event.detail) - 1] = '\0';
+  }
+
+  if (options_.ring_size == 0) {
+    events_.push_back(event);
+    if (events_.size() >= kBatchSize) {
+      Dump();
+    }
+  } else if (events_.size() < options_.ring_size) {
+    events_.push_back(event);
+  } else {
+    events_[next_] = event;
+    next_ = (next_ + 1) % options_.ring_size;
+  }
+}
+
+std::size_t Tracer::Dump() {
+  const std::size_t count = events_.size();
+  if (options_.ring_size == 0) {
+    WriteEvents(file_, &written_);
+    events_.clear();
+    if (!file_.flush()) {
+      std::cerr << "Tracer: Failed to write " << options_.file << std::endl;
+    }
+    return count;
+  }
+
+  std::ofstream out(options_.file, std::ios::out | std::ios::trunc);
+  bool written = false;
+  WriteHeader(out, &written);
+  WriteEvents(out, &written);
+  out << "\n]\n";
+  if (!out.flush()) {
+    std::cerr << "Tracer: Failed to write " << options_.file << std::endl;
+    return 0;
+  }
+  return count;
+}
+
+void Tracer::WriteHeader(std::ostream& out, bool* written) const {
+  out << "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << getpid()
+      << ",\"args\":{\"name\":\"speech_server\"}}";
+  *written = true;
+}
+
+void Tracer::WriteEvents(std::ostream& out, bool* written) const {
+  const int pid = getpid();
+  for (std::size_t i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[(next_ + i) % events_.size()];
+    if (*written) {
+      out << ",\n";
+    }
+    *written = true;
+
+    char time[32];
+    std::snprintf(time, sizeof(time), "%lld.%03d",
+                  static_cast<long long>(event.time_ns / 1000),
+                  static_cast<int>(event.time_ns % 1000));
+    out << "{\"name\":";
+    WriteString(out, event.name);
+    out << ",\"cat\":\"statement\",\"ph\":\"" << event.phase
+        << "\",\"id\":" << event.id << ",\"pid\":" << pid
+        << ",\"tid\":" << event.thread << ",\"ts\":" << time;
+    if (event.arg_name != nullptr || event.detail[0] != '\0') {
+      out << ",\"args\":{";
+      if (event.arg_name != nullptr) {
+        WriteString(out, event.arg_name);
+        out << ":" << event.arg;
+      }
+      if (event.detail[0] != '\0') {
+        if (event.arg_name != nullptr) out << ",";
+        out << "\"detail\":";
+        WriteString(out, event.detail);
+      }
+      out << "}";
+    }
+    out << "}";
+  }
+}
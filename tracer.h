@@ -0,0 +1,146 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TRACER_H_
+#define TRACER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Tracer of the lifecycle of the statements of the server, in the Chrome
+// trace-event format, which chrome://tracing and Perfetto open.
+//
+// Each traced statement has an id, and its lifecycle is an async slice of
+// that id, from the moment it is read to the moment its task is destroyed,
+// with nested slices and instant events for each step, e.g. formatting,
+// dispatch by a d command, or the first audio of its task. Events are
+// recorded through static functions that do nothing, besides testing a
+// pointer, until a tracer is installed, so the code is instrumented at no
+// cost. Events are either written to the trace file as they are recorded,
+// in batches, or only the latest ones are kept in a ring buffer, as a flight
+// recorder, which is written to the file on demand.
+//
+// Events are only recorded from the thread of the main loop, so the tracer
+// takes no lock.
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    Options() noexcept {}
+
+    // Trace file, in the JSON array format.
+    std::string file;
+
+    // Number of latest events to keep for Dump(), or zero to write all the
+    // events to the file.
+    std::size_t ring_size = 0;
+  };
+
+  // Opens the trace file. Throws std::system_error on failure.
+  explicit Tracer(const Options& options);
+
+  // Writes the events recorded since the last batch, unless the tracer is a
+  // flight recorder.
+  ~Tracer();
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  // Sets the tracer that records events, or nullptr to stop recording.
+  static void Install(Tracer* tracer) { tracer_ = tracer; }
+  static bool enabled() { return tracer_ != nullptr; }
+
+  // Returns a new id to trace, or zero if tracing is disabled.
+  static std::uint64_t NextId() {
+    return tracer_ != nullptr ? ++tracer_->last_id_ : 0;
+  }
+
+  // Record the beginning and the end of a slice of the given id, or an
+  // instant event in it, with an optional integer argument. The beginning
+  // may have a short text of detail, e.g. the name of the command, and a
+  // time other than now. Nothing is recorded for id zero.
+  static void Begin(const char* name, std::uint64_t id,
+                    const char* detail = nullptr,
+                    Clock::time_point time = Clock::time_point()) {
+    if (tracer_ != nullptr && id != 0) {
+      tracer_->Record('b', name, id, time, nullptr, 0, detail);
+    }
+  }
+  static void End(const char* name, std::uint64_t id) {
+    if (tracer_ != nullptr && id != 0) {
+      tracer_->Record('e', name, id, Clock::time_point(), nullptr, 0);
+    }
+  }
+  static void Mark(const char* name, std::uint64_t id,
+                   const char* arg_name = nullptr, std::int64_t arg = 0) {
+    if (tracer_ != nullptr && id != 0) {
+      tracer_->Record('n', name, id, Clock::time_point(), arg_name, arg);
+    }
+  }
+
+  // Writes the events kept in memory to the trace file: the ring buffer of a
+  // flight recorder replaces the file, otherwise the events recorded since
+  // the last batch are appended to it. Returns the number of events written.
+  std::size_t Dump();
+
+  // Returns the number of events kept in memory.
+  std::size_t size() const { return events_.size(); }
+
+ private:
+  // Event as recorded. Names are string literals.
+  struct Event {
+    const char* name;
+    const char* arg_name;
+    std::int64_t arg;
+    std::uint64_t id;
+    std::int64_t time_ns;
+    int thread;
+    char phase;
+    char detail[19];
+  };
+
+  // Number of events written to the trace file at once.
+  static constexpr std::size_t kBatchSize = 4096;
+
+  void Record(char phase, const char* name, std::uint64_t id,
+              Clock::time_point time, const char* arg_name, std::int64_t arg,
+              const char* detail = nullptr);
+
+  // Writes the start of a trace file, and the events in memory in the order
+  // they were recorded, separated by commas from those already written.
+  void WriteHeader(std::ostream& out, bool* written) const;
+  void WriteEvents(std::ostream& out, bool* written) const;
+
+  static Tracer* tracer_;
+
+  const Options options_;
+  std::ofstream file_;
+
+  // Events not written yet, or the ring buffer of the flight recorder, whose
+  // oldest event is at next_ once full.
+  std::vector<Event> events_;
+  std::size_t next_ = 0;
+
+  // Whether an event was written to the file, so the next one is preceded
+  // by a comma.
+  bool written_ = false;
+  std::uint64_t last_id_ = 0;
+};
+
+#endif  // TRACER_H_
@@ -0,0 +1,117 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tracer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+string ReadFile(const string& path) {
+  std::ifstream in(path);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+int Count(const string& text, const string& pattern) {
+  int count = 0;
+  for (std::size_t pos = text.find(pattern); pos != string::npos;
+       pos = text.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+int main() {
+  const string path = "/tmp/tracer_test." + std::to_string(getpid()) + ".json";
+
+  // Nothing is recorded while no tracer is installed.
+  Check("Disabled", !Tracer::enabled() && Tracer::NextId() == 0, 0);
+  Tracer::Begin("Statement", 1, "q");
+
+  // All the events are written to the file, with the lifecycle of each id.
+  {
+    Tracer::Options options;
+    options.file = path;
+    Tracer tracer(options);
+    Tracer::Install(&tracer);
+    const std::uint64_t id = Tracer::NextId();
+    Check("First id", id == 1, id);
+    Tracer::Begin("Statement", id, "q");
+    Tracer::Begin("Format", id);
+    Tracer::End("Format", id);
+    Tracer::Mark("FirstAudio", id, "frames", 256);
+    Tracer::End("Statement", id);
+    Tracer::Mark("Untraced", 0);
+  }
+  Check("Uninstalled", !Tracer::enabled(), 0);
+
+  string trace = ReadFile(path);
+  Check("Array", trace.compare(0, 2, "[\n") == 0 &&
+                     trace.compare(trace.size() - 3, 3, "\n]\n") == 0,
+        trace.size());
+  Check("Begin events", Count(trace, "\"ph\":\"b\"") == 2,
+        Count(trace, "\"ph\":\"b\""));
+  Check("End events", Count(trace, "\"ph\":\"e\"") == 2,
+        Count(trace, "\"ph\":\"e\""));
+  Check("Detail", Count(trace, "\"args\":{\"detail\":\"q\"}") == 1, 0);
+  Check("Argument", Count(trace, "\"args\":{\"frames\":256}") == 1, 0);
+  Check("Id zero", Count(trace, "Untraced") == 0, 0);
+
+  // The flight recorder keeps the latest events, in order, until dumped.
+  {
+    Tracer::Options options;
+    options.file = path;
+    options.ring_size = 4;
+    Tracer tracer(options);
+    Tracer::Install(&tracer);
+    for (int i = 0; i < 10; ++i) {
+      Tracer::Mark("Event", Tracer::NextId());
+    }
+    Check("Ring size", tracer.size() == 4, tracer.size());
+    const std::size_t dumped = tracer.Dump();
+    Check("Dumped", dumped == 4, dumped);
+  }
+
+  trace = ReadFile(path);
+  const std::size_t first = trace.find("\"id\":7,");
+  const std::size_t last = trace.find("\"id\":10,");
+  Check("Latest events", Count(trace, "\"ph\":\"n\"") == 4 &&
+                             trace.find("\"id\":6,") == string::npos &&
+                             first != string::npos && last != string::npos &&
+                             first < last,
+        Count(trace, "\"ph\":\"n\""));
+
+  std::remove(path.c_str());
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -13,12 +13,13 @@
 // limitations under the License.
 
 #include "tts.h"
-#include "alsa_player.h"
+#include "audio_sink.h"
 
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <sstream>
 #include <string>
@@ -26,43 +27,101 @@
 using std::string;
 using std::vector;
 
+namespace {
+
+const std::map<string, ECILanguageDialect> kSupportedLanguages = {
+    {"en_US", eciGeneralAmericanEnglish}, {"en_GB", eciBritishEnglish},
+    {"es_ES", eciCastilianSpanish},       {"es_MX", eciMexicanSpanish},
+    {"fr_FR", eciStandardFrench},         {"fr_CA", eciCanadianFrench},
+    {"de_DE", eciStandardGerman},         {"it_IT", eciStandardItalian},
+    {"pt_BR", eciBrazilianPortuguese},    {"fi_FI", eciStandardFinnish}};
+
+// Voice presets, in the same order as TTS::ECIVoiceAnnotation.
+const VoicePreset kVoicePresets[] = {
+    // name, base_voice, head_size, pitch_baseline, pitch_fluctuation, volume
+    {"paul", 1, VoicePreset::kKeep, VoicePreset::kKeep, VoicePreset::kKeep,
+     VoicePreset::kKeep},
+    {"harry", 1, 65, 50, VoicePreset::kKeep, VoicePreset::kKeep},
+    {"dennis", 1, VoicePreset::kKeep, 45, 10, VoicePreset::kKeep},
+    {"frank", 1, 75, 55, VoicePreset::kKeep, VoicePreset::kKeep},
+    {"betty", 7, VoicePreset::kKeep, VoicePreset::kKeep, VoicePreset::kKeep,
+     VoicePreset::kKeep},
+    {"ursula", 2, VoicePreset::kKeep, VoicePreset::kKeep, VoicePreset::kKeep,
+     VoicePreset::kKeep},
+    {"rita", 2, 55, 70, VoicePreset::kKeep, VoicePreset::kKeep},
+    {"wendy", 2, 45, 90, VoicePreset::kKeep, VoicePreset::kKeep},
+    {"kit", 3, VoicePreset::kKeep, VoicePreset::kKeep, VoicePreset::kKeep,
+     VoicePreset::kKeep},
+};
+
+static_assert(sizeof(kVoicePresets) / sizeof(kVoicePresets[0]) ==
+                  TTS::NO_ANNOTATION,
+              "There must be one voice preset for each voice.");
+
+}  // namespace
+
 constexpr char TTS::kEciLibraryName[];
 
-TTS::TTS(AudioManager *audio, const Options &options) : audio_(audio) {
-  languages_ = ECI::GetAvailableLanguages();
+TTS::TTS(AudioManager *audio, const Options &options)
+    : options_(options),
+      audio_(audio),
+      converter_(new SpeechConverter(GetSampleRateHz(options.sample_rate),
+                                     *audio->player(),
+                                     options.resample_quality)),
+      voices_(vector<VoicePreset>(std::begin(kVoicePresets),
+                                  std::end(kVoicePresets))) {
+  const vector<ECILanguageDialect> languages = ECI::GetAvailableLanguages();
 
-  if (languages_.empty()) {
+  if (languages.empty()) {
     throw TTSError("No languages found.");
   }
-  int i;
-  for (i = 0; i < languages_.size(); ++i) {
-    if (languages_[i] == options.default_language) break;
+  std::size_t i;
+  for (i = 0; i < languages.size(); ++i) {
+    if (languages[i] == options.default_language) break;
+  }
+
+  // Initialize each engine in the same way. Callbacks are installed by each
+  // speech task while it runs, and send the audio from the output buffer of
+  // the engine to the player.
+  auto setup = [options](ECI *eci, short * /*buffer*/) {
+    eci->SetParam(eciInputType, 1);
+    eci->SetParam(eciSynthMode, 1);
+    eci->SetParam(eciSampleRate, options.sample_rate);
+  };
+
+  if (options.trim_silence) {
+    converter_->EnableTrimming(options.trim_options);
   }
 
-  current_language_index_ =
-      i != languages_.size() ? i
-                             : 0 /*Fallback to the first available language.*/;
+  EnginePool::Options pool_options;
+  pool_options.preload = options.preload_languages;
+  // The engine buffer is sized to produce about one period of audio at the
+  // rate of the player.
+  pool_options.buffer_size =
+      converter_->InputFrames(audio_->player()->period_size());
 
-  eci_.reset(new ECI(languages_[current_language_index_]));
+  // At a slow tempo, or after silence held back by the trimmer, one engine
+  // buffer becomes more than one period.
+  audio_->player()->ReserveStaging(
+      converter_->MaxOutputFramesAtAnyTempo(pool_options.buffer_size));
+  engines_.reset(new EnginePool(languages, setup, pool_options));
 
-  // Initialize TTS.
-  eci_->SetParam(eciInputType, 1);
-  eci_->SetParam(eciSynthMode, 1);
-  eci_->SetParam(eciSampleRate, options.sample_rate);
+  if (options_.preload_languages) {
+    for (std::size_t j = 0; j < engines_->size(); ++j) {
+      ReportEngine(j);
+    }
+  }
 
-  eci_->SetCallback(eciWaveformBuffer, [=](long frames) {
-    audio_->player()->Play(frames);
-    return eciDataProcessed;
-  });
-  eci_->SetOutputBuffer(audio_->player()->period_size(),
-                        reinterpret_cast<short *>(audio_->player()->buffer()));
+  UseLanguage(i != languages.size()
+                  ? i
+                  : 0 /*Fallback to the first available language.*/);
 }
 
 TTS::~TTS() {}
 
 SpeechTask *TTS::GetTask() {
   if (pending_task_ == nullptr) {
-    pending_task_.reset(new SpeechTask(eci_.get()));
+    pending_task_.reset(new SpeechTask(eci_, converter_.get()));
   }
   return pending_task_.get();
 }
@@ -71,14 +130,20 @@ std::unique_ptr<SpeechTask> TTS::ReleaseTask() {
   return std::move(pending_task_);
 }
 
-bool TTS::SubmitTask() {
+bool TTS::SubmitTask(AudioManager::Lane lane) {
   if (pending_task_ == nullptr) return false;
-  audio_->Push(ReleaseTask());
+  audio_->Push(ReleaseTask(), lane, source_);
   return true;
 }
 
 bool TTS::AddText(const string &msg) {
   GetTask()->AddText(msg);
+
+  // In-band voice annotations change the active voice of the engine behind
+  // the back of the voice table.
+  if (msg.find("`v") != string::npos) {
+    GetTask()->InvalidateVoice(&voices_);
+  }
   return true;
 }
 
@@ -87,78 +152,154 @@ bool TTS::Synthesize() {
   return true;
 }
 
-const string TTS::GetPrefixString() const {
-  std::ostringstream prefix_string;
-  prefix_string << "`vs" << GetSpeechRate() << " ";
-  return prefix_string.str();
-}
-
 bool TTS::Output(const string &msg) { return AddText(msg) && Synthesize(); }
 
 bool TTS::Say(const string &msg, const ECIVoiceAnnotation voice) {
-  if (voice == NO_ANNOTATION) {
-    return Output(GetPrefixString() + msg);
-  }
-  string voice_prefix;
-  switch (voice) {
-    case DEFAULT_VOICE:
-      voice_prefix = "`v1 ";
-      break;
-    default:
-      break;
-  }
+  GetTask()->SetVoice(
+      &voices_, voice == NO_ANNOTATION ? VoiceTable::kCurrentVoice : voice,
+      GetSpeechRate());
+  return Output(msg);
+}
 
-  return Output(voice_prefix + GetPrefixString() + msg);
+std::unique_ptr<SpeechTask> TTS::MakeNotice(const string &msg) {
+  std::unique_ptr<SpeechTask> task(new SpeechTask(eci_, converter_.get()));
+  task->SetVoice(&voices_, DEFAULT_VOICE, GetSpeechRate());
+  task->AddText(msg);
+  task->Synthesize();
+  return task;
 }
 
 std::unique_ptr<SpeechTask> TTS::UseSelectedVoice(
     const ECIVoiceAnnotation voice) {
-  Say("", voice);
+  GetTask()->SetVoice(
+      &voices_, voice == NO_ANNOTATION ? VoiceTable::kCurrentVoice : voice,
+      GetSpeechRate());
   return ReleaseTask();
 }
 
-bool TTS::GenerateSilence(const int duration) {
-  // The ECI library has a special code to insert silence during speech. We
-  // create a message of this form and simply Output() it.
-  std::ostringstream msg;
-  msg << "`p" << duration;
-  return Output(msg.str());
-}
-
 bool TTS::Pause() {
-  audio_->player()->Pause();
+  if (paused_) return true;
+  if (audio_->player()->Pause()) {
+    paused_ = true;
+    return true;
+  }
+
+  // The device cannot pause, so stop instead, remembering where the speech
+  // was interrupted.
+  interrupted_[source_] = Interrupt();
   return true;
 }
 
 bool TTS::Resume() {
-  audio_->player()->Resume();
+  if (paused_) {
+    audio_->player()->Resume();
+    paused_ = false;
+    return true;
+  }
+
+  // Continue the speech that was stopped by Pause(), from the last word that
+  // was spoken.
+  std::queue<std::unique_ptr<AudioTask>>& tasks = interrupted_[source_];
+  if (tasks.empty()) return false;
+  ReportInterruption();
+  while (!tasks.empty()) {
+    audio_->Push(std::move(tasks.front()), AudioManager::BULK, source_);
+    tasks.pop();
+  }
   return true;
 }
 
 bool TTS::Stop() {
-  audio_->Clear();
-  audio_->player()->Interrupt();
+  Interrupt();
+  interrupted_.erase(source_);
   return true;
 }
 
+void TTS::RemoveSource(int source) {
+  const int current = source_;
+  source_ = source;
+  Stop();
+  source_ = current;
+}
+
 string TTS::TTSVersion() { return eci_->Version(); }
 
 void TTS::NextLanguage() {
-  if (current_language_index_ == languages_.size() - 1) {
-    current_language_index_ = 0;
+  if (current_language_index_ == engines_->size() - 1) {
+    UseLanguage(0);
   } else {
-    ++current_language_index_;
+    UseLanguage(current_language_index_ + 1);
   }
-  eci_->SetParam(eciLanguageDialect, languages_[current_language_index_]);
 }
 
 void TTS::PreviousLanguage() {
   if (current_language_index_ == 0) {
-    current_language_index_ = languages_.size() - 1;
+    UseLanguage(engines_->size() - 1);
   } else {
-    --current_language_index_;
+    UseLanguage(current_language_index_ - 1);
+  }
+}
+
+bool TTS::SelectLanguage(ECILanguageDialect language) {
+  for (std::size_t i = 0; i < engines_->size(); ++i) {
+    if (engines_->language(i) == language) {
+      UseLanguage(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+ECILanguageDialect TTS::GetLanguage() const {
+  return engines_->language(current_language_index_);
+}
+
+void TTS::UseLanguage(std::size_t index) {
+  // Any text added so far belongs to the previous language, so the pending
+  // task keeps pointing to the previous engine, and new tasks will use the new
+  // one.
+  const bool was_loaded = engines_->loaded(index);
+  current_language_index_ = index;
+  eci_ = engines_->Get(index);
+
+  if (!was_loaded) {
+    ReportEngine(index);
+  }
+}
+
+void TTS::ReportEngine(std::size_t index) const {
+  if (!options_.verbose) return;
+
+  string name = GetLanguageName(engines_->language(index));
+  if (name.empty()) {
+    std::ostringstream code;
+    code << "0x" << std::hex << engines_->language(index);
+    name = code.str();
+  }
+  std::cerr << "TTS: Loaded engine for language " << name << " in "
+            << engines_->load_time(index).count() / 1000.0 << "ms, using "
+            << engines_->memory_cost(index) / 1024 << "KiB." << std::endl;
+}
+
+std::queue<std::unique_ptr<AudioTask>> TTS::Interrupt() {
+  // The output is only interrupted if it is not playing another source.
+  const int playing = audio_->current_source();
+  std::queue<std::unique_ptr<AudioTask>> tasks = audio_->Clear(source_);
+  if (playing < 0 || playing == source_) {
+    paused_ = false;
+    audio_->player()->Interrupt();
   }
-  eci_->SetParam(eciLanguageDialect, languages_[current_language_index_]);
+  return tasks;
+}
+
+void TTS::ReportInterruption() const {
+  if (!options_.verbose) return;
+
+  const auto *task = dynamic_cast<const SpeechTask *>(
+      interrupted_.at(source_).front().get());
+  if (task == nullptr) return;
+  std::cerr << "TTS: Resuming speech after word " << task->last_spoken_mark()
+            << " of " << task->num_marks() << "." << std::endl;
 }
 
 TTS::SampleRate TTS::GetSampleRateConfig(int sample_rate) {
@@ -171,13 +312,18 @@ TTS::SampleRate TTS::GetSampleRateConfig(int sample_rate) {
   return it->second;
 }
 
+unsigned int TTS::GetSampleRateHz(SampleRate sample_rate) {
+  switch (sample_rate) {
+    case R_8000:
+      return 8000;
+    case R_22050:
+      return 22050;
+    default:
+      return 11025;
+  }
+}
+
 ECILanguageDialect TTS::GetLanguageConfig(const string &language) {
-  static const std::map<string, ECILanguageDialect> kSupportedLanguages = {
-      {"en_US", eciGeneralAmericanEnglish}, {"en_GB", eciBritishEnglish},
-      {"es_ES", eciCastilianSpanish},       {"es_MX", eciMexicanSpanish},
-      {"fr_FR", eciStandardFrench},         {"fr_CA", eciCanadianFrench},
-      {"de_DE", eciStandardGerman},         {"it_IT", eciStandardItalian},
-      {"pt_BR", eciBrazilianPortuguese},    {"fi_FI", eciStandardFinnish}};
   auto it = kSupportedLanguages.find(language);
   if (it == kSupportedLanguages.end()) {
     throw TTSError("Unknown language.");
@@ -185,3 +331,19 @@ ECILanguageDialect TTS::GetLanguageConfig(const string &language) {
 
   return it->second;
 }
+
+string TTS::GetLanguageName(ECILanguageDialect language) {
+  for (const auto &entry : kSupportedLanguages) {
+    if (entry.second == language) return entry.first;
+  }
+  return string();
+}
+
+TTS::ECIVoiceAnnotation TTS::GetVoiceConfig(const string &name) {
+  for (int i = 0; i < NO_ANNOTATION; ++i) {
+    if (name == kVoicePresets[i].name) {
+      return static_cast<ECIVoiceAnnotation>(i);
+    }
+  }
+  throw TTSError("Unknown voice.");
+}
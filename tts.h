@@ -18,8 +18,15 @@
 #include "audio_manager.h"
 #include "audio_tasks.h"
 #include "eci-c++.h"
+#include "engine_pool.h"
+#include "resampler.h"
+#include "silence_trimmer.h"
+#include "speech_converter.h"
+#include "voice_table.h"
 
+#include <map>
 #include <memory>
+#include <queue>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -44,21 +51,45 @@ class TTS {
     R_22050 = 2,
   };
 
+  // Preset voices, named after the voices of the Emacspeak Outloud server,
+  // e.g. "harry" for HARRY.
   enum ECIVoiceAnnotation {
     DEFAULT_VOICE,  // Adult male.
-    NO_ANNOTATION,
-    // TODO: add more.
+    HARRY,          // Adult male, deeper.
+    DENNIS,         // Adult male, flat.
+    FRANK,          // Adult male, larger.
+    BETTY,          // Elderly female.
+    URSULA,         // Adult female.
+    RITA,           // Adult female, lower.
+    WENDY,          // Adult female, higher.
+    KIT,            // Child.
+    NO_ANNOTATION,  // Keeps the current voice.
   };
 
   // Options to configure the behavior of this class.
   struct Options {
     Options() noexcept {}
 
-    // Sample rate of synthesized speech.
+    // Sample rate of synthesized speech. If it differs from the sample rate
+    // of the player, speech is resampled.
     SampleRate sample_rate = R_11025;
 
+    // Quality of the resampling of speech, if needed.
+    Resampler::Quality resample_quality = Resampler::MEDIUM;
+
+    // Whether to remove the silence at both ends of each utterance, and how.
+    bool trim_silence = false;
+    SilenceTrimmer::Options trim_options;
+
     // Default language to load the TTS.
     ECILanguageDialect default_language = eciGeneralAmericanEnglish;
+
+    // Whether to initialize the engines for all available languages at
+    // startup, instead of the first time each language is selected.
+    bool preload_languages = false;
+
+    // Whether to report the cost of loading each language engine.
+    bool verbose = false;
   };
 
   static constexpr char kEciLibraryName[] = "libibmeci.so";
@@ -78,8 +109,9 @@ class TTS {
   // ownership to the caller.
   std::unique_ptr<SpeechTask> ReleaseTask();
 
-  // Submits the current pending task for execution, if any.
-  bool SubmitTask();
+  // Submits the current pending task for execution in the given lane of the
+  // audio manager, if any.
+  bool SubmitTask(AudioManager::Lane lane = AudioManager::BULK);
 
   // Adds the given text to be an output. The texts can be appended with
   // subsequent calls to this function. The final output will only be produced
@@ -96,20 +128,40 @@ class TTS {
   bool Output(const std::string& msg);
 
   // Helper method to generate the internal PCM representation of the speech,
-  // prefixing the text with a string to control the speed of the speech engine.
-  // This would be the same as
-  // AddText(GetPrefixString() + text), Synthesize().
+  // using the given voice and the current speech rate. The voice and rate are
+  // set through engine parameters before the text is added, and only when they
+  // differ from the ones the engine is already using.
   bool Say(const std::string& msg,
            const ECIVoiceAnnotation voice = NO_ANNOTATION);
 
-  bool GenerateSilence(const int duration);
+  // Returns a task that says the given text with the default voice, without
+  // touching the pending task, e.g. for notices of the server itself.
+  std::unique_ptr<SpeechTask> MakeNotice(const std::string& msg);
 
+  // Pauses the output. If the sound device cannot pause, the tasks of the
+  // current source are interrupted instead, and kept so that Resume()
+  // continues them from the last spoken word.
   bool Pause();
 
+  // Resumes the output after Pause(). Returns false if there is nothing to
+  // resume, e.g. after Stop().
   bool Resume();
 
+  // Stops the output and discards all queued tasks of the current source,
+  // including those interrupted by Pause(). If the audio manager is playing
+  // the tasks of another source, they keep playing.
   bool Stop();
 
+  // Sets the source on whose behalf tasks are submitted, stopped and resumed,
+  // e.g. the client whose commands are being run. Pausing affects all the
+  // sources, since they share the player.
+  void set_source(int source) { source_ = source; }
+  int source() const { return source_; }
+
+  // Stops the tasks of the given source and forgets its interrupted tasks,
+  // e.g. when the client disconnects.
+  void RemoveSource(int source);
+
   std::string TTSVersion();
 
   // Selects the next available language.
@@ -118,33 +170,84 @@ class TTS {
   // Selects the previous available language.
   void PreviousLanguage();
 
+  // Selects the given language. Returns false if the language is not
+  // available.
+  bool SelectLanguage(ECILanguageDialect language);
+
+  // Returns the currently selected language.
+  ECILanguageDialect GetLanguage() const;
+
   int GetSpeechRate() const { return speech_rate_; }
 
   void SetSpeechRate(const int speech_rate) { speech_rate_ = speech_rate; }
 
-  const std::string GetPrefixString() const;
+  // Voice that the commands speak with, DEFAULT_VOICE unless selected
+  // otherwise.
+  ECIVoiceAnnotation GetVoice() const { return voice_; }
+  void SetVoice(const ECIVoiceAnnotation voice) { voice_ = voice; }
+
+  // Changes the tempo of the speech being played, and of all the speech that
+  // follows, without synthesizing it again, e.g. 1.5 to speak 50% faster.
+  void SetPlaybackTempo(double tempo) { converter_->set_tempo(tempo); }
+  double GetPlaybackTempo() const { return converter_->tempo(); }
 
-  // Helper method to output a task containing only the voice annotation, e.g, a
-  // string annotation making the speech engine use the default parameters for
-  // the selected voice.
+  // Helper method to output a task that only selects the given voice, making
+  // the speech engine use the default parameters for it.
   std::unique_ptr<SpeechTask> UseSelectedVoice(const ECIVoiceAnnotation voice);
 
   // Returns the sample rate configuration for the TTS/ECI classes equivalent
   // to the given sample rate in Hz.
   static SampleRate GetSampleRateConfig(int sample_rate);
 
+  // Returns the sample rate in Hz of the given configuration.
+  static unsigned int GetSampleRateHz(SampleRate sample_rate);
+
   // Returns the language configuration for the TTS/ECI classes.
   static ECILanguageDialect GetLanguageConfig(const std::string& language);
 
+  // Returns the name of the given language configuration, e.g. "en_US", or an
+  // empty string if the language is unknown.
+  static std::string GetLanguageName(ECILanguageDialect language);
+
+  // Returns the preset voice with the given name, e.g. "harry".
+  static ECIVoiceAnnotation GetVoiceConfig(const std::string& name);
+
  private:
-  std::vector<ECILanguageDialect> languages_;
-  int current_language_index_;
+  // Switches to the engine of the language at the given index of the pool,
+  // creating it if needed.
+  void UseLanguage(std::size_t index);
+
+  // Reports the cost of loading the engine at the given index of the pool.
+  void ReportEngine(std::size_t index) const;
+
+  // Clears the tasks of the current source, interrupting the output if it is
+  // playing them, and returns them.
+  std::queue<std::unique_ptr<AudioTask>> Interrupt();
 
-  std::unique_ptr<ECI> eci_;
+  // Reports where the interrupted speech is going to be resumed.
+  void ReportInterruption() const;
+
+  const Options options_;
+  std::unique_ptr<EnginePool> engines_;
+  std::size_t current_language_index_;
+
+  // Engine of the currently selected language, owned by engines_.
+  ECI* eci_ = nullptr;
   AudioManager* audio_;
+  std::unique_ptr<SpeechConverter> converter_;
 
   std::unique_ptr<SpeechTask> pending_task_;
 
+  // Source of the tasks submitted, stopped and resumed.
+  int source_ = 0;
+
+  // Tasks interrupted by Pause() when the player could not pause, by source,
+  // and whether the player is paused.
+  std::map<int, std::queue<std::unique_ptr<AudioTask>>> interrupted_;
+  bool paused_ = false;
+
+  VoiceTable voices_;
+  ECIVoiceAnnotation voice_ = DEFAULT_VOICE;
   int speech_rate_ = 50;
 };
 
@@ -0,0 +1,191 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the underruns of the audio output with and without the audio
+// thread of ThreadedSink, while the CPU is loaded. Tones are played without
+// a gap on a null sink with a real time clock, while busy threads keep every
+// CPU loaded and the main loop stalls periodically, as it does for a large
+// regex or a page fault, e.g.:
+//
+//   underrun_benchmark --seconds 10 --buffer-time 20 --stall 15
+//
+// Both configurations use the same device buffer, which sets how long a stop
+// takes to be heard. The ring buffer of the audio thread holds another buffer
+// of audio, but it is dropped at once on a stop. The audio thread only gets a
+// real-time priority with the privileges for it, e.g. as root or with rtprio
+// in /etc/security/limits.conf.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include <boost/program_options.hpp>
+
+#include "audio_manager.h"
+#include "audio_tasks.h"
+#include "null_sink.h"
+#include "threaded_sink.h"
+
+namespace po = boost::program_options;
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+// Interval between the stalls of the main loop.
+const std::chrono::milliseconds kStallInterval(100);
+
+struct Config {
+  std::chrono::seconds duration{10};
+  std::chrono::milliseconds buffer_time{20};
+  std::chrono::milliseconds stall{0};
+  int stress_threads = 0;
+  int priority = 50;
+};
+
+// Busy loops until the given time.
+void Spin(SteadyClock::time_point until) {
+  while (SteadyClock::now() < until) {
+  }
+}
+
+// Plays tones for the configured duration, with or without the audio thread,
+// and returns the number of underruns.
+int Run(const Config& config, bool audio_thread) {
+  NullSink::Options sink_options;
+  sink_options.buffer_time = config.buffer_time;
+  std::unique_ptr<AudioSink> sink(new NullSink(sink_options));
+  if (audio_thread) {
+    ThreadedSink::Options thread_options;
+    thread_options.verbose = true;
+    thread_options.priority = config.priority;
+    sink.reset(new ThreadedSink(std::move(sink), thread_options));
+  }
+  AudioManager audio(std::move(sink));
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> stress;
+  for (int i = 0; i < config.stress_threads; ++i) {
+    stress.emplace_back([&stop]() {
+      while (!stop) {
+      }
+    });
+  }
+
+  std::vector<struct pollfd> fds = audio.GetPollDescriptors();
+  const auto start = SteadyClock::now();
+  auto next_stall = start + kStallInterval;
+  while (SteadyClock::now() - start < config.duration) {
+    // Keep a tone queued after the one playing, so the output has no gaps.
+    while (audio.lane_stats(AudioManager::BULK).depth < 2) {
+      audio.Push(std::unique_ptr<AudioTask>(new ToneTask(440, 0.3f, 200)));
+    }
+
+    if (config.stall.count() > 0 && SteadyClock::now() >= next_stall) {
+      Spin(SteadyClock::now() + config.stall);
+      next_stall += kStallInterval;
+    }
+
+    for (auto& fd : fds) {
+      fd.revents = 0;
+    }
+    poll(fds.data(), fds.size(), audio.GetPollTimeout());
+    if (audio.GetPollEvents(fds.data(), fds.size())) {
+      audio.Run();
+    }
+  }
+
+  stop = true;
+  for (auto& thread : stress) {
+    thread.join();
+  }
+  return audio.player()->underruns();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  /* clang-format off */
+  po::options_description options("Benchmark options");
+  options.add_options()
+      ("help,h", "Display this help message.")
+      ("seconds", po::value<int>()->value_name("seconds"),
+       "Duration of each run (default: 10).")
+      ("buffer-time", po::value<int>()->value_name("ms"),
+       "Buffer time of the device (default: 20).")
+      ("stall", po::value<int>()->value_name("ms"),
+       "Time the main loop stalls every 100ms (default: 0).")
+      ("stress-threads", po::value<int>()->value_name("count"),
+       "Number of busy threads loading the CPU (default: one per CPU).")
+      ("audio-priority", po::value<int>()->value_name("priority"),
+       "SCHED_FIFO priority of the audio thread (default: 50).");
+  /* clang-format on */
+
+  po::variables_map args;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), args);
+    po::notify(args);
+  } catch (po::error& e) {
+    cerr << "Error parsing command line options:\n" << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (args.count("help")) {
+    cerr << options << "\n";
+    return EXIT_SUCCESS;
+  }
+
+  Config config;
+  if (args.count("seconds")) {
+    config.duration = std::chrono::seconds(args["seconds"].as<int>());
+  }
+  if (args.count("buffer-time")) {
+    config.buffer_time =
+        std::chrono::milliseconds(args["buffer-time"].as<int>());
+  }
+  if (args.count("stall")) {
+    config.stall = std::chrono::milliseconds(args["stall"].as<int>());
+  }
+  config.stress_threads = args.count("stress-threads")
+                              ? args["stress-threads"].as<int>()
+                              : std::thread::hardware_concurrency();
+  if (args.count("audio-priority")) {
+    config.priority = args["audio-priority"].as<int>();
+  }
+
+  cout << "Playing " << config.duration.count() << "s of tones with "
+       << config.buffer_time.count() << "ms of buffer, "
+       << config.stress_threads << " busy thread(s) and a "
+       << config.stall.count() << "ms stall every " << kStallInterval.count()
+       << "ms.\n";
+
+  const double minutes = config.duration.count() / 60.0;
+  for (bool audio_thread : {false, true}) {
+    const int underruns = Run(config, audio_thread);
+    cout << (audio_thread ? "Audio thread: " : "Main loop:    ") << underruns
+         << " underrun(s), " << underruns / minutes << " per minute.\n";
+  }
+  return EXIT_SUCCESS;
+}
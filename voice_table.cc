@@ -0,0 +1,102 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "voice_table.h"
+
+constexpr int VoicePreset::kKeep;
+constexpr int VoiceTable::kCurrentVoice;
+constexpr int VoiceTable::kActiveVoice;
+constexpr int VoiceTable::kFirstCacheSlot;
+constexpr int VoiceTable::kNumCacheSlots;
+
+VoiceTable::VoiceTable(std::vector<VoicePreset> presets)
+    : presets_(std::move(presets)) {}
+
+VoiceTable::Key VoiceTable::MakeKey(int voice, int speed) {
+  // Offset by one, so that zero is never a valid key.
+  return ((static_cast<Key>(voice) + 1) << 16) | (speed & 0xffff);
+}
+
+void VoiceTable::Apply(ECI* eci, int voice, int speed) {
+  EngineState& state = engines_[eci];
+
+  if (voice == kCurrentVoice) {
+    // Keep the active voice. If it is known, it may still be selected from the
+    // cache with the new speed, otherwise, change only the speed.
+    if (state.voice == kCurrentVoice) {
+      if (state.speed != speed) {
+        eci->SetVoiceParam(kActiveVoice, eciSpeed, speed);
+        state.speed = speed;
+      }
+      return;
+    }
+    voice = state.voice;
+  }
+
+  if (state.voice == voice && state.speed == speed) {
+    return;
+  }
+
+  eci->CopyVoice(GetSlot(eci, &state, voice, speed), kActiveVoice);
+  state.voice = voice;
+  state.speed = speed;
+}
+
+void VoiceTable::Invalidate(ECI* eci) {
+  EngineState& state = engines_[eci];
+  state.voice = kCurrentVoice;
+  state.speed = kCurrentVoice;
+}
+
+int VoiceTable::GetSlot(ECI* eci, EngineState* state, int voice, int speed) {
+  const Key key = MakeKey(voice, speed);
+
+  // Look for the voice in the cache, and for the least recently used slot
+  // in case it is not there.
+  int lru = 0;
+  for (int i = 0; i < kNumCacheSlots; ++i) {
+    if (state->slots[i] == key) {
+      state->last_used[i] = ++clock_;
+      return kFirstCacheSlot + i;
+    }
+    if (state->last_used[i] < state->last_used[lru]) {
+      lru = i;
+    }
+  }
+
+  // Build the voice in the evicted slot.
+  const VoicePreset& preset = presets_[voice];
+  const int slot = kFirstCacheSlot + lru;
+  eci->CopyVoice(preset.base_voice, slot);
+
+  const struct {
+    ECIVoiceParam parameter;
+    int value;
+  } parameters[] = {
+      {eciHeadSize, preset.head_size},
+      {eciPitchBaseline, preset.pitch_baseline},
+      {eciPitchFluctuation, preset.pitch_fluctuation},
+      {eciVolume, preset.volume},
+      {eciSpeed, speed},
+  };
+  for (const auto& p : parameters) {
+    if (p.value != VoicePreset::kKeep) {
+      eci->SetVoiceParam(slot, p.parameter, p.value);
+    }
+  }
+
+  state->slots[lru] = key;
+  state->last_used[lru] = ++clock_;
+  return slot;
+}
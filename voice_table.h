@@ -0,0 +1,108 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef VOICE_TABLE_H_
+#define VOICE_TABLE_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "eci-c++.h"
+
+// Definition of a preset voice, in terms of ECI voice parameters.
+struct VoicePreset {
+  // Value used for parameters that should be kept as defined by base_voice.
+  static constexpr int kKeep = -1;
+
+  // Name of the voice.
+  const char* name;
+
+  // Built-in ECI voice that this voice is based on, from 1 to
+  // ECI_PRESET_VOICES.
+  int base_voice;
+
+  // ECI voice parameters overriding the ones of the base voice, or kKeep.
+  int head_size;
+  int pitch_baseline;
+  int pitch_fluctuation;
+  int volume;
+};
+
+// Table of preset voices, applied to ECI engines through voice parameters.
+//
+// Selecting a voice through in-band annotations (e.g. "`v1 `vs50 ") makes
+// the engine parse them again for every utterance. Instead, this class builds
+// each combination of voice and speed once in one of the user-defined voice
+// slots of the engine, using eciCopyVoice() and eciSetVoiceParam(), and then
+// selects it with a single eciCopyVoice() into the active voice. It also keeps
+// track of the active voice of each engine, so that selecting the voice that
+// is already active does not call the engine at all.
+class VoiceTable {
+ public:
+  // Voice index meaning that the active voice should be kept, changing only
+  // its speed.
+  static constexpr int kCurrentVoice = -1;
+
+  explicit VoiceTable(std::vector<VoicePreset> presets);
+
+  // Returns the number of voices in the table.
+  int size() const { return presets_.size(); }
+
+  // Makes the voice at the given index of the table, with the given speed,
+  // the active voice of the engine. If voice is kCurrentVoice, only the speed
+  // of the active voice is changed.
+  void Apply(ECI* eci, int voice, int speed);
+
+  // Forgets what the active voice of the engine is, e.g. after text with
+  // voice annotations was sent to it, so the next call to Apply() sets it
+  // again.
+  void Invalidate(ECI* eci);
+
+ private:
+  // Voice slot of the engine where the voice parameters take effect.
+  static constexpr int kActiveVoice = 0;
+
+  // First and number of voice slots available to cache voice settings.
+  static constexpr int kFirstCacheSlot = ECI_PRESET_VOICES + 1;
+  static constexpr int kNumCacheSlots = ECI_USER_DEFINED_VOICES;
+
+  // Identifies a combination of voice and speed.
+  using Key = std::uint32_t;
+  static Key MakeKey(int voice, int speed);
+
+  // Voice state of one engine.
+  struct EngineState {
+    // Combination of voice and speed stored at each cache slot, or zero if
+    // the slot is unused.
+    Key slots[kNumCacheSlots] = {};
+
+    // Last time each slot was used, to evict the least recently used.
+    std::uint64_t last_used[kNumCacheSlots] = {};
+
+    // Current active voice and speed, or kCurrentVoice if unknown.
+    int voice = kCurrentVoice;
+    int speed = kCurrentVoice;
+  };
+
+  // Returns the cache slot holding the given voice and speed, building it if
+  // necessary.
+  int GetSlot(ECI* eci, EngineState* state, int voice, int speed);
+
+  const std::vector<VoicePreset> presets_;
+  std::unordered_map<ECI*, EngineState> engines_;
+  std::uint64_t clock_ = 0;
+};
+
+#endif  // VOICE_TABLE_H_
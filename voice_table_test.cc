@@ -0,0 +1,104 @@
+// Copyright 2015 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests of the voice table, run against the fake ECI library whose path is
+// given as the only argument.
+
+#include "voice_table.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using std::string;
+
+bool good = true;
+
+void Check(const string& name, bool condition, double value) {
+  if (!condition) {
+    good = false;
+    std::cout << "[FAIL] " << name << ": " << value << "\n";
+  } else {
+    std::cout << "[GOOD] " << name << ": " << value << "\n";
+  }
+}
+
+// Voice slot of the engine where the voice parameters take effect.
+const int kActiveVoice = 0;
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <fake ECI library>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  ECI::Init(argv[1]);
+  ECI eci;
+
+  const int kKeep = VoicePreset::kKeep;
+  VoiceTable voices({
+      // name, base_voice, head_size, pitch_baseline, pitch_fluctuation, volume
+      {"plain", 1, kKeep, kKeep, kKeep, kKeep},
+      {"custom", 2, 60, 70, 20, 80},
+  });
+
+  // The parameters of the preset override those of its base voice.
+  voices.Apply(&eci, 1, 70);
+  Check("Gender of the base voice",
+        eci.GetVoiceParam(kActiveVoice, eciGender) ==
+            eci.GetVoiceParam(2, eciGender),
+        eci.GetVoiceParam(kActiveVoice, eciGender));
+  Check("Head size", eci.GetVoiceParam(kActiveVoice, eciHeadSize) == 60,
+        eci.GetVoiceParam(kActiveVoice, eciHeadSize));
+  Check("Pitch baseline",
+        eci.GetVoiceParam(kActiveVoice, eciPitchBaseline) == 70,
+        eci.GetVoiceParam(kActiveVoice, eciPitchBaseline));
+  Check("Pitch fluctuation",
+        eci.GetVoiceParam(kActiveVoice, eciPitchFluctuation) == 20,
+        eci.GetVoiceParam(kActiveVoice, eciPitchFluctuation));
+  Check("Volume", eci.GetVoiceParam(kActiveVoice, eciVolume) == 80,
+        eci.GetVoiceParam(kActiveVoice, eciVolume));
+  Check("Speed", eci.GetVoiceParam(kActiveVoice, eciSpeed) == 70,
+        eci.GetVoiceParam(kActiveVoice, eciSpeed));
+
+  // Parameters that are kept come from the base voice.
+  voices.Apply(&eci, 0, 50);
+  Check("Kept head size",
+        eci.GetVoiceParam(kActiveVoice, eciHeadSize) ==
+            eci.GetVoiceParam(1, eciHeadSize),
+        eci.GetVoiceParam(kActiveVoice, eciHeadSize));
+
+  // Selecting the active voice and speed again does not touch the engine, so
+  // a change behind the back of the table stays until it is invalidated.
+  eci.SetVoiceParam(kActiveVoice, eciSpeed, 10);
+  voices.Apply(&eci, 0, 50);
+  voices.Apply(&eci, VoiceTable::kCurrentVoice, 50);
+  Check("Unchanged voice not applied",
+        eci.GetVoiceParam(kActiveVoice, eciSpeed) == 10,
+        eci.GetVoiceParam(kActiveVoice, eciSpeed));
+  voices.Invalidate(&eci);
+  voices.Apply(&eci, 0, 50);
+  Check("Applied after invalidation",
+        eci.GetVoiceParam(kActiveVoice, eciSpeed) == 50,
+        eci.GetVoiceParam(kActiveVoice, eciSpeed));
+
+  // The current voice is kept when only the speed changes.
+  voices.Apply(&eci, 1, 50);
+  voices.Apply(&eci, VoiceTable::kCurrentVoice, 90);
+  Check("Speed of the current voice",
+        eci.GetVoiceParam(kActiveVoice, eciSpeed) == 90 &&
+            eci.GetVoiceParam(kActiveVoice, eciHeadSize) == 60,
+        eci.GetVoiceParam(kActiveVoice, eciSpeed));
+
+  return good ? EXIT_SUCCESS : EXIT_FAILURE;
+}